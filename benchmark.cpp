@@ -0,0 +1,433 @@
+// Throughput/latency benchmark for tcpsock.hpp.
+//
+// Runs a server and its clients over loopback in one process, for each I/O backend:
+//   blocking - a thread per connection, blocking accept/recv/send.
+//   epoll    - one skt::EventLoop thread (WSAPoll on Windows).
+//   uring    - one skt::Uring thread. Only with -DSKT_IO_URING, Linux 5.6+.
+//
+// Tests:
+//   pingpong   - round trip latency of `--size` byte messages: p50/p99/p999, and round trips/sec.
+//   throughput - clients stream `--size` byte chunks, the server counts what it received.
+//   accept     - clients connect and reset in a loop, the server counts its accepts.
+//   idle       - opens `--connections` idle connections, and reports the memory they take.
+//
+// Usage: ./benchmark [--test all|pingpong|throughput|accept|idle] [--backend all|blocking|epoll|uring]
+//                    [--seconds 3] [--size bytes] [--clients 1] [--connections 1000] [--port 19120]
+//
+// One result per line, `key=value` pairs, so it can be diffed or parsed by CI.
+
+#include "tcpsock.hpp"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#ifndef SO_WINDOWS
+#include <sys/resource.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+enum class Mode { ECHO, SINK, ACCEPT, HOLD };
+
+struct Config {
+    std::string test = "all";
+    std::string backend = "all";
+    int seconds = 3;
+    size_t size = 0;        // 0: the test default, 64 for pingpong, 64 KB for throughput.
+    int clients = 1;
+    int connections = 1000;
+    int port = 19120;       // Below the ephemeral ranges (32768+ on Linux, 49152+ on Windows), the clients can't take it.
+};
+
+// What the server side counted.
+struct Counters {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> accepts{0};
+    std::atomic<uint64_t> open{0};
+};
+
+// A server running one backend in its own thread.
+class BenchServer {
+    skt::Socket sock;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+    int port;
+
+public:
+    Counters counters;
+
+    template<typename Serve>
+    BenchServer(int port, Serve serve) : sock(port, ANY_ADDR, false, true, skt::MAX_BACKLOG), port(port) {
+        thread = std::thread([this, serve] { serve(sock, counters, stopping); });
+    }
+
+    // Stops the server. The listener is woken with one more connection, and sees the flag.
+    ~BenchServer() {
+        stopping = true;
+        try {
+            skt::Socket wake(port, LOCALHOST, true);
+            wake.connect();
+        } catch(const std::exception&) {}
+        thread.join();
+    }
+};
+
+// Serves with blocking calls, a thread per connection.
+void serveBlocking(skt::Socket& sock, Mode mode, Counters& counters, std::atomic<bool>& stopping) {
+    std::vector<std::thread> threads;
+    while(true) {
+        skt::Node node;
+        try {
+            node = sock.accept();
+        } catch(const std::exception&) {
+            continue;  // Ex: a client reset before it was accepted.
+        }
+        if(stopping) break;
+        counters.accepts.fetch_add(1, std::memory_order_relaxed);
+        if(mode == Mode::ACCEPT) continue;
+
+        // Runs until the client closes: the tests close their clients before stopping the server.
+        threads.emplace_back([&counters, mode, node = std::move(node)]() mutable {
+            counters.open.fetch_add(1, std::memory_order_relaxed);
+            std::vector<char> buffer(mode == Mode::HOLD ? 1 : 1 << 16);
+            try {
+                while(size_t n = node.recv(buffer.data(), buffer.size())) {
+                    counters.bytes.fetch_add(n, std::memory_order_relaxed);
+                    if(mode == Mode::ECHO) node.sendAll(std::string_view(buffer.data(), n));
+                }
+            } catch(const std::exception&) {}
+            counters.open.fetch_sub(1, std::memory_order_relaxed);
+        });
+    }
+    for(std::thread& t : threads) t.join();
+}
+
+// Serves from a single skt::EventLoop.
+void serveEpoll(skt::Socket& sock, Mode mode, Counters& counters, std::atomic<bool>& stopping) {
+    skt::EventLoop loop;
+    std::unordered_map<sock_t, std::unique_ptr<skt::Node>> nodes;
+    std::vector<char> buffer(1 << 16);
+    sock.setNonBlocking(true);
+
+    auto close = [&](sock_t fd) {
+        loop.remove(fd);
+        nodes.erase(fd);
+        counters.open.fetch_sub(1, std::memory_order_relaxed);
+    };
+
+    auto onReadable = [&](sock_t fd) {
+        skt::Node& node = *nodes[fd];
+        while(true) {
+            skt::Result<size_t> n = node.recvSome(buffer.data(), buffer.size());
+            if(!n && skt::isWouldBlock(n.error())) return;
+            if(!n || *n == 0) return close(fd);
+
+            counters.bytes.fetch_add(*n, std::memory_order_relaxed);
+            if(mode == Mode::ECHO) node.sendAll(std::string_view(buffer.data(), *n));
+        }
+    };
+
+    loop.add(sock.getSocket(), skt::READABLE, {[&] {
+        while(true) {
+            skt::Result<skt::Node> accepted = sock.acceptSome();
+            if(stopping) return loop.stop();
+            if(!accepted) return;
+            counters.accepts.fetch_add(1, std::memory_order_relaxed);
+            if(mode == Mode::ACCEPT) continue;
+
+            auto node = std::make_unique<skt::Node>(std::move(*accepted));
+            node->setNonBlocking(true);
+            sock_t fd = node->getSock();
+            nodes.emplace(fd, std::move(node));
+            counters.open.fetch_add(1, std::memory_order_relaxed);
+            loop.add(fd, skt::READABLE, {[&, fd] { onReadable(fd); }, nullptr, [&, fd] { close(fd); }});
+        }
+    }, nullptr, nullptr});
+
+    loop.run();
+}
+
+#if defined(SKT_IO_URING) && !defined(SO_WINDOWS)
+// Serves from a single skt::Uring: every accept, recv and send is a queued operation.
+void serveUring(skt::Socket& sock, Mode mode, Counters& counters, std::atomic<bool>& stopping) {
+    enum Op : uint64_t { ACCEPT, RECV, SEND };
+    struct Connection {
+        skt::Node node;
+        std::vector<char> buffer;
+        size_t length = 0, sent = 0;
+    };
+
+    // Declared before the ring: pending operations point into these buffers until the ring is gone.
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    skt::Uring ring(1024);
+
+    auto tag = [](int fd, Op op) { return ((uint64_t)fd << 8) | op; };
+    auto recv = [&](Connection& c) {
+        ring.recv(c.node.getSock(), c.buffer.data(), c.buffer.size(), tag(c.node.getSock(), RECV));
+    };
+
+    ring.accept(sock.getSocket(), tag(sock.getSocket(), ACCEPT));
+    bool running = true;
+    while(running) {
+        ring.submit(1);
+        ring.reap([&](const skt::Uring::Completion& done) {
+            int fd = (int)(done.userData >> 8);
+            Op op = (Op)(done.userData & 0xff);
+
+            if(op == ACCEPT) {
+                if(stopping) { running = false; if(done.result >= 0) ::close(done.result); return; }
+                ring.accept(sock.getSocket(), tag(sock.getSocket(), ACCEPT));
+                if(done.result < 0) return;
+                counters.accepts.fetch_add(1, std::memory_order_relaxed);
+                if(mode == Mode::ACCEPT) { ::close(done.result); return; }
+
+                auto c = std::make_unique<Connection>();
+                c->node.setSock(done.result);
+                c->buffer.resize(mode == Mode::HOLD ? 1 : 1 << 16);
+                recv(*c);
+                connections.emplace(done.result, std::move(c));
+                counters.open.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            auto it = connections.find(fd);
+            if(it == connections.end()) return;
+            Connection& c = *it->second;
+            if(done.result <= 0) {
+                connections.erase(it);
+                counters.open.fetch_sub(1, std::memory_order_relaxed);
+                return;
+            }
+
+            if(op == RECV) {
+                counters.bytes.fetch_add(done.result, std::memory_order_relaxed);
+                if(mode != Mode::ECHO) return recv(c);
+                c.length = done.result;
+                c.sent = 0;
+            } else {
+                c.sent += done.result;
+                if(c.sent == c.length) return recv(c);
+            }
+            ring.send(fd, c.buffer.data() + c.sent, c.length - c.sent, tag(fd, SEND));
+        });
+    }
+}
+#endif
+
+using Serve = std::function<void(skt::Socket&, Counters&, std::atomic<bool>&)>;
+
+// Returns the server function of a backend, in the given mode.
+Serve backend(const std::string& name, Mode mode) {
+    if(name == "blocking") return [mode](skt::Socket& s, Counters& c, std::atomic<bool>& stop) { serveBlocking(s, mode, c, stop); };
+    if(name == "epoll") return [mode](skt::Socket& s, Counters& c, std::atomic<bool>& stop) { serveEpoll(s, mode, c, stop); };
+#if defined(SKT_IO_URING) && !defined(SO_WINDOWS)
+    if(name == "uring") return [mode](skt::Socket& s, Counters& c, std::atomic<bool>& stop) { serveUring(s, mode, c, stop); };
+#endif
+    throw std::runtime_error("Unknown or disabled backend: " + name);
+}
+
+// Prints one result line.
+void report(const std::string& test, const std::string& backend, const std::string& results) {
+    std::cout << std::left << std::setw(11) << test << std::setw(9) << backend << results << std::endl;
+}
+
+// Runs `work(clientIndex)` on `clients` threads, and waits for all of them.
+template<typename F>
+void runClients(int clients, F work) {
+    std::vector<std::thread> threads;
+    for(int i = 0; i < clients; i++) threads.emplace_back(work, i);
+    for(std::thread& t : threads) t.join();
+}
+
+void pingpong(const Config& config, const std::string& name) {
+    size_t size = config.size ? config.size : 64;
+    BenchServer server(config.port, backend(name, Mode::ECHO));
+    std::vector<std::vector<uint64_t>> samples(config.clients);
+
+    Clock::time_point deadline = Clock::now() + std::chrono::seconds(config.seconds);
+    runClients(config.clients, [&](int index) {
+        skt::Socket client(config.port, LOCALHOST, true, skt::SocketOptions::lowLatency());
+        client.connect();
+        std::string message(size, 'x');
+        std::vector<char> reply(size);
+
+        std::vector<uint64_t>& rtts = samples[index];
+        for(int i = 0; ; i++) {
+            Clock::time_point start = Clock::now();
+            if(start >= deadline) break;
+            client.sendAll(message);
+            client.recvExact(reply.data(), reply.size());
+            // The first round trips are warm-up: connection setup, page faults, cold caches.
+            if(i >= 100) rtts.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        }
+    });
+
+    std::vector<uint64_t> rtts;
+    for(const auto& s : samples) rtts.insert(rtts.end(), s.begin(), s.end());
+    if(rtts.empty()) return report("pingpong", name, "no samples");
+    std::sort(rtts.begin(), rtts.end());
+
+    auto percentile = [&](double p) { return rtts[std::min(rtts.size() - 1, (size_t)(p * rtts.size()))] / 1000.0; };
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "size=" << size << " clients=" << config.clients
+        << " p50=" << percentile(0.50) << "us p99=" << percentile(0.99) << "us p999=" << percentile(0.999) << "us"
+        << " rtt/s=" << (uint64_t)(rtts.size() / (double)config.seconds);
+    report("pingpong", name, out.str());
+}
+
+void throughput(const Config& config, const std::string& name) {
+    size_t size = config.size ? config.size : 1 << 16;
+    BenchServer server(config.port, backend(name, Mode::SINK));
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::seconds(config.seconds);
+    runClients(config.clients, [&](int) {
+        skt::Socket client(config.port, LOCALHOST, true, skt::SocketOptions::bulkThroughput());
+        client.connect();
+        std::string chunk(size, 'x');
+        while(Clock::now() < deadline) client.sendAll(chunk);
+    });
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t bytes = server.counters.bytes.load();
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1)
+        << "size=" << size << " clients=" << config.clients
+        << " MB/s=" << bytes / elapsed / 1e6 << " Gbit/s=" << std::setprecision(2) << bytes * 8 / elapsed / 1e9;
+    report("throughput", name, out.str());
+}
+
+void acceptRate(const Config& config, const std::string& name) {
+    BenchServer server(config.port, backend(name, Mode::ACCEPT));
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point deadline = start + std::chrono::seconds(config.seconds);
+    std::atomic<uint64_t> failures{0};
+    runClients(config.clients, [&](int) {
+        while(Clock::now() < deadline) {
+            try {
+                skt::Socket client(config.port, LOCALHOST, true);
+                client.connect();
+                // Closes with a reset: no TIME_WAIT, so the ephemeral ports don't run out.
+                linger reset{1, 0};
+                setsockopt(client.getSocket(), SOL_SOCKET, SO_LINGER, reinterpret_cast<const char*>(&reset), sizeof(reset));
+            } catch(const std::exception&) {
+                failures.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::ostringstream out;
+    out << "clients=" << config.clients
+        << " accepts/s=" << (uint64_t)(server.counters.accepts.load() / elapsed)
+        << " failed=" << failures.load();
+    report("accept", name, out.str());
+}
+
+// Returns the process resident memory, in bytes. 0 where it is not known.
+size_t residentMemory() {
+#ifdef SO_WINDOWS
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+// Returns the kernel memory held by TCP sockets, in bytes. 0 where it is not known.
+size_t socketMemory() {
+#ifdef SO_WINDOWS
+    return 0;
+#else
+    std::ifstream sockstat("/proc/net/sockstat");
+    std::string line, word;
+    while(std::getline(sockstat, line)) {
+        std::istringstream fields(line);
+        fields >> word;
+        if(word != "TCP:") continue;
+        size_t value;
+        while(fields >> word >> value) {
+            if(word == "mem") return value * sysconf(_SC_PAGESIZE);
+        }
+    }
+    return 0;
+#endif
+}
+
+void idle(const Config& config, const std::string& name) {
+#ifndef SO_WINDOWS
+    // Both ends of every connection live in this process.
+    rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+    BenchServer server(config.port, backend(name, Mode::HOLD));
+    size_t rssBefore = residentMemory(), kernelBefore = socketMemory();
+
+    std::vector<skt::Socket> clients;
+    clients.reserve(config.connections);
+    try {
+        for(int i = 0; i < config.connections; i++) {
+            clients.emplace_back(config.port, LOCALHOST, true);
+            clients.back().connect();
+        }
+    } catch(const std::exception& e) {
+        std::cerr << "idle: stopped at " << clients.size() << " connections: " << e.what() << std::endl;
+    }
+    while(server.counters.open.load() < clients.size()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    size_t opened = clients.size();
+    double rss = (double)residentMemory() - (double)rssBefore;
+    double kernel = (double)socketMemory() - (double)kernelBefore;
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2)
+        << "connections=" << opened
+        << " rss=" << rss / (1 << 20) << "MB kernel=" << kernel / (1 << 20) << "MB"
+        << " rss/conn=" << (opened ? rss / opened / 1024 : 0) << "KB";
+    report("idle", name, out.str());
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    for(int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i], value = argv[i + 1];
+        if(flag == "--test") config.test = value;
+        else if(flag == "--backend") config.backend = value;
+        else if(flag == "--seconds") config.seconds = std::stoi(value);
+        else if(flag == "--size") config.size = std::stoul(value);
+        else if(flag == "--clients") config.clients = std::stoi(value);
+        else if(flag == "--connections") config.connections = std::stoi(value);
+        else if(flag == "--port") config.port = std::stoi(value);
+        else { std::cerr << "Unknown option: " << flag << std::endl; return 1; }
+    }
+
+    std::vector<std::string> backends = {"blocking", "epoll"};
+#if defined(SKT_IO_URING) && !defined(SO_WINDOWS)
+    backends.push_back("uring");
+#endif
+    if(config.backend != "all") backends = {config.backend};
+
+    using Test = void(*)(const Config&, const std::string&);
+    std::vector<std::pair<std::string, Test>> tests = {
+        {"pingpong", pingpong}, {"throughput", throughput}, {"accept", acceptRate}, {"idle", idle}};
+
+    try {
+        for(const auto& [testName, test] : tests) {
+            if(config.test != "all" && config.test != testName) continue;
+            for(const std::string& name : backends) {
+                test(config, name);
+                config.port++;  // A fresh port per run: the previous listener may still be in TIME_WAIT.
+            }
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,128 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <iostream>
+
+using namespace std::chrono;
+
+// Reads until `size` bytes came.
+static skt::Task<void> readAll(skt::EventLoop& loop, skt::Node& node, size_t size, std::string& data, int& finished) {
+    while(data.size() < size) {
+        std::string part = co_await skt::recvAsync(loop, node);
+        assert(!part.empty());
+        data += part;
+    }
+    finished++;
+}
+
+static skt::Task<void> writeAll(skt::EventLoop& loop, skt::Node& node, const std::string& out, int& finished) {
+    co_await skt::sendAsync(loop, node, out);
+    finished++;
+}
+
+static skt::Task<void> connectTo(skt::EventLoop& loop, skt::Socket& client, milliseconds timeout) {
+    co_await skt::connectAsync(loop, client, timeout);
+}
+
+int main() {
+    // One coroutine reads while another writes, on the same socket: both go through.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        std::string out(8 << 20, 'a'), in, echoed;
+        for(size_t i = 0; i < out.size(); i += 4096) out[i] = (char)('a' + i / 4096 % 26);
+        int finished = 0;
+        skt::spawn(readAll(loop, pair.first, out.size(), in, finished));
+        skt::spawn(writeAll(loop, pair.first, out, finished));
+        // The other end does the same.
+        skt::spawn(readAll(loop, pair.second, out.size(), echoed, finished));
+        skt::spawn(writeAll(loop, pair.second, out, finished));
+        auto deadline = steady_clock::now() + seconds(20);
+        while(finished < 4) {
+            assert(steady_clock::now() < deadline);
+            loop.runOnce(100);
+        }
+        assert(in == out && echoed == out);
+        // Still registered, with nothing to wait for.
+        assert(loop.size() == 2 && loop.interest(pair.first) == 0 && loop.interest(pair.second) == 0);
+        loop.remove(pair.first);
+        loop.remove(pair.second);
+    }
+
+    // Awaits after the first don't register again.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        for(int i = 0; i < 100; i++) {
+            std::string data;
+            int finished = 0;
+            skt::spawn(readAll(loop, pair.first, 1, data, finished));
+            assert(loop.size() == 1 && loop.interest(pair.first) == skt::READABLE);
+            pair.second.send("x");
+            while(!finished) loop.runOnce(100);
+            assert(data == "x" && loop.size() == 1 && loop.interest(pair.first) == 0);
+        }
+        // A hang up with nobody waiting stops the watch, instead of firing on every tick.
+        pair.second.close();
+        for(int i = 0; i < 10 && loop.size(); i++) loop.runOnce(10);
+        assert(loop.size() == 0);
+        assert(skt::blockOn(loop, skt::recvAsync(loop, pair.first)).empty());
+    }
+
+    // A socket the user watches with its own handlers can't be awaited.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        loop.add(pair.first, skt::READABLE, {[] {}, nullptr, nullptr});
+        try { skt::blockOn(loop, skt::recvAsync(loop, pair.first)); assert(false); } catch(const std::runtime_error&) {}
+        loop.remove(pair.first);
+    }
+
+    // A connection that never completes times out, on the loop timers. 0 waits.
+    {
+        skt::EventLoop loop;
+        skt::Socket server(21601, LOCALHOST, false, true, 1);
+        // Fill the backlog, so the next handshakes are left hanging.
+        std::vector<std::unique_ptr<skt::Socket>> fillers;
+        bool hanging = false;
+        for(int i = 0; i < 64 && !hanging; i++) {
+            auto client = std::make_unique<skt::Socket>(21601, LOCALHOST, true);
+            try { skt::blockOn(loop, connectTo(loop, *client, milliseconds(200))); }
+            catch(const std::system_error& e) { assert(e.code() == std::errc::timed_out); hanging = true; loop.remove(client->getSocket()); }
+            fillers.push_back(std::move(client));
+        }
+        if(hanging) {
+            auto start = steady_clock::now();
+            skt::Socket late(21601, LOCALHOST, true);
+            try { skt::blockOn(loop, connectTo(loop, late, milliseconds(100))); assert(false); }
+            catch(const std::system_error& e) { assert(e.code() == std::errc::timed_out); }
+            assert(steady_clock::now() - start >= milliseconds(90));
+            loop.remove(late.getSocket());
+        } else {
+            std::cout << "(backlog never filled, timeout not checked)" << std::endl;
+        }
+        for(auto& client : fillers) loop.remove(client->getSocket());
+        skt::Socket other(21602, LOCALHOST);
+        skt::Socket client(21602, LOCALHOST, true);
+        skt::blockOn(loop, connectTo(loop, client, milliseconds(0)));
+    }
+
+    // Closed without being removed: the descriptor, once reused, is watched anew.
+    {
+        skt::EventLoop loop;
+        sock_t first;
+        {
+            auto pair = skt::socketPair(true);
+            first = pair.first;
+            pair.second.send("one");
+            assert(skt::blockOn(loop, skt::recvAsync(loop, pair.first)) == "one");
+        }
+        auto pair = skt::socketPair(true);
+        if((sock_t)pair.first != first) std::swap(pair.first, pair.second);
+        assert((sock_t)pair.first == first);
+        pair.second.send("two");
+        assert(skt::blockOn(loop, skt::recvAsync(loop, pair.first)) == "two");
+        loop.remove(pair.first);
+    }
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,86 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <future>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono;
+
+// Runs `loop.run()` on a thread, and fails if it does not return within `limit`.
+static void runWithin(skt::EventLoop& loop, milliseconds limit) {
+    auto done = std::async(std::launch::async, [&] { loop.run(); });
+    assert(done.wait_for(limit) == std::future_status::ready);
+    done.get();
+}
+
+int main() {
+    // A stop from another thread, before `run()` started, is not lost.
+    {
+        skt::EventLoop loop;
+        std::thread([&] { loop.stop(); }).join();
+        runWithin(loop, seconds(2));
+        // Consumed by that run: the next one waits for its own stop.
+        auto done = std::async(std::launch::async, [&] { loop.run(); });
+        assert(done.wait_for(milliseconds(100)) == std::future_status::timeout);
+        loop.stop();
+        assert(done.wait_for(seconds(2)) == std::future_status::ready);
+    }
+
+    // Stop while waiting, from another thread, and from a callback.
+    {
+        skt::EventLoop loop;
+        std::thread stopper([&] { std::this_thread::sleep_for(milliseconds(50)); loop.stop(); });
+        runWithin(loop, seconds(2));
+        stopper.join();
+
+        int ran = 0;
+        loop.post([&] { ran++; loop.stop(); });
+        runWithin(loop, seconds(2));
+        assert(ran == 1);
+    }
+
+    // Posted code runs on the loop thread, in order. Deferred code runs at the end of the tick.
+    {
+        skt::EventLoop loop;
+        std::vector<int> order;
+        std::thread::id loopThread;
+        loop.post([&] { loopThread = std::this_thread::get_id(); order.push_back(1); loop.defer([&] { order.push_back(3); loop.stop(); }); });
+        loop.post([&] { order.push_back(2); });
+        auto done = std::async(std::launch::async, [&] { loop.run(); return std::this_thread::get_id(); });
+        assert(done.get() == loopThread);
+        assert((order == std::vector<int>{1, 2, 3}));
+    }
+
+    // Readable events, and peer close.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        std::string received;
+        bool closed = false;
+        sock_t fd = pair.first;
+        loop.add(fd, skt::READABLE, {[&] {
+            std::string data;
+            int n;
+            while((n = pair.first.tryRecv(data)) > 0) received += data;
+            if(n == 0) { closed = true; loop.remove(fd); loop.stop(); }
+        }, nullptr, nullptr});
+        pair.second.send("hello");
+        pair.second.close();
+        runWithin(loop, seconds(2));
+        assert(received == "hello" && closed);
+        assert(loop.interest(fd) == 0);
+    }
+
+    // Timers wake a blocked loop.
+    {
+        skt::EventLoop loop;
+        auto start = steady_clock::now();
+        loop.addTimer(milliseconds(50), [&] { loop.stop(); });
+        auto cancelled = loop.addTimer(milliseconds(10), [&] { assert(false); });
+        assert(loop.cancelTimer(cancelled));
+        runWithin(loop, seconds(2));
+        assert(steady_clock::now() - start >= milliseconds(50));
+    }
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,107 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono;
+
+// Reads everything from a blocking node into `received`, until `expected` bytes.
+static std::thread drain(skt::Node& node, std::string& received, size_t expected) {
+    return std::thread([&node, &received, expected] {
+        char buffer[65536];
+        while(received.size() < expected) received.append(buffer, node.recv(buffer, sizeof(buffer)));
+    });
+}
+
+template<typename F>
+static void runUntil(skt::EventLoop& loop, F done, milliseconds limit=seconds(10)) {
+    auto deadline = steady_clock::now() + limit;
+    while(!done()) {
+        assert(steady_clock::now() < deadline);
+        loop.runOnce(10);
+    }
+}
+
+int main() {
+    // A burst larger than `maxPending` within one tick, to members that keep up: nobody is slow.
+    {
+        skt::EventLoop loop;
+        skt::Group group(loop, skt::Group::SlowPolicy::Disconnect, 1 << 20);
+        bool removed = false;
+        group.onRemoved = [&](sock_t) { removed = true; };
+        auto a = skt::socketPair(true), b = skt::socketPair(true);
+        a.second.setNonBlocking(false);
+        b.second.setNonBlocking(false);
+        group.add(a.first);
+        group.add(b.first);
+
+        const size_t count = 1100, size = 1024;
+        std::string receivedA, receivedB;
+        std::thread readerA = drain(a.second, receivedA, count * size), readerB = drain(b.second, receivedB, count * size);
+        for(size_t i = 0; i < count; i++) assert(group.broadcast(std::string(size, (char)('a' + i % 26))) == 2);
+        runUntil(loop, [&] { return group.queueOf(a.first).pending() == 0 && group.queueOf(b.first).pending() == 0; });
+        readerA.join();
+        readerB.join();
+        assert(!removed && group.size() == 2 && group.droppedCount() == 0);
+        assert(receivedA == receivedB && receivedA.size() == count * size && receivedA[1024 * 27] == 'b');
+    }
+
+    // A member that does not read: with `Drop` it misses messages, the others get them all.
+    {
+        skt::EventLoop loop;
+        skt::Group group(loop, skt::Group::SlowPolicy::Drop, 64 << 10);
+        auto fast = skt::socketPair(true), slow = skt::socketPair(true);
+        group.add(fast.first);
+        group.add(slow.first);
+
+        // The fast member reads after every tick, on the loop thread.
+        const size_t count = 2000, size = 1024;
+        size_t received = 0;
+        std::string data;
+        for(size_t i = 0; i < count; i++) {
+            group.broadcast(std::string(size, 'x'));
+            loop.runOnce(0);
+            while(fast.second.tryRecv(data) > 0) received += data.size();
+        }
+        assert(received == count * size);
+        assert(group.droppedCount(fast.first) == 0 && group.droppedCount(slow.first) > 0);
+        assert(group.droppedCount() == group.droppedCount(slow.first) && group.size() == 2);
+    }
+
+    // With `Disconnect`, it is removed and reported. `except` leaves the sender out.
+    {
+        skt::EventLoop loop;
+        skt::Group group(loop, skt::Group::SlowPolicy::Disconnect, 64 << 10);
+        std::vector<sock_t> removed;
+        group.onRemoved = [&](sock_t fd) { removed.push_back(fd); };
+        auto sender = skt::socketPair(true), slow = skt::socketPair(true);
+        group.add(sender.first);
+        group.add(slow.first);
+        assert(!group.add(slow.first));
+
+        while(removed.empty()) {
+            assert(group.broadcast(std::string(1024, 'y'), sender.first) <= 1);
+            loop.runOnce(0);
+        }
+        assert(removed == std::vector<sock_t>{(sock_t)slow.first});
+        assert(!group.contains(slow.first) && group.contains(sender.first));
+        std::string data;
+        assert(sender.second.tryRecv(data) == skt::WOULD_BLOCK);
+    }
+
+    // A member whose peer left is removed once its send fails.
+    {
+        skt::EventLoop loop;
+        skt::Group group(loop);
+        std::vector<sock_t> removed;
+        group.onRemoved = [&](sock_t fd) { removed.push_back(fd); };
+        auto gone = skt::socketPair(true);
+        gone.second.close();
+        group.add(gone.first);
+        group.broadcast(std::string_view("hello"));
+        runUntil(loop, [&] { return !removed.empty(); });
+        assert(group.size() == 0);
+    }
+
+    std::cout << "OK" << std::endl;
+}
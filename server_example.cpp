@@ -6,9 +6,9 @@ int main(){
     skt::Node client;
     skt::Socket sock(49110, ANY_ADDR, false);
     try {
-        client = *sock.accept();
+        client = sock.accept();
     } catch (std::runtime_error& e) {
-        std::cout << e.what() << ": " << skt::getLastError() << std::endl;
+        std::cout << e.what() << std::endl;
         return 1;
     }
     std::cout << "Client connected: " << client.getIpStr() << ":" << client.getPort() << std::endl;
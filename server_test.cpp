@@ -0,0 +1,98 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <future>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono;
+
+// Fails if `fn` does not return within `limit`.
+template<typename F>
+static void within(milliseconds limit, F fn) {
+    auto done = std::async(std::launch::async, fn);
+    assert(done.wait_for(limit) == std::future_status::ready);
+    done.get();
+}
+
+int main() {
+    // Acceptor: stopped right after starting, before the workers run their loops.
+    for(int i = 0; i < 20; i++) {
+        skt::Acceptor acceptor(21401, LOCALHOST, 4);
+        within(seconds(5), [&] {
+            acceptor.start([](skt::Node, skt::EventLoop&) {});
+            acceptor.stop();
+        });
+    }
+
+    // Acceptor: connections reach the callback, on the loop of the worker that accepted them.
+    {
+        skt::Acceptor acceptor(21402, LOCALHOST, 2);
+        std::atomic<int> accepted{0};
+        acceptor.start([&](skt::Node node, skt::EventLoop&) { node.send("hi"); accepted++; });
+        for(int i = 0; i < 8; i++) {
+            skt::Socket client(21402, LOCALHOST, true);
+            client.connect();
+            assert(client.recv() == "hi");
+        }
+        within(seconds(5), [&] { acceptor.stop(); });
+        assert(accepted == 8);
+    }
+
+    // Acceptor: an exception ends its worker, closes its listener, and is rethrown by `stop()`.
+    {
+        skt::Acceptor acceptor(21403, LOCALHOST, 1);
+        acceptor.start([](skt::Node, skt::EventLoop&) { throw std::runtime_error("handler failed"); });
+        skt::Socket client(21403, LOCALHOST, true);
+        client.connect();
+        // The worker's listener is closed: later connections are refused, not queued forever.
+        bool refused = false;
+        for(int i = 0; i < 100 && !refused; i++) {
+            std::this_thread::sleep_for(milliseconds(10));
+            try { skt::Socket late(21403, LOCALHOST, true); late.connect(); } catch(const std::runtime_error&) { refused = true; }
+        }
+        assert(refused);
+        try { acceptor.stop(); assert(false); } catch(const std::runtime_error& e) { assert(std::string(e.what()) == "handler failed"); }
+        acceptor.stop();  // Reported once.
+    }
+
+    // Server: stopped before `run()`.
+    {
+        skt::Server server(21404, LOCALHOST, 1);
+        server.stop();
+        within(seconds(5), [&] { server.run([](skt::Server::Connection&) { return true; }); });
+    }
+
+    // Server: stopped right after starting, often before `run()` got to its loop.
+    for(int i = 0; i < 20; i++) {
+        skt::Server server(21404, LOCALHOST, 2);
+        within(seconds(5), [&] {
+            std::thread runner([&] { server.run([](skt::Server::Connection&) { return true; }); });
+            if(i % 2) server.stop();
+            else std::thread([&] { server.stop(); }).join();
+            runner.join();
+        });
+    }
+
+    // Server: echoes, then stops with connections open.
+    {
+        skt::Server server(21405, LOCALHOST, 2);
+        std::thread runner([&] {
+            server.run([](skt::Server::Connection& c) {
+                std::string data;
+                int n;
+                while((n = c.node.tryRecv(data)) > 0) c.node.send(data);
+                return n != 0;
+            });
+        });
+        skt::Socket a(21405, LOCALHOST, true), b(21405, LOCALHOST, true);
+        a.connect();
+        b.connect();
+        a.send("one");
+        b.send("two");
+        assert(a.recv() == "one" && b.recv() == "two");
+        within(seconds(5), [&] { server.stop(); runner.join(); });
+        assert(server.size() == 0);
+    }
+
+    std::cout << "OK" << std::endl;
+}
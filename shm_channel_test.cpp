@@ -0,0 +1,135 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <iostream>
+#include <thread>
+#include <sys/wait.h>
+
+using namespace std::chrono;
+
+// Sets up a channel over a socket pair: `offer()` on one side, `accept()` on the other.
+static std::pair<skt::ShmChannel, skt::ShmChannel> channelPair(size_t capacity) {
+    auto pair = skt::socketPair();
+    std::optional<skt::ShmChannel> offered;
+    std::thread offering([&] { offered.emplace(skt::ShmChannel::offer(std::move(pair.first), capacity)); });
+    skt::ShmChannel accepted = skt::ShmChannel::accept(std::move(pair.second));
+    offering.join();
+    return {std::move(*offered), std::move(accepted)};
+}
+
+// Sends a hand made offer, as a peer that does not follow the rules would.
+static int rogueOffer(skt::Node& node, size_t capacity, bool seal) {
+    // The calls stay out of `assert()`: the offer must be sized, and sealed if asked, whatever NDEBUG says.
+    int memfd = memfd_create("rogue", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    int sized = memfd < 0 ? -1 : ftruncate(memfd, 2 * (4096 + capacity));
+    int sealed = seal && sized == 0 ? fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) : 0;
+    assert(memfd >= 0 && sized == 0 && sealed == 0);
+    char hello[16] = {'S', 'K', 'T', 'S', 'H', 'M', '0', '1'};
+    uint64_t size = capacity;
+    std::memcpy(hello + 8, &size, 8);
+    node.sendFd(memfd, std::string_view(hello, sizeof(hello)));
+    return memfd;
+}
+
+int main() {
+    // Round trip.
+    {
+        auto [a, b] = channelPair(4096);
+        assert(a.getCapacity() == 4096 && b.getCapacity() == 4096);
+        a.send("ping");
+        assert(b.recv() == "ping");
+        b.send("pong");
+        char buffer[16];
+        assert(a.recv(buffer, sizeof(buffer)) == 4 && std::string(buffer, 4) == "pong");
+        assert(a.tryRecv(buffer, sizeof(buffer)) == skt::WOULD_BLOCK);
+    }
+
+    // Wraparound: far more than the capacity, in sizes that don't divide it, with a full ring on the way.
+    {
+        auto [a, b] = channelPair(4096);
+        const size_t total = 4 << 20;
+        std::thread writer([&, &a = a] {
+            std::string chunk;
+            for(size_t sent = 0, i = 0; sent < total; i++) {
+                chunk.assign(std::min<size_t>(1000 + i % 3001, total - sent), '\0');
+                for(size_t j = 0; j < chunk.size(); j++) chunk[j] = (char)((sent + j) * 31 % 251);
+                a.send(chunk);
+                sent += chunk.size();
+            }
+        });
+        std::vector<char> buffer(777);
+        size_t received = 0;
+        while(received < total) {
+            size_t n = b.recv(buffer.data(), buffer.size());
+            assert(n > 0);
+            for(size_t j = 0; j < n; j++) assert(buffer[j] == (char)((received + j) * 31 % 251));
+            received += n;
+        }
+        writer.join();
+        char extra;
+        assert(b.tryRecv(&extra, 1) == skt::WOULD_BLOCK);
+    }
+
+    // Peer close: its last bytes, then 0. Sends fail.
+    {
+        auto [a, b] = channelPair(4096);
+        a.send("last words");
+        a.close();
+        assert(b.recv() == "last words");
+        char buffer[16];
+        assert(b.recv(buffer, sizeof(buffer)) == 0 && b.tryRecv(buffer, sizeof(buffer)) == 0);
+        try { b.send("anyone?"); assert(false); } catch(const std::runtime_error&) {}
+    }
+
+    // Peer death, without closing: blocking and non-blocking calls both notice.
+    for(bool blocking : {true, false}) {
+        auto pair = skt::socketPair();
+        pid_t pid = fork();
+        if(pid == 0) {
+            pair.second.close();
+            skt::ShmChannel channel = skt::ShmChannel::offer(std::move(pair.first), 4096);
+            channel.send("dying");
+            _exit(0);  // No destructor: the channel is never closed.
+        }
+        pair.first.close();
+        skt::ShmChannel channel = skt::ShmChannel::accept(std::move(pair.second));
+        int status;
+        waitpid(pid, &status, 0);
+        char buffer[16];
+        if(blocking) {
+            assert(channel.recv(buffer, sizeof(buffer)) == 5);
+            assert(channel.recv(buffer, sizeof(buffer)) == 0);
+        } else {
+            assert(channel.tryRecv(buffer, sizeof(buffer)) == 5);
+            assert(channel.tryRecv(buffer, sizeof(buffer)) == 0);
+        }
+        assert(channel.isPeerGone());
+        std::string fill(8192, 'f');
+        try { channel.trySend(fill); channel.trySend(fill); assert(false); } catch(const std::runtime_error&) {}
+    }
+
+    // An offer of memory the peer could still resize is refused.
+    {
+        auto pair = skt::socketPair();
+        int memfd = rogueOffer(pair.first, 4096, false);
+        try { skt::ShmChannel::accept(std::move(pair.second)); assert(false); } catch(const std::runtime_error&) {}
+        close(memfd);
+    }
+
+    // A peer writing nonsense positions breaks the channel, instead of making it copy out of bounds.
+    {
+        auto pair = skt::socketPair();
+        int memfd = rogueOffer(pair.first, 4096, true);
+        skt::ShmChannel channel = skt::ShmChannel::accept(std::move(pair.second));
+        void* memory = mmap(nullptr, 2 * (4096 + 4096), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        assert(memory != MAP_FAILED);
+        // The rogue's send ring comes first: its head is the first word.
+        static_cast<std::atomic<uint64_t>*>(memory)->store(uint64_t(1) << 40);
+        char buffer[64];
+        try { channel.tryRecv(buffer, sizeof(buffer)); assert(false); } catch(const std::runtime_error&) {}
+        try { channel.recv(buffer, sizeof(buffer)); assert(false); } catch(const std::runtime_error&) {}
+        munmap(memory, 2 * (4096 + 4096));
+        close(memfd);
+    }
+
+    std::cout << "OK" << std::endl;
+}
@@ -0,0 +1,200 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono;
+
+// Expects `fn` to throw `std::system_error` with EPIPE or ECONNRESET, instead of the process dying of SIGPIPE.
+template<typename F>
+static void expectPeerGone(F fn) {
+    try {
+        for(int i = 0; i < 100; i++) fn();
+        assert(false);
+    } catch(const std::system_error& e) {
+        assert(e.code().value() == EPIPE || e.code().value() == ECONNRESET);
+    }
+}
+
+int main() {
+    // SIGPIPE stays at its default action: a send to a closed peer must not raise it.
+    {
+        auto pair = skt::socketPair();
+        pair.second.close();
+        expectPeerGone([&] { pair.first.send("data"); });
+        expectPeerGone([&] { pair.first.trySend("data"); });
+        expectPeerGone([&] { pair.first.sendAll("data"); });
+        std::string_view parts[] = {"head", "body"};
+        expectPeerGone([&] { pair.first.sendv(parts, 2); });
+        expectPeerGone([&] { pair.first.trySendv(parts, 2); });
+    }
+    {
+        skt::Socket server(21501, LOCALHOST);
+        skt::Socket client(21501, LOCALHOST, true);
+        client.connect();
+        server.accept().close();
+        std::this_thread::sleep_for(milliseconds(20));
+        expectPeerGone([&] { client.send("data"); });
+    }
+    {
+        skt::Socket server(21503, LOCALHOST);
+        skt::Socket client(21503, LOCALHOST, true);
+        skt::Node node = client.connectRef();
+        server.accept().close();
+        std::this_thread::sleep_for(milliseconds(20));
+        bool zeroCopy = true;
+        try { node.enableZeroCopy(); } catch(const std::runtime_error&) { zeroCopy = false; }
+        static const std::string pinned(4096, 'z');
+        if(zeroCopy) expectPeerGone([&] { node.sendZeroCopy(pinned); });
+    }
+
+    // `sendFd()`: the rest of a payload too large for one call goes after the descriptor, and the peer may leave meanwhile.
+    {
+        auto pair = skt::socketPair(true);
+        std::string payload(4 << 20, 'f');
+        std::thread reader([&] {
+            std::this_thread::sleep_for(milliseconds(50));
+            pair.second.close();
+        });
+        expectPeerGone([&] { pair.first.sendFd(0, payload); });
+        reader.join();
+    }
+
+    // `sendFile()` from a pipe and from a socket: sent to their end, without a failed probe in the stats.
+    {
+        auto out = skt::socketPair();
+        std::string payload(300000, 'p');
+        for(size_t i = 0; i < payload.size(); i += 1000) payload[i] = (char)('a' + i / 1000 % 26);
+        std::string received;
+        std::thread reader([&] {
+            char buffer[65536];
+            while(received.size() < 2 * payload.size()) received.append(buffer, out.second.recv(buffer, sizeof(buffer)));
+        });
+
+        int pipeFds[2];
+        int piped = pipe(pipeFds);
+        assert(piped == 0);
+        std::thread writer([&] {
+            for(size_t done = 0; done < payload.size();) done += write(pipeFds[1], payload.data() + done, payload.size() - done);
+            close(pipeFds[1]);
+        });
+        assert(out.first.sendFile(pipeFds[0]) == payload.size());
+        writer.join();
+        try { out.first.sendFile(pipeFds[0], 10); assert(false); } catch(const std::runtime_error&) {}
+        close(pipeFds[0]);
+
+        auto source = skt::socketPair();
+        std::thread feeder([&] { source.second.send(payload); source.second.close(); });
+        assert(out.first.sendFile(source.first) == payload.size());
+        feeder.join();
+        reader.join();
+        assert(received == payload + payload);
+        assert(out.first.getStats().snapshot().errors == 0);
+    }
+
+    // `Socket::send()` sends everything, also on a non-blocking socket with a slow reader.
+    {
+        skt::Socket server(21502, LOCALHOST);
+        skt::Socket client(21502, LOCALHOST, true);
+        client.connect();
+        skt::Node peer = server.accept();
+        client.setNonBlocking(true);
+
+        std::string payload(8 << 20, 'x');
+        for(size_t i = 0; i < payload.size(); i += 4096) payload[i] = (char)('a' + i / 4096 % 26);
+        std::string received;
+        std::thread reader([&] {
+            char buffer[65536];
+            while(received.size() < payload.size()) {
+                std::this_thread::sleep_for(microseconds(200));
+                received.append(buffer, peer.recv(buffer, sizeof(buffer)));
+            }
+        });
+        assert(client.send(payload) == (int)payload.size());
+        reader.join();
+        assert(received == payload);
+    }
+
+    // A signal while blocked in recv is retried, not reported as an error.
+    {
+        struct sigaction action{};
+        action.sa_handler = [](int) {};
+        sigaction(SIGUSR1, &action, nullptr);  // No SA_RESTART: recv fails with EINTR.
+
+        auto pair = skt::socketPair();
+        pthread_t self = pthread_self();
+        std::thread poker([&] {
+            std::this_thread::sleep_for(milliseconds(50));
+            pthread_kill(self, SIGUSR1);
+            std::this_thread::sleep_for(milliseconds(50));
+            pair.second.send("late");
+        });
+        std::string data;
+        pair.first.tryRecv(data);
+        poker.join();
+        assert(data == "late");
+
+        // Same for a scatter recv.
+        std::thread again([&] {
+            std::this_thread::sleep_for(milliseconds(50));
+            pthread_kill(self, SIGUSR1);
+            std::this_thread::sleep_for(milliseconds(50));
+            pair.second.send("headbody");
+        });
+        char head[4], body[4];
+        assert(pair.first.recvv({{head, sizeof(head)}, {body, sizeof(body)}}) == 8);
+        again.join();
+        assert(std::string(head, 4) == "head" && std::string(body, 4) == "body");
+    }
+
+    // A Unix domain server replaces a stale socket file, but never takes the path of a live server.
+    {
+        std::string path = "/tmp/skt_socket_test_" + std::to_string(getpid()) + ".sock";
+        {
+            skt::Socket first(0, "unix:" + path);
+            try { skt::Socket second(0, "unix:" + path); assert(false); } catch(const std::system_error& e) { assert(e.code().value() == EADDRINUSE); }
+            skt::Socket client(0, "unix:" + path, true);
+            client.connect();
+            client.send("still yours");
+            // The probe of `second` reached `first` too, as a connection closed right away.
+            std::string data;
+            while(data.empty()) data = first.accept().recv();
+            assert(data == "still yours");
+        }
+        struct stat info;
+        assert(stat(path.c_str(), &info) == 0);  // Left behind by `first`.
+        skt::Socket again(0, "unix:" + path);
+        skt::Socket client(0, "unix:" + path, true);
+        client.connect();
+        again.accept();
+        unlink(path.c_str());
+    }
+
+    // An inherited socket is taken once: the variables naming it are removed, so children started later don't count on it.
+    {
+        skt::Socket server(21504, LOCALHOST);
+        server.handOff();
+        std::optional<skt::Socket> inherited = skt::Socket::inherit();
+        assert(inherited && inherited->getSocket() == server.getSocket() && inherited->getPort() == 21504);
+        assert(std::getenv("SKT_LISTEN_FD") == nullptr && !skt::Socket::inherit());
+        inherited->release();
+
+        // systemd socket activation: the first passed descriptor is 3.
+        skt::Socket activated(21505, LOCALHOST);
+        int saved = dup(3);
+        int moved = dup2(activated.getSocket(), 3);
+        assert(moved == 3);
+        setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+        setenv("LISTEN_FDS", "1", 1);
+        setenv("LISTEN_FDNAMES", "web", 1);
+        inherited = skt::Socket::inherit();
+        assert(inherited && inherited->getSocket() == 3 && inherited->getPort() == 21505);
+        assert(!std::getenv("LISTEN_PID") && !std::getenv("LISTEN_FDS") && !std::getenv("LISTEN_FDNAMES"));
+        assert(!skt::Socket::inherit());
+        inherited->release();
+        if(saved >= 0) { dup2(saved, 3); close(saved); } else close(3);
+    }
+
+    std::cout << "OK" << std::endl;
+}
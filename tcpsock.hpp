@@ -2,26 +2,126 @@
 
 #define ANY_ADDR  "0.0.0.0"
 #define LOCALHOST "127.0.0.1"
+#define ANY_ADDR6  "::"
+#define LOCALHOST6 "::1"
 
 #ifndef __linux__
     #include <winsock2.h>
     #include <ws2tcpip.h>
     #include <windows.h>
     #include <iphlpapi.h>
+    #include <mswsock.h>
+    #include <afunix.h>
+    #ifndef SHUT_RD
+        #define SHUT_RD   SD_RECEIVE
+        #define SHUT_WR   SD_SEND
+        #define SHUT_RDWR SD_BOTH
+    #endif
+    #include <io.h>
     #define SO_WINDOWS
     typedef SOCKET sock_t;
 #else
     #include <sys/socket.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
     #include <unistd.h>
     #include <netdb.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <sys/uio.h>
+    #include <sys/un.h>
+    #include <sys/sendfile.h>
+    #include <sys/stat.h>
+    #include <linux/errqueue.h>
+    #include <netinet/udp.h>
+    #ifndef UDP_SEGMENT
+        #define UDP_SEGMENT 103
+    #endif
+    #ifndef UDP_GRO
+        #define UDP_GRO 104
+    #endif
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+    #include <linux/filter.h>
+    #include <sched.h>
+    #include <pthread.h>
+    #ifndef SO_INCOMING_CPU
+        #define SO_INCOMING_CPU 49
+    #endif
+    #ifndef SO_ATTACH_REUSEPORT_CBPF
+        #define SO_ATTACH_REUSEPORT_CBPF 51
+    #endif
+    #ifndef F_ADD_SEALS
+        #define F_ADD_SEALS   1033
+        #define F_GET_SEALS   1034
+        #define F_SEAL_SEAL   0x0001
+        #define F_SEAL_SHRINK 0x0002
+        #define F_SEAL_GROW   0x0004
+    #endif
+    #ifndef MFD_ALLOW_SEALING
+        #define MFD_ALLOW_SEALING 0x0002U
+    #endif
+    #ifdef SKT_IO_URING
+        #include <linux/io_uring.h>
+        #ifndef IORING_ACCEPT_MULTISHOT
+            #define IORING_ACCEPT_MULTISHOT (1U << 0)
+        #endif
+        #ifndef IORING_CQE_F_MORE
+            #define IORING_CQE_F_MORE (1U << 1)
+        #endif
+    #endif
     #define INVALID_SOCKET -1
     typedef int sock_t;
 #endif
 
 #include <string>
+#include <string_view>
 #include <stdexcept>
+#include <exception>
+#include <system_error>
+#include <type_traits>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <initializer_list>
+#include <optional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <any>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+#ifdef SKT_TLS
+    #include <openssl/ssl.h>
+    #include <openssl/err.h>
+    #include <climits>
+#endif
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+    #include <span>
+    #include <cstddef>
+    #define SKT_HAS_SPAN
+#endif
+
+#if __cplusplus >= 202002L && __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+    #include <coroutine>
+    #include <exception>
+    #define SKT_HAS_COROUTINES
+#endif
 
 ////////////////////////////////////////////////////
 ///
@@ -32,33 +132,272 @@
 ///
 /// TOC:
 /// skt - Namespace
+/// skt::Result - Class
+/// skt::Address - Class
+/// skt::SocketOptions - Struct
+/// skt::IoCounters - Struct
+/// skt::IoStats - Class
+/// skt::LatencyHistogram - Class
 /// skt::Node - Class
 /// skt::Socket - Class
+/// skt::Datagram - Struct
+/// skt::DatagramBatch - Class
+/// skt::UdpSocket - Class
+/// skt::ShmChannel - Class (Linux)
+/// skt::BufferPool - Class
+/// skt::PooledBuffer - Class
+/// skt::FramedConnection - Class
+/// skt::ReadBuffer - Class
+/// skt::Deadline - Enum
+/// skt::TimerWheel - Class
+/// skt::EventLoop - Class
+/// skt::WriteQueue - Class
+/// skt::Group - Class
+/// skt::Acceptor - Class
+/// skt::ThreadPool - Class
+/// skt::Server - Class
+/// skt::ConnectionPool - Class
+/// skt::Task - Class (C++20)
+/// skt::Uring - Class (opt-in, SKT_IO_URING)
+/// skt::Context - Class
+/// skt::TlsContext - Class (opt-in, SKT_TLS)
+/// skt::TlsStream - Class (opt-in, SKT_TLS)
 ///
 /// skt: getLastError() - Function
+/// skt: availableCpus(), cpusOfNode(), numaNode(), currentCpu(), pinThread() - Functions
+/// skt: socketPair() -> std::pair<skt::Node, skt::Node> - Function
+/// skt: isWouldBlock() - Function
+/// skt: toPrometheus() -> std::string - Function
+/// skt: spawn(), blockOn() - Functions (C++20)
+/// skt: acceptAsync(), connectAsync(), recvAsync(), sendAsync() -> skt::Task - Functions (C++20)
 ///
 /// SOCKET METHODS:
 /// skt::Socket::Socket() -----> Constructor
-/// skt::Socket::accept() -----> skt::Node*   - Method
+/// skt::Socket::accept() -----> skt::Node    - Method
+/// skt::Socket::tryAccept() --> std::optional<skt::Node> - Method
+/// skt::Socket::acceptSome() -> skt::Result<skt::Node> - Method (noexcept)
+/// skt::Socket::sendSome() ---> skt::Result<size_t> - Method (noexcept)
+/// skt::Socket::recvSome() ---> skt::Result<size_t> - Method (noexcept)
 /// skt::Socket::connect() ----> void         - Method
-/// skt::Socket::connectRef() -> skt::Node*   - Method
+/// skt::Socket::connect(timeout) -> void     - Method
+/// skt::Socket::connectRef() -> skt::Node    - Method
 /// skt::Socket::send() -------> int          - Method
 /// skt::Socket::recv() -------> std::string  - Method
+/// skt::Socket::recv(buf, n) -> size_t       - Method
+/// skt::Socket::recvPooled() -> skt::PooledBuffer - Method
+/// skt::Socket::recvExact() --> std::string  - Method
+/// skt::Socket::setRecvSize() -> void        - Method
+/// skt::Socket::setAdaptiveRecv() -> void    - Method
+/// skt::Socket::trySend() ----> int          - Method
+/// skt::Socket::sendAll() ----> size_t       - Method
+/// skt::Socket::tryRecv() ----> int          - Method
+/// skt::Socket::sendv() ------> size_t       - Method
+/// skt::Socket::trySendv() ---> long         - Method
+/// skt::Socket::recvv() ------> size_t       - Method
+/// skt::Socket::sendFile() ---> size_t       - Method
+/// skt::Socket::setNonBlocking() -> void     - Method
+/// skt::Socket::setOptions() -> void         - Method
 /// skt::Socket::close() ------> void         - Method
+/// skt::Socket::shutdown() ---> void         - Method
+/// skt::Socket::release() ----> sock_t       - Method
+/// skt::Socket::setInheritable() -> void     - Method
+/// skt::Socket::handOff() ----> void         - Method
+/// skt::Socket::adopt() ------> skt::Socket  - Function
+/// skt::Socket::inherit() ----> std::optional<skt::Socket> - Function
 /// skt::Socket::getSocket() --> sock_t       - Method
 /// skt::Socket::getAddr() ----> sockaddr_in* - Method
+/// skt::Socket::getAddress() -> const skt::Address& - Method
+/// skt::Socket::getStats() ---> skt::IoStats& - Method
+///
+/// ADDRESS METHODS:
+/// skt::Address::parse() -----> std::optional<skt::Address> - Function
+/// skt::Address::ip() --------> std::string  - Method
+/// skt::Address::toString() --> std::string  - Method
+/// skt::Address::port() ------> int          - Method
 ///
 /// NODE METHODS:
 /// skt::Node::Node() ---------> Constructor
 /// skt::Node::send() ---------> void         - Method
 /// skt::Node::recv() ---------> std::string  - Method
+/// skt::Node::recv(buf, n) ---> size_t       - Method
+/// skt::Node::recvPooled() ---> skt::PooledBuffer - Method
+/// skt::Node::recvExact() ----> std::string  - Method
+/// skt::Node::setRecvSize() --> void         - Method
+/// skt::Node::setAdaptiveRecv() -> void      - Method
+/// skt::Node::trySend() ------> int          - Method
+/// skt::Node::sendSome() -----> skt::Result<size_t> - Method (noexcept)
+/// skt::Node::recvSome() -----> skt::Result<size_t> - Method (noexcept)
+/// skt::Node::sendAll() ------> size_t       - Method
+/// skt::Node::tryRecv() ------> int          - Method
+/// skt::Node::sendv() --------> size_t       - Method
+/// skt::Node::trySendv() -----> long         - Method
+/// skt::Node::recvv() --------> size_t       - Method
+/// skt::Node::sendFile() -----> size_t       - Method
+/// skt::Node::enableZeroCopy() -> void       - Method
+/// skt::Node::sendZeroCopy() -> uint32_t     - Method
+/// skt::Node::pollZeroCopy() -> size_t       - Method
+/// skt::Node::waitZeroCopy() -> bool         - Method
+/// skt::Node::sendFd() -------> void         - Method
+/// skt::Node::recvFd() -------> int          - Method
+/// skt::Node::setNonBlocking() -> void       - Method
+/// skt::Node::setOptions() ---> void         - Method
 /// skt::Node::getSock() ------> sock_t       - Method
+/// skt::Node::isValid() ------> bool         - Method
+/// skt::Node::shutdown() -----> void         - Method
+/// skt::Node::closeGracefully() -> bool      - Method
+/// skt::Node::close() --------> void         - Method
 /// skt::Node::getIp() --------> std::string  - Method
 /// skt::Node::getIpStr() -----> std::string  - Method
 /// skt::Node::getPort() ------> int          - Method
 /// skt::Node::getAddr() ------> sockaddr_in* - Method
+/// skt::Node::getAddress() ---> const skt::Address& - Method
+/// skt::Node::getStats() -----> skt::IoStats& - Method
 /// skt::Node::getAddrLen() ---> socklen_t*   - Method
 ///
+/// BUFFERPOOL METHODS:
+/// skt::BufferPool::BufferPool() -> Constructor
+/// skt::BufferPool::acquire() ---> skt::PooledBuffer - Method
+/// skt::BufferPool::release() ---> void       - Method
+/// skt::BufferPool::allocated() -> size_t     - Method
+/// skt::BufferPool::global() ----> skt::BufferPool&  - Function
+/// skt::BufferPool::forSize() ---> skt::BufferPool&  - Function
+///
+/// UDPSOCKET METHODS:
+/// skt::UdpSocket::UdpSocket() --> Constructor
+/// skt::UdpSocket::connect() ----> void      - Method
+/// skt::UdpSocket::sendTo() -----> int       - Method
+/// skt::UdpSocket::recvFrom() ---> int       - Method
+/// skt::UdpSocket::send() -------> int       - Method
+/// skt::UdpSocket::recv() -------> int       - Method
+/// skt::UdpSocket::sendBatch() --> int       - Method
+/// skt::UdpSocket::recvBatch() --> int       - Method
+/// skt::UdpSocket::sendSegments() -> long    - Method
+/// skt::UdpSocket::enableGro() --> bool      - Method
+///
+/// SHMCHANNEL METHODS:
+/// skt::ShmChannel::offer() ----> skt::ShmChannel - Function
+/// skt::ShmChannel::accept() ---> skt::ShmChannel - Function
+/// skt::ShmChannel::send() -----> void       - Method
+/// skt::ShmChannel::trySend() --> int        - Method
+/// skt::ShmChannel::recv() -----> size_t     - Method
+/// skt::ShmChannel::tryRecv() --> int        - Method
+/// skt::ShmChannel::close() ----> void       - Method
+/// skt::ShmChannel::isPeerGone() -> bool     - Method
+///
+/// FRAMEDCONNECTION METHODS:
+/// skt::FramedConnection::FramedConnection() -> Constructor
+/// skt::FramedConnection::recvFrame() ----> std::optional<std::string_view> - Method
+/// skt::FramedConnection::tryRecvFrame() -> std::optional<std::string_view> - Method
+/// skt::FramedConnection::sendFrame() ----> void - Method
+/// skt::FramedConnection::isClosed() -----> bool - Method
+///
+/// TIMERWHEEL METHODS:
+/// skt::TimerWheel::TimerWheel() -> Constructor
+/// skt::TimerWheel::add() -------> skt::TimerWheel::TimerId - Method
+/// skt::TimerWheel::cancel() ----> bool         - Method
+/// skt::TimerWheel::reset() -----> bool         - Method
+/// skt::TimerWheel::advance() ---> size_t       - Method
+/// skt::TimerWheel::nextTimeout() -> int        - Method
+///
+/// EVENTLOOP METHODS:
+/// skt::EventLoop::EventLoop() --> Constructor
+/// skt::EventLoop::add() --------> void         - Method
+/// skt::EventLoop::modify() -----> void         - Method
+/// skt::EventLoop::remove() -----> void         - Method
+/// skt::EventLoop::runOnce() ----> int          - Method
+/// skt::EventLoop::run() --------> void         - Method
+/// skt::EventLoop::post() -------> void         - Method
+/// skt::EventLoop::defer() ------> void         - Method
+/// skt::EventLoop::setHandler() -> Callback     - Method
+/// skt::EventLoop::setDeadline() -> void        - Method
+/// skt::EventLoop::addTimer() ---> skt::TimerWheel::TimerId - Method
+/// skt::EventLoop::cancelTimer() -> bool        - Method
+/// skt::EventLoop::resetTimer() -> bool         - Method
+/// skt::EventLoop::stop() -------> void         - Method
+/// skt::EventLoop::size() -------> size_t       - Method
+/// skt::EventLoop::tickLatency() -> const skt::LatencyHistogram& - Method
+///
+/// WRITEQUEUE METHODS:
+/// skt::WriteQueue::WriteQueue() -> Constructor
+/// skt::WriteQueue::write() -----> bool      - Method
+/// skt::WriteQueue::flush() -----> void      - Method
+/// skt::WriteQueue::pending() ---> size_t    - Method
+///
+/// GROUP METHODS:
+/// skt::Group::Group() ----------> Constructor
+/// skt::Group::add() ------------> bool      - Method
+/// skt::Group::remove() ---------> bool      - Method
+/// skt::Group::broadcast() ------> size_t    - Method
+/// skt::Group::queueOf() --------> skt::WriteQueue& - Method
+/// skt::Group::size() -----------> size_t    - Method
+/// skt::Group::droppedCount() ---> uint64_t  - Method
+///
+/// ACCEPTOR METHODS:
+/// skt::Acceptor::Acceptor() --> Constructor
+/// skt::Acceptor::start() -----> void        - Method
+/// skt::Acceptor::stop() ------> void        - Method
+/// skt::Acceptor::loop() ------> skt::EventLoop& - Method
+/// skt::Acceptor::steerByCpu() -> bool       - Method
+/// skt::Acceptor::bufferPool() -> skt::BufferPool& - Method
+///
+/// THREADPOOL METHODS:
+/// skt::ThreadPool::ThreadPool() -> Constructor
+/// skt::ThreadPool::submit() -----> void    - Method
+/// skt::ThreadPool::steals() -----> size_t  - Method
+/// skt::ThreadPool::workerOnCpu() -> long   - Method
+/// skt::ThreadPool::bufferPool() -> skt::BufferPool& - Method
+///
+/// SERVER METHODS:
+/// skt::Server::Server() --------> Constructor
+/// skt::Server::run() -----------> void     - Method
+/// skt::Server::stop() ----------> void     - Method
+/// skt::Server::drain() ---------> void     - Method
+/// skt::Server::isDraining() ----> bool     - Method
+/// skt::Server::executor() ------> skt::ThreadPool& - Method
+/// skt::Server::steerByCpu() ----> void     - Method
+///
+/// CONNECTIONPOOL METHODS:
+/// skt::ConnectionPool::ConnectionPool() -> Constructor
+/// skt::ConnectionPool::acquire() ---> skt::ConnectionPool::Lease - Method
+/// skt::ConnectionPool::prewarm() ---> size_t  - Method
+/// skt::ConnectionPool::evictIdle() -> void    - Method
+/// skt::ConnectionPool::idle() ------> size_t  - Method
+///
+/// URING METHODS (Linux, #define SKT_IO_URING):
+/// skt::Uring::Uring() --------> Constructor
+/// skt::Uring::send() ---------> void        - Method
+/// skt::Uring::recv() ---------> void        - Method
+/// skt::Uring::accept() -------> void        - Method
+/// skt::Uring::submit() -------> int         - Method
+/// skt::Uring::reap() ---------> size_t      - Method
+/// skt::Uring::sendToMany() ---> size_t      - Method
+///
+/// CONTEXT METHODS:
+/// skt::Context::instance() ---> skt::Context& - Function
+/// skt::Context::loop() -------> skt::EventLoop& - Method
+/// skt::Context::uring() ------> skt::Uring& - Method (SKT_IO_URING)
+/// skt::Context::bufferPool() -> skt::BufferPool& - Method
+///
+/// TLSCONTEXT METHODS (#define SKT_TLS, link -lssl -lcrypto):
+/// skt::TlsContext::server() --> skt::TlsContext - Function
+/// skt::TlsContext::client() --> skt::TlsContext - Function
+/// skt::TlsContext::setKernelTls() -> void   - Method
+/// skt::TlsContext::native() --> SSL_CTX*    - Method
+///
+/// TLSSTREAM METHODS (#define SKT_TLS):
+/// skt::TlsStream::TlsStream() -> Constructor
+/// skt::TlsStream::handshake() -> void       - Method
+/// skt::TlsStream::tryHandshake() -> bool    - Method
+/// skt::TlsStream::trySend() ----> int       - Method
+/// skt::TlsStream::sendAll() ----> size_t    - Method
+/// skt::TlsStream::tryRecv() ----> int       - Method
+/// skt::TlsStream::recv() -------> std::string / size_t - Method
+/// skt::TlsStream::sendFile() ---> size_t    - Method
+/// skt::TlsStream::isKernelTlsSend() -> bool - Method
+/// skt::TlsStream::isKernelTlsRecv() -> bool - Method
+/// skt::TlsStream::shutdown() ---> void      - Method
+/// skt::TlsStream::getNode() ----> skt::Node& - Method
+///
 /// FUNCTIONS:
 /// skt::getLastError() -------> std::string  - Function
 ///
@@ -78,442 +417,8061 @@
  */
 namespace skt {
 
-// Node class.
+// Returned by the `try*()` methods when a non-blocking socket is not ready.
+const int WOULD_BLOCK = -1;
+
+// The largest listen backlog the system allows. The kernel caps bigger values, ex: to `net.core.somaxconn` on Linux.
+const int MAX_BACKLOG = SOMAXCONN;
+
+// A writable memory region, used by the scatter reads (`recvv()`).
+struct MutableBuffer {
+    void* data;
+    size_t size;
+};
+
+// Address class.
 /**
  *
- * @brief ## `skt::Node`
- *
+ * @brief ## `skt::Address`
  *
- * @param sock_fd   The socket file descriptor of the node.
- * @param ip        The ip of the node.
- * @param port      The port of the node.
- *
- * @note - Used to store data about a client: socket file descriptor, ip, etc.
- * @note - No parameters are required to create a node, but you will have to set them later.
- * @note - The destructor will close the socket file descriptor, this behavior can be changed by passing true to the constructor.
+ * @note - A socket address of any family: IPv4 or IPv6, stored in a `sockaddr_storage`.
+ * @note - Holds the raw address only. The text form is built when asked for, with `ip()` or `toString()`, never on accept.
+ * @note - IPv4 clients of a dual-stack IPv6 server show up as IPv4-mapped addresses: `ip()` prints them as plain IPv4.
  * @note #### Examples:
- * @note `skt::Node node;` - Creates a node with no parameters.
- * @note `skt::Node node(true);` - Creates a node with no parameters, but the destructor will not close the socket file descriptor.
- * @note `skt::Node node(sock_fd, ip, port);` - Creates a node with the given parameters.
+ * @note `skt::Address::parse("::1", 49110)` - An IPv6 loopback address, or an empty optional if the ip is not numeric.
+ * @note `node.getAddress().toString()` - "127.0.0.1:52044", or "[::1]:52044".
  *
  */
-class Node {
-    int port{};
-    sock_t sock_fd{};
-    std::string ip;
-    sockaddr_in addr;
-    socklen_t addrLen = sizeof(addr);
-    bool noCloseOnDestruct = false;
-    char buffer[4096];
+class Address {
+    sockaddr_storage storage{};
+    socklen_t length = sizeof(sockaddr_storage);
 
 public:
 
-    Node() = default;
+    Address() = default;
 
-    Node(bool noCloseOnDestruct) {
-        this->noCloseOnDestruct = noCloseOnDestruct;
+    Address(const sockaddr* addr, socklen_t length) {
+        this->length = std::min<socklen_t>(length, sizeof(storage));
+        std::memcpy(&storage, addr, this->length);
     }
 
-    Node(sock_t sock_fd, std::string ip, int port) {
-        this->sock_fd = sock_fd;
-        this->ip = ip;
-        this->port = port;
-    }
+    // Parses a numeric IPv4 or IPv6 address, with no lookup. Brackets around IPv6 are allowed: "[::1]".
+    // "unix:/path" and "unix:@name" are Unix domain sockets, see `local()`. The port is ignored for them.
+    static std::optional<Address> parse(std::string_view ip, int port) {
+        if(ip.substr(0, 5) == "unix:") return local(ip.substr(5));
+        Address address;
+        char text[INET6_ADDRSTRLEN + 1];
+        if(ip.size() >= 2 && ip.front() == '[' && ip.back() == ']') ip = ip.substr(1, ip.size() - 2);
+        if(ip.size() >= sizeof(text)) return std::nullopt;
+        std::memcpy(text, ip.data(), ip.size());
+        text[ip.size()] = '\0';
 
-    void setAddr() {
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(port);
-        addr.sin_addr.s_addr = inet_addr(ip.c_str());
+        sockaddr_in* v4 = reinterpret_cast<sockaddr_in*>(&address.storage);
+        sockaddr_in6* v6 = reinterpret_cast<sockaddr_in6*>(&address.storage);
+        if(inet_pton(AF_INET, text, &v4->sin_addr) == 1) {
+            v4->sin_family = AF_INET;
+            v4->sin_port = htons(port);
+            address.length = sizeof(sockaddr_in);
+        }
+        else if(inet_pton(AF_INET6, text, &v6->sin6_addr) == 1) {
+            v6->sin6_family = AF_INET6;
+            v6->sin6_port = htons(port);
+            address.length = sizeof(sockaddr_in6);
+        }
+        else return std::nullopt;
+        return address;
     }
 
-    ~Node() {
-        if(noCloseOnDestruct) return;
-        close(sock_fd);
+    // A Unix domain socket address: a file system path, or a name in the abstract namespace if it starts with '@' (Linux only).
+    // Empty if the path does not fit, 107 bytes at most.
+    static std::optional<Address> local(std::string_view path) {
+        Address address;
+        sockaddr_un* un = reinterpret_cast<sockaddr_un*>(&address.storage);
+        if(path.empty() || path.size() >= sizeof(un->sun_path)) return std::nullopt;
+        un->sun_family = AF_UNIX;
+        std::memcpy(un->sun_path, path.data(), path.size());
+        size_t length = path.size() + 1;  // Path ones end with a '\0'.
+        if(path[0] == '@') {
+            un->sun_path[0] = '\0';      // Abstract ones don't: the name is the bytes after it.
+            length = path.size();
+        }
+        address.length = (socklen_t)(offsetof(sockaddr_un, sun_path) + length);
+        return address;
     }
 
-    operator sock_t() const { return sock_fd; }
+    // The wildcard address of a family, to listen on every interface.
+    static Address any(int family, int port) {
+        Address address;
+        if(family == AF_INET6) {
+            sockaddr_in6* v6 = reinterpret_cast<sockaddr_in6*>(&address.storage);
+            v6->sin6_family = AF_INET6;
+            v6->sin6_addr = in6addr_any;
+            v6->sin6_port = htons(port);
+            address.length = sizeof(sockaddr_in6);
+        }
+        else {
+            sockaddr_in* v4 = reinterpret_cast<sockaddr_in*>(&address.storage);
+            v4->sin_family = AF_INET;
+            v4->sin_addr.s_addr = INADDR_ANY;
+            v4->sin_port = htons(port);
+            address.length = sizeof(sockaddr_in);
+        }
+        return address;
+    }
 
-    void setSock(int sock_fd) {
-        this->sock_fd = sock_fd;
+    // AF_INET, AF_INET6, or AF_UNSPEC if not set.
+    int family() const {
+        return storage.ss_family;
     }
 
-    void setIp(std::string ip) {
-        this->ip = ip;
+    bool isV6() const {
+        return storage.ss_family == AF_INET6;
     }
 
-    void setPort(int port) {
-        this->port = port;
+    bool isUnix() const {
+        return storage.ss_family == AF_UNIX;
     }
 
-    void setAddrLen(size_t addrLen) {
-        this->addrLen = addrLen;
+    // The port. 0 for Unix domain sockets, which have none.
+    int port() const {
+        if(isV6()) return ntohs(reinterpret_cast<const sockaddr_in6*>(&storage)->sin6_port);
+        if(isUnix()) return 0;
+        return ntohs(reinterpret_cast<const sockaddr_in*>(&storage)->sin_port);
     }
 
-    sock_t getSock() {
-        return sock_fd;
+    void setPort(int port) {
+        if(isV6()) reinterpret_cast<sockaddr_in6*>(&storage)->sin6_port = htons(port);
+        else if(!isUnix()) reinterpret_cast<sockaddr_in*>(&storage)->sin_port = htons(port);
     }
 
-    std::string getIp() {
-        return ip;
+    // The path of a Unix domain socket, with '@' for abstract ones. Empty for unnamed ones, like the client end of a connection.
+    std::string path() const {
+        if(!isUnix()) return std::string();
+        const sockaddr_un* un = reinterpret_cast<const sockaddr_un*>(&storage);
+        size_t size = length > offsetof(sockaddr_un, sun_path) ? length - offsetof(sockaddr_un, sun_path) : 0;
+        if(size == 0) return std::string();
+        if(un->sun_path[0] == '\0') return "@" + std::string(un->sun_path + 1, size - 1);
+        return std::string(un->sun_path, strnlen(un->sun_path, size));
     }
 
-    std::string getIpStr() {
-        return inet_ntoa(addr.sin_addr);
+    // Formats the ip. IPv4-mapped IPv6 addresses are printed as IPv4, Unix domain sockets as "unix:/path".
+    std::string ip() const {
+        if(isUnix()) return "unix:" + path();
+        char text[INET6_ADDRSTRLEN] = "";
+        if(isV6()) {
+            const in6_addr& a = reinterpret_cast<const sockaddr_in6*>(&storage)->sin6_addr;
+            if(IN6_IS_ADDR_V4MAPPED(&a)) inet_ntop(AF_INET, &a.s6_addr[12], text, sizeof(text));
+            else inet_ntop(AF_INET6, &a, text, sizeof(text));
+        }
+        else if(family() == AF_INET) {
+            inet_ntop(AF_INET, &reinterpret_cast<const sockaddr_in*>(&storage)->sin_addr, text, sizeof(text));
+        }
+        return text;
     }
 
-    int getPort() {
-        return port;
+    // Formats "ip:port", with brackets for IPv6: "[::1]:49110". Unix domain sockets have no port: "unix:/path".
+    std::string toString() const {
+        std::string text = ip();
+        if(isUnix()) return text;
+        if(isV6() && text.find(':') != std::string::npos) text = "[" + text + "]";
+        return text + ":" + std::to_string(port());
     }
 
-    sockaddr_in* getAddr() {
-        return &addr;
+    sockaddr* data() { return reinterpret_cast<sockaddr*>(&storage); }
+    const sockaddr* data() const { return reinterpret_cast<const sockaddr*>(&storage); }
+
+    // The length of the address. `sizePtr()` is for calls that fill it in, like accept().
+    socklen_t size() const { return length; }
+    socklen_t* sizePtr() { return &length; }
+};
+
+// SocketOptions struct.
+/**
+ *
+ * @brief ## `skt::SocketOptions`
+ *
+ * @note - Typed socket options. Only the fields that are set are applied, the others keep the system default.
+ * @note - Given to the `skt::Socket` constructor, they are applied before bind/listen or connect, so buffer sizes also size the TCP window.
+ * @note - Connections accepted from a server socket get the same options: most of them are inherited by the kernel, and `quickAck`/`cork` are set again on each accepted node.
+ * @note - Options marked Linux only are ignored on other platforms.
+ * @note #### Examples:
+ * @note `skt::Socket sock(49110, ANY_ADDR, false, skt::SocketOptions::lowLatency());` - A server tuned for request/response traffic.
+ * @note `auto opts = skt::SocketOptions::bulkThroughput(); opts.keepAlive = true;` - Presets are plain structs, fields can be changed.
+ *
+ */
+struct SocketOptions {
+    std::optional<bool> noDelay;           // TCP_NODELAY: send small writes right away, don't wait to fill a segment.
+    std::optional<bool> cork;              // TCP_CORK: hold partial segments until uncorked, or 200ms. Linux only.
+    std::optional<int>  sendBuffer;        // SO_SNDBUF, in bytes. The kernel may double or cap it.
+    std::optional<int>  recvBuffer;        // SO_RCVBUF, in bytes. The kernel may double or cap it.
+    std::optional<bool> quickAck;          // TCP_QUICKACK: ack right away instead of delaying. Linux only.
+    std::optional<int>  busyPoll;          // SO_BUSY_POLL, in microseconds to spin on the device queue before sleeping. Linux only, may need CAP_NET_ADMIN.
+    std::optional<int>  fastOpen;          // TCP_FASTOPEN: on servers, the pending fast open queue length. On clients, non-zero sends data in the SYN. Linux only.
+    std::optional<bool> keepAlive;         // SO_KEEPALIVE: probe idle connections, to detect dead peers.
+    std::optional<int>  keepAliveIdle;     // TCP_KEEPIDLE, in seconds of idle before probing. Linux only.
+    std::optional<int>  keepAliveInterval; // TCP_KEEPINTVL, in seconds between probes. Linux only.
+    std::optional<int>  keepAliveCount;    // TCP_KEEPCNT, probes lost before dropping the connection. Linux only.
+
+    // Small messages, latency first: no Nagle, no delayed acks. Add `busyPoll` (ex: 50) when allowed to spin.
+    static SocketOptions lowLatency() {
+        SocketOptions options;
+        options.noDelay = true;
+        options.quickAck = true;
+        return options;
     }
 
-    socklen_t* getAddrLen() {
-        return &addrLen;
+    // Large transfers, throughput first: big buffers for a wide TCP window, full segments.
+    static SocketOptions bulkThroughput() {
+        SocketOptions options;
+        options.noDelay = false;
+        options.sendBuffer = 4 << 20;
+        options.recvBuffer = 4 << 20;
+        return options;
     }
 
-    // Send data to the connected server.
-    /**
-     *
-     * @brief Every node is a client, so this method sends data to the server it is connected to.
-     *
-     * @param data The data to be sent.
-     *
-     * @throw `std::runtime_error()` if the data can't be sent.
-     *
-     */
-    void send(std::string data) {
-        int sent = ::send(sock_fd, data.c_str(), data.size(), 0);
-        if(sent < 0) {
-            throw std::runtime_error("Error sending data");
-        }
+    // Overrides the fields set in `other`.
+    SocketOptions& merge(const SocketOptions& other) {
+        auto take = [](auto& field, const auto& value) { if(value) field = value; };
+        take(noDelay, other.noDelay);
+        take(cork, other.cork);
+        take(sendBuffer, other.sendBuffer);
+        take(recvBuffer, other.recvBuffer);
+        take(quickAck, other.quickAck);
+        take(busyPoll, other.busyPoll);
+        take(fastOpen, other.fastOpen);
+        take(keepAlive, other.keepAlive);
+        take(keepAliveIdle, other.keepAliveIdle);
+        take(keepAliveInterval, other.keepAliveInterval);
+        take(keepAliveCount, other.keepAliveCount);
+        return *this;
     }
+};
 
-    // Receives data from the connected server.
-    /**
-     *
-     * @brief As a client, this method receives data from the server, and stores it in the buffer.
-     *
-     * @param buffer[] The buffer to store the data. If omitted, it will use the internal buffer.
-     *
-     * @returns The data received, as a std::string. If the data bytes is 0, it will return an empty string.
-     *
-     * @throw `std::runtime_error()` if the data can't be received.
-     *
-     */
-    std::string recv(char buffer[]=nullptr) {
-        if(buffer == nullptr) { buffer = this->buffer; }
+// Result class.
+/**
+ *
+ * @brief ## `skt::Result<T>`
+ *
+ * @note - A value, or the `std::error_code` of why there is none. Returned by the `noexcept` calls (`sendSome()`, `recvSome()`, `acceptSome()`), which never throw or allocate on failure.
+ * @note - Works like C++23 `std::expected<T, std::error_code>`: test it, then read `*result` or `result.error()`.
+ * @note - `skt::isWouldBlock(result.error())` tells the normal "try again later" of non-blocking sockets from real failures.
+ * @note #### Examples:
+ * @note `auto sent = node.sendSome(data); if(sent) data.remove_prefix(*sent); else if(!skt::isWouldBlock(sent.error())) close();`
+ *
+ */
+template<typename T>
+class Result {
+    T result{};
+    std::error_code code;
 
-        int received = ::recv(sock_fd, buffer, 4096, 0);
-        if(received < 0) {
-            throw std::runtime_error("Error receiving data");
-        }
-        std::string data = std::string(buffer, received);
-        if(received == 0) data = "";
+public:
 
-        return data;
+    Result(T value) noexcept(std::is_nothrow_move_constructible<T>::value) : result(std::move(value)) {}
+    Result(std::error_code error) noexcept : code(error) {}
+
+    bool hasValue() const noexcept { return !code; }
+    explicit operator bool() const noexcept { return !code; }
+
+    // The value. Throws `std::system_error` with the error, if there is none.
+    T& value() & {
+        if(code) throw std::system_error(code);
+        return result;
+    }
+
+    T&& value() && {
+        if(code) throw std::system_error(code);
+        return std::move(result);
     }
 
+    T& operator*() & noexcept { return result; }
+    T&& operator*() && noexcept { return std::move(result); }
+    T* operator->() noexcept { return &result; }
+
+    const std::error_code& error() const noexcept { return code; }
+
+    T valueOr(T fallback) const& { return code ? fallback : result; }
 };
 
-// Socket class.
+// True if `error` means the operation would block: no data, no room, or no pending connection on a non-blocking socket.
+inline bool isWouldBlock(const std::error_code& error) noexcept {
+#ifdef SO_WINDOWS
+    return error.value() == WSAEWOULDBLOCK && error.category() == std::system_category();
+#else
+    return error == std::errc::operation_would_block || error == std::errc::resource_unavailable_try_again;
+#endif
+}
+
+// IoCounters struct.
 /**
  *
- * @brief ## `skt::Socket`
- *
- * @param port      The port that the socket will connect or bind. No default value, must be set.
- * @param ip        The ip that the socket will be bind, or to connected to. If not set, fallback to 0.0.0.0
- * @param isClient  Tell the socket if it is a client or not. If not set, fallback to false. Check note below.
- * @param reuseAddr Tell the socket if it should reuse the address or not. If not set, fallback to true.
- * @param queued    Tell the socket how many connections it should queue until droping requisitions. If not set, fallback to 10.
+ * @brief ## `skt::IoCounters`
  *
- * @throw `std::runtime_error()` if the socket can't be created. Sometimes it can be fixed, so you should try to treat it. Ex: bad port.
+ * @note - A plain copy of I/O counters, taken with `skt::IoStats::snapshot()` or `skt::IoStats::total()`.
+ * @note - `sendCalls`/`recvCalls` count syscalls, including the ones that failed or would block.
+ * @note - `shortWrites` are sends that took only part of the data. `wouldBlocks` are calls that returned `EAGAIN`, `errors` the ones that failed.
+ * @note #### Examples:
+ * @note `std::cout << skt::toPrometheus(skt::IoStats::total());` - Process-wide counters, in the Prometheus text format.
  *
- * @note If the socket is a client, the ip and port will be used to connect to the server.
+ */
+struct IoCounters {
+    uint64_t bytesSent = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t sendCalls = 0;
+    uint64_t recvCalls = 0;
+    uint64_t shortWrites = 0;
+    uint64_t wouldBlocks = 0;
+    uint64_t errors = 0;
+    uint64_t accepts = 0;
+    uint64_t acceptErrors = 0;
+    uint64_t connects = 0;
+    uint64_t connectErrors = 0;
+
+    IoCounters& operator+=(const IoCounters& other) {
+        bytesSent += other.bytesSent;
+        bytesReceived += other.bytesReceived;
+        sendCalls += other.sendCalls;
+        recvCalls += other.recvCalls;
+        shortWrites += other.shortWrites;
+        wouldBlocks += other.wouldBlocks;
+        errors += other.errors;
+        accepts += other.accepts;
+        acceptErrors += other.acceptErrors;
+        connects += other.connects;
+        connectErrors += other.connectErrors;
+        return *this;
+    }
+};
+
+// IoStats class.
+/**
  *
- * @note ##### As a Client:
- * @note - If client, MUST call `connect()` or `connectRef()` to connect to a server. `client.connect()`
- * @note - As a client, if connecting to localhost, `LOCALHOST` should be used instead of `ANY_ADDR` in windows.
- * @note ##### As a Server:
- * @note - After a unexpected error, the socket may be in a `TIME_WAIT` state, and even with `SO_REUSEADDR`, it may not be able to bind to the same port. So, if your server can't bind to the same port after a crash, or a Ctrl + C, you should wait a few seconds before trying to bind again, or change port.
- * @note #### Overloads:
- * @note `skt::Socket sock(49110);` - Creates a server socket, listening on port 49110, binded to 0.0.0.0
- * @note `skt::Socket sock(49110, true)` - Creates a client socket, connecting to 127.0.0.0 on port 49110.
- * @note `skt::Socket sock(49110, LOCALHOST, true);` - Creates a client socket, connecting to localhost on port 49110.
- * @note `skt::Socket sock(49110, ANY_ADDR, false, true, 10);` - Creates a server socket, listening on port 49110, with reuseAddr set to true, and queued set to 10.
+ * @brief ## `skt::IoStats`
  *
+ * @note - Live I/O counters of a `skt::Node` or `skt::Socket`, see `getStats()`. Every call is also added to the process-wide `IoStats::total()`.
+ * @note - Relaxed atomics: recording takes no lock, and `snapshot()` can be called from any thread while the socket is in use.
+ * @note - A socket is used by one thread at a time, so its counters are bumped with a plain load and store, not a locked read-modify-write.
+ * @note - Accepts are the exception, a listener can be shared by the workers of a `skt::Acceptor`: they are added atomically.
+ * @note - The process-wide counters are kept per thread, so threads doing I/O never write the same cache line.
+ * @note - Compiled out with `#define SKT_NO_STATS`: recording does nothing, and the counters stay at 0.
  *
  */
-class Socket {
-    
-    sock_t socket;
-    std::string ip;
-    sockaddr_in addr;
-    socklen_t addrLen = sizeof(addr);
-    bool reuseAddr;
-    char buffer[4096];
-    int port{}, queued{};
-    bool isClient;
+class IoStats {
+#ifndef SKT_NO_STATS
+    std::atomic<uint64_t> bytesSent{0}, bytesReceived{0}, sendCalls{0}, recvCalls{0}, shortWrites{0},
+                          wouldBlocks{0}, errors{0}, accepts{0}, acceptErrors{0}, connects{0}, connectErrors{0};
 
-    sock_t createSocket(){
-        sock_t sock;
-    #ifdef SO_WINDOWS
-        WSADATA wsaData;
-        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-            throw std::runtime_error("WSAStartup failed");
-        }
-    #endif
-        sock = ::socket(AF_INET, SOCK_STREAM, 0);
-        if (sock == INVALID_SOCKET) {
-            throw std::runtime_error("Error creating socket");
-        }
-        return sock;
+    // Single writer: readers may see the counter late, but never torn.
+    static void add(std::atomic<uint64_t>& counter, uint64_t n) noexcept {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
     }
 
-    void setAddr() {
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(port);
-        if(isClient)
-            addr.sin_addr.s_addr = inet_addr(ip.c_str());
-        else
-            addr.sin_addr.s_addr = INADDR_ANY;
+    // Several writers.
+    static void addShared(std::atomic<uint64_t>& counter, uint64_t n) noexcept {
+        counter.fetch_add(n, std::memory_order_relaxed);
     }
+#endif
 
+public:
 
-    void bindSocket() {
-        if(reuseAddr) {
-            int opt = 1;
+    IoStats() = default;
 
-        #ifdef SO_WINDOWS
-            if (setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt)) < 0) 
-        #else
-            if (setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
-        #endif
-                throw std::runtime_error("Error setting socket options");
-        }
+    // Copies keep the counts, ex: when a `skt::Node` is moved.
+    IoStats(const IoStats& other) noexcept { *this = other; }
 
-        if(::bind(socket, (struct sockaddr *)&addr, addrLen) < 0) {
-            throw std::runtime_error("Error binding socket to IP/Port");
-        }
+    IoStats& operator=(const IoStats& other) noexcept {
+    #ifndef SKT_NO_STATS
+        IoCounters counts = other.snapshot();
+        bytesSent.store(counts.bytesSent, std::memory_order_relaxed);
+        bytesReceived.store(counts.bytesReceived, std::memory_order_relaxed);
+        sendCalls.store(counts.sendCalls, std::memory_order_relaxed);
+        recvCalls.store(counts.recvCalls, std::memory_order_relaxed);
+        shortWrites.store(counts.shortWrites, std::memory_order_relaxed);
+        wouldBlocks.store(counts.wouldBlocks, std::memory_order_relaxed);
+        errors.store(counts.errors, std::memory_order_relaxed);
+        accepts.store(counts.accepts, std::memory_order_relaxed);
+        acceptErrors.store(counts.acceptErrors, std::memory_order_relaxed);
+        connects.store(counts.connects, std::memory_order_relaxed);
+        connectErrors.store(counts.connectErrors, std::memory_order_relaxed);
+    #else
+        (void)other;
+    #endif
+        return *this;
     }
 
-    void listenSocket() {
-        if(::listen(socket, queued) < 0) {
-            throw std::runtime_error("Error listening to socket");
+    // Records a send call: `result` is what it returned, `requested` how much it was asked to send.
+    void onSend(long result, size_t requested, bool wouldBlock) noexcept {
+    #ifndef SKT_NO_STATS
+        add(sendCalls, 1);
+        if(result < 0) add(wouldBlock ? wouldBlocks : errors, 1);
+        else {
+            add(bytesSent, (uint64_t)result);
+            if((size_t)result < requested) add(shortWrites, 1);
         }
+    #else
+        (void)result; (void)requested; (void)wouldBlock;
+    #endif
     }
 
-public:
-    
-    Socket(int port, bool isClient){
-        this->ip = LOCALHOST;
-        this->port = port;
-        this->isClient = isClient;
-        this->reuseAddr = true;
-        this->queued = 10;
-        this->socket = createSocket();
-        setAddr();
+    // Records a recv call: `result` is what it returned.
+    void onRecv(long result, bool wouldBlock) noexcept {
+    #ifndef SKT_NO_STATS
+        add(recvCalls, 1);
+        if(result < 0) add(wouldBlock ? wouldBlocks : errors, 1);
+        else add(bytesReceived, (uint64_t)result);
+    #else
+        (void)result; (void)wouldBlock;
+    #endif
+    }
 
-        if(!isClient) {
-            bindSocket();
-            listenSocket();
-        }
+    // Records an accept call. An empty queue on a non-blocking socket is not an error.
+    void onAccept(bool accepted, bool wouldBlock) noexcept {
+    #ifndef SKT_NO_STATS
+        if(accepted) addShared(accepts, 1);
+        else addShared(wouldBlock ? wouldBlocks : acceptErrors, 1);
+    #else
+        (void)accepted; (void)wouldBlock;
+    #endif
+    }
 
+    // Records a finished connect attempt.
+    void onConnect(bool connected) noexcept {
+    #ifndef SKT_NO_STATS
+        add(connected ? connects : connectErrors, 1);
+    #else
+        (void)connected;
+    #endif
     }
 
-    Socket(int port, std::string ip=ANY_ADDR, bool isClient=false, bool reuseAddr=true, int queued=10){
-        this->ip = ip;
-        this->port = port;
-        this->isClient = isClient;
-        this->socket = createSocket();
-        this->queued = queued;
-        setAddr();
+    // Returns a copy of the counters. The fields are read one by one, not as a single atomic snapshot.
+    IoCounters snapshot() const noexcept {
+        IoCounters counts;
+    #ifndef SKT_NO_STATS
+        counts.bytesSent = bytesSent.load(std::memory_order_relaxed);
+        counts.bytesReceived = bytesReceived.load(std::memory_order_relaxed);
+        counts.sendCalls = sendCalls.load(std::memory_order_relaxed);
+        counts.recvCalls = recvCalls.load(std::memory_order_relaxed);
+        counts.shortWrites = shortWrites.load(std::memory_order_relaxed);
+        counts.wouldBlocks = wouldBlocks.load(std::memory_order_relaxed);
+        counts.errors = errors.load(std::memory_order_relaxed);
+        counts.accepts = accepts.load(std::memory_order_relaxed);
+        counts.acceptErrors = acceptErrors.load(std::memory_order_relaxed);
+        counts.connects = connects.load(std::memory_order_relaxed);
+        counts.connectErrors = connectErrors.load(std::memory_order_relaxed);
+    #endif
+        return counts;
+    }
 
-        if(!isClient){
-            bindSocket();
-            listenSocket();         
-        }
+    // Sets the counters back to 0.
+    void reset() noexcept {
+        *this = IoStats();
     }
 
-    // Accepts a new connection.
-    /**
-     * 
-     * @brief ## Accepts a new connection.
-     * 
-     * @note Hangs until a new connection is made.
-     * 
-     * @throw `std::runtime_error()` if the socket can't be accepted, or if it is a client socket.
-     * 
-     * @returns A pointer to a `skt::Node` object, containing the new socket file descriptor, ip and port. See skt::Node class.
-     * 
-     * @warning Put the returned pointer in a smart pointer to avoid memory leaks, or delete it manually.
-     * 
-     */
-    Node* accept() {
-        if(isClient) {
-            throw std::runtime_error("Can't accept connections on a client socket");
-        }
+    // The process-wide counters of the calling thread.
+    static IoStats& shard() noexcept;
+
+    // Returns the process-wide counters: every call made through the library, on any socket and any thread.
+    static IoCounters total() noexcept;
+};
 
-        Node* node = new Node();
+// LatencyHistogram class.
+/**
+ *
+ * @brief ## `skt::LatencyHistogram`
+ *
+ * @note - Counts durations in power-of-two buckets of microseconds: bucket 0 is under 1us, bucket `i` is under `2^i` us, the last one is everything above.
+ * @note - Recording is a relaxed atomic increment, `snapshot()` can be read from any thread.
+ * @note - `skt::EventLoop::tickLatency()` records how long each loop iteration spent running callbacks.
+ * @note #### Examples:
+ * @note `auto ticks = loop.tickLatency().snapshot(); ticks.percentile(0.99);` - The 99th percentile tick, in microseconds (bucket upper bound).
+ *
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t BUCKETS = 32;
 
-        node->setSock(::accept(socket, (struct sockaddr *)node->getAddr(), node->getAddrLen()));
-        node->setIp(inet_ntoa(node->getAddr()->sin_addr));
-        node->setPort(port);
+    // A copy of the histogram.
+    struct Snapshot {
+        uint64_t counts[BUCKETS] = {};
+        uint64_t count = 0;
+        uint64_t sumNs = 0;
 
-        if(node->getSock() < 0) {
-            throw std::runtime_error("Error accepting connection");
+        // The upper bound of the bucket holding the `p` quantile (0 to 1), in microseconds. 0 if empty.
+        double percentile(double p) const {
+            if(count == 0) return 0;
+            uint64_t rank = (uint64_t)(p * (double)count);
+            uint64_t seen = 0;
+            for(size_t i = 0; i < BUCKETS; i++) {
+                seen += counts[i];
+                if(seen > rank) return upperBound(i);
+            }
+            return upperBound(BUCKETS - 1);
         }
-        return node;
+    };
+
+    // The upper bound of bucket `i`, in microseconds.
+    static double upperBound(size_t i) {
+        return (double)(uint64_t(1) << i);
+    }
+
+    void record(std::chrono::nanoseconds duration) noexcept {
+    #ifndef SKT_NO_STATS
+        uint64_t ns = duration.count() > 0 ? (uint64_t)duration.count() : 0;
+        uint64_t us = ns / 1000;
+        size_t bucket = 0;
+        while(us > 0 && bucket < BUCKETS - 1) { us >>= 1; bucket++; }
+        counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        sumNs.fetch_add(ns, std::memory_order_relaxed);
+    #else
+        (void)duration;
+    #endif
+    }
+
+    Snapshot snapshot() const noexcept {
+        Snapshot snap;
+    #ifndef SKT_NO_STATS
+        for(size_t i = 0; i < BUCKETS; i++) {
+            snap.counts[i] = counts[i].load(std::memory_order_relaxed);
+            snap.count += snap.counts[i];
+        }
+        snap.sumNs = sumNs.load(std::memory_order_relaxed);
+    #endif
+        return snap;
+    }
+
+    void reset() noexcept {
+    #ifndef SKT_NO_STATS
+        for(auto& c : counts) c.store(0, std::memory_order_relaxed);
+        sumNs.store(0, std::memory_order_relaxed);
+    #endif
+    }
+
+private:
+#ifndef SKT_NO_STATS
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+    std::atomic<uint64_t> sumNs{0};
+#endif
+};
+
+namespace detail {
+    // The process-wide counters: the threads alive, and what the finished ones counted.
+    struct StatsRegistry {
+        std::mutex mutex;
+        std::vector<const IoStats*> live;
+        IoCounters retired;
+    };
+
+    // Never destroyed: threads still running at exit keep counting.
+    inline StatsRegistry& statsRegistry() noexcept {
+        static StatsRegistry* registry = new StatsRegistry();
+        return *registry;
+    }
+
+    // The counters of one thread, the only one writing them. Padded to a cache line, so no other thread's share it.
+    struct alignas(64) ThreadStats {
+        IoStats stats;
+
+        ThreadStats() {
+            StatsRegistry& registry = statsRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.live.push_back(&stats);
+        }
+
+        ~ThreadStats() {
+            StatsRegistry& registry = statsRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            registry.retired += stats.snapshot();
+            registry.live.erase(std::find(registry.live.begin(), registry.live.end(), &stats));
+        }
+    };
+
+    // The time, for latency stats. Not read at all when they are compiled out.
+    inline std::chrono::steady_clock::time_point statsClock() noexcept {
+    #ifndef SKT_NO_STATS
+        return std::chrono::steady_clock::now();
+    #else
+        return {};
+    #endif
+    }
+
+    // Appends one Prometheus sample line.
+    inline void promSample(std::string& out, std::string_view name, std::string_view suffix, std::string_view labels, std::string_view extra, double value) {
+        out.append(name).append(suffix);
+        if(!labels.empty() || !extra.empty()) {
+            out += '{';
+            out.append(labels);
+            if(!labels.empty() && !extra.empty()) out += ',';
+            out.append(extra);
+            out += '}';
+        }
+        char number[32];
+        snprintf(number, sizeof(number), " %.17g\n", value);
+        out += number;
+    }
+}
+
+inline IoStats& IoStats::shard() noexcept {
+    thread_local detail::ThreadStats local;
+    return local.stats;
+}
+
+inline IoCounters IoStats::total() noexcept {
+    detail::StatsRegistry& registry = detail::statsRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    IoCounters counts = registry.retired;
+    for(const IoStats* stats : registry.live) counts += stats->snapshot();
+    return counts;
+}
+
+// Formats counters for Prometheus.
+/**
+ *
+ * @brief ## Formats I/O counters in the Prometheus text exposition format.
+ *
+ * @param counts The counters, ex: `skt::IoStats::total()` or `node.getStats().snapshot()`.
+ * @param prefix The metric name prefix. If not set, fallback to "skt".
+ * @param labels Labels added to every sample, ex: `"listener=\"api\""`. If not set, none.
+ *
+ * @returns The `# TYPE` and sample lines, ready to be served on a `/metrics` endpoint.
+ *
+ */
+inline std::string toPrometheus(const IoCounters& counts, std::string_view prefix="skt", std::string_view labels="") {
+    const std::pair<const char*, uint64_t> metrics[] = {
+        {"_bytes_sent_total", counts.bytesSent}, {"_bytes_received_total", counts.bytesReceived},
+        {"_send_calls_total", counts.sendCalls}, {"_recv_calls_total", counts.recvCalls},
+        {"_short_writes_total", counts.shortWrites}, {"_would_block_total", counts.wouldBlocks},
+        {"_errors_total", counts.errors}, {"_accepts_total", counts.accepts},
+        {"_accept_errors_total", counts.acceptErrors}, {"_connects_total", counts.connects},
+        {"_connect_errors_total", counts.connectErrors},
+    };
+    std::string out;
+    for(const auto& [suffix, value] : metrics) {
+        out.append("# TYPE ").append(prefix).append(suffix).append(" counter\n");
+        detail::promSample(out, prefix, suffix, labels, "", (double)value);
+    }
+    return out;
+}
+
+// Formats a latency histogram for Prometheus.
+/**
+ *
+ * @brief ## Formats a latency histogram in the Prometheus text exposition format, in seconds.
+ *
+ * @param histogram The histogram, ex: `loop.tickLatency().snapshot()`.
+ * @param name      The metric name, ex: `"skt_loop_tick_seconds"`.
+ * @param labels    Labels added to every sample. If not set, none.
+ *
+ * @returns The `# TYPE` line, the cumulative `_bucket` lines, `_sum` and `_count`.
+ *
+ */
+inline std::string toPrometheus(const LatencyHistogram::Snapshot& histogram, std::string_view name, std::string_view labels="") {
+    std::string out;
+    out.append("# TYPE ").append(name).append(" histogram\n");
+    uint64_t cumulative = 0;
+    for(size_t i = 0; i < LatencyHistogram::BUCKETS - 1; i++) {
+        cumulative += histogram.counts[i];
+        char le[48];
+        snprintf(le, sizeof(le), "le=\"%g\"", LatencyHistogram::upperBound(i) / 1e6);
+        detail::promSample(out, name, "_bucket", labels, le, (double)cumulative);
+    }
+    detail::promSample(out, name, "_bucket", labels, "le=\"+Inf\"", (double)histogram.count);
+    detail::promSample(out, name, "_sum", labels, "", (double)histogram.sumNs / 1e9);
+    detail::promSample(out, name, "_count", labels, "", (double)histogram.count);
+    return out;
+}
+
+// Internal helpers shared by Node and Socket. Not part of the public API.
+namespace detail {
+
+    // Buffers passed to the kernel per vectored call. Longer lists take more calls.
+    const size_t MAX_IOV = 64;
+
+    // Created sockets are close-on-exec: a process started by the program, ex: the next version in a restart, only gets what is handed to it.
+#ifdef SO_WINDOWS
+    const int CLOEXEC = 0;
+#else
+    const int CLOEXEC = SOCK_CLOEXEC;
+#endif
+
+    // Stream sends never raise SIGPIPE: a peer that left is an error (EPIPE), not the end of the process. Where there is no such flag, sockets get SO_NOSIGPIPE.
+#ifdef MSG_NOSIGNAL
+    const int NOSIGNAL = MSG_NOSIGNAL;
+#else
+    const int NOSIGNAL = 0;
+#endif
+
+    inline int closeSocket(sock_t fd) {
+    #ifdef SO_WINDOWS
+        return closesocket(fd);
+    #else
+        return ::close(fd);
+    #endif
+    }
+
+    // The error of the last failed socket call, read right away so later calls can't clobber it.
+    inline std::error_code lastError() noexcept {
+    #ifdef SO_WINDOWS
+        return std::error_code(WSAGetLastError(), std::system_category());
+    #else
+        return std::error_code(errno, std::system_category());
+    #endif
+    }
+
+    // Throws a `std::system_error` (a `std::runtime_error`) carrying the error of the last failed socket call.
+    [[noreturn]] inline void throwLastError(const char* what) {
+        throw std::system_error(lastError(), what);
+    }
+
+    // An owned socket descriptor: closed on destruction, reset to INVALID_SOCKET when moved from.
+    // Converts to `sock_t`, so it can be passed straight to the socket calls.
+    class UniqueFd {
+        sock_t fd = INVALID_SOCKET;
+        bool owned = true;
+
+    public:
+        UniqueFd() = default;
+        UniqueFd(sock_t fd, bool owned=true) : fd(fd), owned(owned) {}
+
+        UniqueFd(UniqueFd&& other) noexcept : fd(other.fd), owned(other.owned) {
+            other.fd = INVALID_SOCKET;
+        }
+
+        UniqueFd& operator=(UniqueFd&& other) noexcept {
+            if(this != &other) {
+                reset();
+                fd = other.fd;
+                owned = other.owned;
+                other.fd = INVALID_SOCKET;
+            }
+            return *this;
+        }
+
+        ~UniqueFd() { reset(); }
+
+        operator sock_t() const { return fd; }
+
+        // Closes the descriptor if owned. Returns the close result, 0 if there was nothing to close.
+        int reset() {
+            int result = 0;
+            if(fd != INVALID_SOCKET && owned) result = closeSocket(fd);
+            fd = INVALID_SOCKET;
+            return result;
+        }
+
+        // Gives up the descriptor, without closing it.
+        sock_t release() {
+            sock_t released = fd;
+            fd = INVALID_SOCKET;
+            return released;
+        }
+
+        bool isOwned() const { return owned; }
+        void setOwned(bool owned) { this->owned = owned; }
+    };
+
+    // Receive size used when no buffer is given, and the largest one that can be set.
+    const size_t RECV_SIZE = 4096;
+    const size_t MAX_RECV_SIZE = size_t(1) << 26;
+
+    // Picks how much to read per recv call. In adaptive mode, doubles when a read fills
+    // the buffer, and halves after two reads in a row that used less than half of it.
+    struct RecvSizer {
+        size_t size = RECV_SIZE, min = RECV_SIZE, max = RECV_SIZE;
+        bool adaptive = false;
+        unsigned smallReads = 0;
+
+        void update(size_t received) {
+            if(!adaptive) return;
+            if(received >= size) {
+                smallReads = 0;
+                size = std::min(size * 2, max);
+            } else if(received < size / 2) {
+                if(++smallReads < 2) return;
+                smallReads = 0;
+                size = std::max(size / 2, min);
+            } else {
+                smallReads = 0;
+            }
+        }
+
+        void set(size_t size) {
+            this->size = std::min(std::max<size_t>(size, 1), MAX_RECV_SIZE);
+            adaptive = false;
+        }
+
+        void setAdaptive(bool adaptive, size_t min, size_t max) {
+            this->min = std::min(std::max<size_t>(min, 1), MAX_RECV_SIZE);
+            this->max = std::min(std::max(max, this->min), MAX_RECV_SIZE);
+            this->adaptive = adaptive;
+            size = std::min(std::max(size, this->min), this->max);
+            smallReads = 0;
+        }
+    };
+
+    // True if the last socket call failed only because a non-blocking socket was not ready.
+    inline bool wouldBlock() {
+    #ifdef SO_WINDOWS
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+    #else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    #endif
+    }
+
+    // Records a call in `stats`, if set, and in the process-wide shard of this thread.
+    // Called right after the syscall: the error of a failed one is read from errno.
+    inline void countSend(IoStats* stats, long result, size_t requested) noexcept {
+    #ifndef SKT_NO_STATS
+        bool blocked = result < 0 && wouldBlock();
+        IoStats::shard().onSend(result, requested, blocked);
+        if(stats) stats->onSend(result, requested, blocked);
+    #else
+        (void)stats; (void)result; (void)requested;
+    #endif
+    }
+
+    inline void countRecv(IoStats* stats, long result) noexcept {
+    #ifndef SKT_NO_STATS
+        bool blocked = result < 0 && wouldBlock();
+        IoStats::shard().onRecv(result, blocked);
+        if(stats) stats->onRecv(result, blocked);
+    #else
+        (void)stats; (void)result;
+    #endif
+    }
+
+    inline void countAccept(IoStats* stats, bool accepted) noexcept {
+    #ifndef SKT_NO_STATS
+        bool blocked = !accepted && wouldBlock();
+        IoStats::shard().onAccept(accepted, blocked);
+        if(stats) stats->onAccept(accepted, blocked);
+    #else
+        (void)stats; (void)accepted;
+    #endif
+    }
+
+    inline void countConnect(IoStats* stats, bool connected) noexcept {
+    #ifndef SKT_NO_STATS
+        IoStats::shard().onConnect(connected);
+        if(stats) stats->onConnect(connected);
+    #else
+        (void)stats; (void)connected;
+    #endif
+    }
+
+    inline void setNonBlocking(sock_t fd, bool nonBlocking) {
+    #ifdef SO_WINDOWS
+        u_long mode = nonBlocking ? 1 : 0;
+        if(ioctlsocket(fd, FIONBIO, &mode) != 0)
+    #else
+        int flags = fcntl(fd, F_GETFL, 0);
+        if(flags < 0 || fcntl(fd, F_SETFL, nonBlocking ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK)) < 0)
+    #endif
+            detail::throwLastError("Error setting non-blocking mode");
+    }
+
+    inline bool trySetOption(sock_t fd, int level, int name, int value) noexcept {
+        return setsockopt(fd, level, name, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+    }
+
+    inline void setOption(sock_t fd, int level, int name, int value) {
+        if(!trySetOption(fd, level, name, value)) {
+            detail::throwLastError("Error setting socket options");
+        }
+    }
+
+    // Applies the options that are set. `listening` picks the server meaning of TCP_FASTOPEN.
+    // Without `tcp` (Unix domain sockets), only the socket level ones apply: buffer sizes and busy polling.
+    inline void applyOptions(sock_t fd, const SocketOptions& options, bool listening, bool tcp=true) {
+    #ifdef SO_NOSIGPIPE
+        setOption(fd, SOL_SOCKET, SO_NOSIGPIPE, 1);
+    #endif
+        if(options.sendBuffer) setOption(fd, SOL_SOCKET, SO_SNDBUF, *options.sendBuffer);
+        if(options.recvBuffer) setOption(fd, SOL_SOCKET, SO_RCVBUF, *options.recvBuffer);
+    #ifndef SO_WINDOWS
+        if(options.busyPoll) setOption(fd, SOL_SOCKET, SO_BUSY_POLL, *options.busyPoll);
+    #endif
+        if(!tcp) return;
+
+        if(options.noDelay) setOption(fd, IPPROTO_TCP, TCP_NODELAY, *options.noDelay);
+        if(options.keepAlive) setOption(fd, SOL_SOCKET, SO_KEEPALIVE, *options.keepAlive);
+    #ifndef SO_WINDOWS
+        if(options.cork) setOption(fd, IPPROTO_TCP, TCP_CORK, *options.cork);
+        if(options.quickAck) setOption(fd, IPPROTO_TCP, TCP_QUICKACK, *options.quickAck);
+        if(options.fastOpen) {
+            if(listening) setOption(fd, IPPROTO_TCP, TCP_FASTOPEN, *options.fastOpen);
+            else setOption(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, *options.fastOpen != 0);
+        }
+        if(options.keepAliveIdle) setOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, *options.keepAliveIdle);
+        if(options.keepAliveInterval) setOption(fd, IPPROTO_TCP, TCP_KEEPINTVL, *options.keepAliveInterval);
+        if(options.keepAliveCount) setOption(fd, IPPROTO_TCP, TCP_KEEPCNT, *options.keepAliveCount);
+    #endif
+    }
+
+    // Shuts down a direction of a connection. A peer that is already gone is not an error: there is nothing left to end.
+    inline void shutdownSocket(sock_t fd, int how) {
+        if(::shutdown(fd, how) == 0) return;
+    #ifdef SO_WINDOWS
+        if(WSAGetLastError() == WSAENOTCONN) return;
+    #else
+        if(errno == ENOTCONN) return;
+    #endif
+        detail::throwLastError("Error shutting down socket");
+    }
+
+    // Waits until the socket is readable (or writable). Returns false on timeout.
+    inline bool waitFor(sock_t fd, bool writable, int timeoutMs=-1) {
+    #ifdef SO_WINDOWS
+        WSAPOLLFD pfd = {fd, (short)(writable ? POLLWRNORM : POLLRDNORM), 0};
+        int ready = WSAPoll(&pfd, 1, timeoutMs);
+    #else
+        pollfd pfd = {fd, (short)(writable ? POLLOUT : POLLIN), 0};
+        int ready;
+        do { ready = ::poll(&pfd, 1, timeoutMs); } while(ready < 0 && errno == EINTR);
+    #endif
+        if(ready < 0) {
+            detail::throwLastError("Error waiting for socket");
+        }
+        return ready > 0;
+    }
+
+    // True if the last connect() call on a non-blocking socket is still in progress.
+    inline bool connectInProgress() {
+    #ifdef SO_WINDOWS
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+    #else
+        return errno == EINPROGRESS;
+    #endif
+    }
+
+    // Reads the result of a finished non-blocking connect. 0 means connected.
+    inline int connectResult(sock_t fd) {
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        if(getsockopt(fd, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&err), &errLen) < 0) return -1;
+        return err;
+    }
+
+    // Starts the platform networking stack, once per process: WSAStartup on Windows, cleaned up at exit. Nothing to do elsewhere.
+    inline void startNetworking() {
+    #ifdef SO_WINDOWS
+        struct Winsock {
+            int error;
+            Winsock() { WSADATA data; error = WSAStartup(MAKEWORD(2, 2), &data); }
+            ~Winsock() { if(error == 0) WSACleanup(); }
+        };
+        // Function-local: anything that started networking is destroyed before it, so WSACleanup runs last.
+        static Winsock winsock;
+        if(winsock.error != 0) {
+            throw std::system_error(winsock.error, std::system_category(), "WSAStartup failed");
+        }
+    #endif
+    }
+
+    // Resolves a host name or numeric ip to its addresses, in the order to try them.
+    // Numeric ips are parsed directly, with no lookup. Families are interleaved, as RFC 8305 asks.
+    inline std::vector<Address> resolve(const std::string& host, int port) {
+        if(std::optional<Address> numeric = Address::parse(host, port)) return {*numeric};
+
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_ADDRCONFIG;
+        addrinfo* found = nullptr;
+        startNetworking();
+        if(getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &found) != 0 || found == nullptr) {
+            throw std::runtime_error("Error resolving host");
+        }
+
+        // getaddrinfo sorts by preference: keep that order, alternating between the families.
+        std::vector<Address> first, second;
+        int preferred = found->ai_family;
+        for(addrinfo* ai = found; ai != nullptr; ai = ai->ai_next) {
+            (ai->ai_family == preferred ? first : second).emplace_back(ai->ai_addr, (socklen_t)ai->ai_addrlen);
+        }
+        freeaddrinfo(found);
+
+        std::vector<Address> addrs;
+        for(size_t i = 0; i < std::max(first.size(), second.size()); i++) {
+            if(i < first.size()) addrs.push_back(first[i]);
+            if(i < second.size()) addrs.push_back(second[i]);
+        }
+        return addrs;
+    }
+
+    // One send call. Returns the bytes sent, or WOULD_BLOCK. Throws on errors.
+    inline int trySend(sock_t fd, const char* data, size_t size, IoStats* stats=nullptr) {
+        int sent;
+        for(;;) {
+            sent = ::send(fd, data, size, NOSIGNAL);
+        #ifndef SO_WINDOWS
+            if(sent < 0 && errno == EINTR) continue;
+        #endif
+            break;
+        }
+        countSend(stats, sent, size);
+        if(sent < 0) {
+            if(wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error sending data");
+        }
+        return sent;
+    }
+
+    // One recv call. Returns the bytes received (0 if closed), or WOULD_BLOCK. Throws on errors.
+    inline int tryRecv(sock_t fd, char* buffer, size_t size, IoStats* stats=nullptr) {
+        int received;
+        for(;;) {
+            received = ::recv(fd, buffer, size, 0);
+        #ifndef SO_WINDOWS
+            if(received < 0 && errno == EINTR) continue;
+        #endif
+            break;
+        }
+        countRecv(stats, received);
+        if(received < 0) {
+            if(wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error receiving data");
+        }
+        return received;
+    }
+
+    // Fills `size` bytes, waiting for more data as needed. MSG_WAITALL lets a blocking socket do it in one call.
+    // Windows fails MSG_WAITALL on non-blocking sockets, and can't tell which ones are: it loops on short reads instead.
+    inline void recvExact(sock_t fd, char* buffer, size_t size, IoStats* stats=nullptr) {
+    #ifdef SO_WINDOWS
+        const int flags = 0;
+    #else
+        const int flags = MSG_WAITALL;
+    #endif
+        size_t total = 0;
+        while(total < size) {
+            int received = ::recv(fd, buffer + total, size - total, flags);
+            countRecv(stats, received);
+            if(received < 0) {
+                if(wouldBlock()) { waitFor(fd, false); continue; }
+            #ifndef SO_WINDOWS
+                if(errno == EINTR) continue;
+            #endif
+                detail::throwLastError("Error receiving data");
+            }
+            if(received == 0) {
+                throw std::runtime_error("Connection closed before all data was received");
+            }
+            total += received;
+        }
+    }
+
+    // Sends everything, resuming after short writes, and waiting for room on non-blocking sockets.
+    inline size_t sendAll(sock_t fd, const char* data, size_t size, IoStats* stats=nullptr) {
+        size_t total = 0;
+        while(total < size) {
+            int sent = trySend(fd, data + total, size - total, stats);
+            if(sent == WOULD_BLOCK) {
+                waitFor(fd, true);
+                continue;
+            }
+            total += sent;
+        }
+        return total;
+    }
+
+    // Sends `length` bytes of a file from `offset`, with no copy through user memory. A length of 0 sends up to the end of the file.
+    // Pipes are spliced instead, and other descriptors (ex: sockets) copied through a buffer, from their current position.
+    // Those can't be sent from an offset. Waits for room on non-blocking sockets.
+    inline size_t sendFile(sock_t fd, int fileFd, int64_t offset, size_t length, IoStats* stats=nullptr) {
+    #ifdef SO_WINDOWS
+        HANDLE file = (HANDLE)_get_osfhandle(fileFd);
+        if(file == INVALID_HANDLE_VALUE) {
+            detail::throwLastError("Error sending file");
+        }
+        if(length == 0) {
+            LARGE_INTEGER size;
+            if(!GetFileSizeEx(file, &size)) detail::throwLastError("Error sending file");
+            if(size.QuadPart <= offset) return 0;
+            length = (size_t)(size.QuadPart - offset);
+        }
+
+        size_t sent = 0;
+        while(sent < length) {
+            // TransmitFile takes at most 2^31 - 2 bytes per call.
+            DWORD chunk = (DWORD)std::min<size_t>(length - sent, 0x7FFFFFFE);
+            LARGE_INTEGER position;
+            position.QuadPart = offset + (int64_t)sent;
+            bool done = SetFilePointerEx(file, position, nullptr, FILE_BEGIN) && TransmitFile(fd, file, chunk, 0, nullptr, nullptr, 0);
+            countSend(stats, done ? (long)chunk : -1, chunk);
+            if(!done) {
+                if(wouldBlock()) { waitFor(fd, true); continue; }
+                detail::throwLastError("Error sending file");
+            }
+            sent += chunk;
+        }
+        return sent;
+    #else
+        struct stat info;
+        if(fstat(fileFd, &info) < 0) detail::throwLastError("Error sending file");
+        bool regular = S_ISREG(info.st_mode);
+        if(!regular && offset != 0) {
+            throw std::runtime_error("Can't send a pipe or socket from an offset");
+        }
+        if(length == 0) {
+            if(!regular) length = SIZE_MAX;  // A pipe or socket: until its end.
+            else if(info.st_size <= offset) return 0;
+            else length = (size_t)(info.st_size - offset);
+        }
+
+        // sendfile only reads from seekable, mmap-able files, splice takes pipes. The rest is copied.
+        enum { SendFile, Splice, Copy } method = regular ? SendFile : S_ISFIFO(info.st_mode) ? Splice : Copy;
+        std::unique_ptr<char[]> buffer;
+        const size_t bufferSize = size_t(1) << 16;
+        off_t position = offset;
+        size_t sent = 0;
+        while(sent < length) {
+            size_t chunk = std::min<size_t>(length - sent, size_t(1) << 30);
+            if(method == Copy) {
+                if(!buffer) buffer.reset(new char[bufferSize]);
+                chunk = std::min(chunk, bufferSize);
+                ssize_t n = regular ? ::pread(fileFd, buffer.get(), chunk, position) : ::read(fileFd, buffer.get(), chunk);
+                if(n < 0 && errno == EINTR) continue;
+                if(n < 0 && wouldBlock()) { waitFor(fileFd, false); continue; }
+                if(n < 0) detail::throwLastError("Error reading file");
+                if(n == 0) break;  // End of file.
+                sendAll(fd, buffer.get(), (size_t)n, stats);
+                position += n;
+                sent += n;
+                continue;
+            }
+
+            ssize_t n = method == Splice ? splice(fileFd, nullptr, fd, nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_MORE)
+                                         : ::sendfile(fd, fileFd, &position, chunk);
+            // A file system without sendfile support: copy instead. Only a probe, not counted as a failed send.
+            if(n < 0 && method == SendFile && errno == EINVAL && sent == 0) { method = Copy; continue; }
+            countSend(stats, (long)n, chunk);
+            if(n < 0) {
+                if(errno == EINTR) continue;
+                if(wouldBlock()) { waitFor(fd, true); continue; }
+                detail::throwLastError("Error sending file");
+            }
+            if(n == 0) break;  // End of file.
+            sent += n;
+        }
+        return sent;
+    #endif
+    }
+
+    // MSG_ZEROCOPY bookkeeping of a socket. The kernel numbers zero-copy sends from 0, and completes them in order on TCP.
+    struct ZeroCopyState {
+        bool enabled = false;
+        uint32_t sent = 0;       // Sends issued.
+        uint32_t completed = 0;  // Sends whose buffers the kernel is done with.
+        size_t copied = 0;       // Sends the kernel copied anyway, ex: over loopback.
+    };
+
+    // Reads the zero-copy completions queued on the socket error queue, without waiting. Returns how many were read.
+    inline size_t reapZeroCopy(sock_t fd, ZeroCopyState& state) {
+    #if defined(SO_WINDOWS) || !defined(MSG_ZEROCOPY)
+        (void)fd; (void)state;
+        return 0;
+    #else
+        size_t reaped = 0;
+        for(;;) {
+            char control[128];
+            msghdr msg{};
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            if(recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+                if(errno == EINTR) continue;
+                if(wouldBlock()) return reaped;
+                detail::throwLastError("Error reading zero-copy completions");
+            }
+
+            for(cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != nullptr; cm = CMSG_NXTHDR(&msg, cm)) {
+                bool isError = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                            || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+                if(!isError) continue;
+                sock_extended_err err;
+                std::memcpy(&err, CMSG_DATA(cm), sizeof(err));
+                if(err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+
+                // Sends ee_info to ee_data, inclusive, are complete.
+                uint32_t end = err.ee_data + 1;
+                if((int32_t)(end - state.completed) > 0) state.completed = end;
+                if(err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) state.copied += end - err.ee_info;
+                reaped++;
+            }
+        }
+    #endif
+    }
+
+    // Sends all the data with MSG_ZEROCOPY. Returns the number of the last send: the data must stay untouched until it completes.
+    inline uint32_t sendZeroCopy(sock_t fd, const char* data, size_t size, ZeroCopyState& state, IoStats* stats=nullptr) {
+    #if defined(SO_WINDOWS) || !defined(MSG_ZEROCOPY)
+        (void)fd; (void)data; (void)size; (void)state; (void)stats;
+        throw std::runtime_error("Zero-copy sends are not supported on this platform");
+    #else
+        if(!state.enabled) {
+            throw std::runtime_error("Zero-copy sends are not enabled, call enableZeroCopy() first");
+        }
+        size_t total = 0;
+        while(total < size) {
+            ssize_t sent = ::send(fd, data + total, size - total, MSG_ZEROCOPY | NOSIGNAL);
+            countSend(stats, (long)sent, size - total);
+            if(sent < 0) {
+                if(errno == EINTR) continue;
+                if(wouldBlock()) { waitFor(fd, true); continue; }
+                if(errno == ENOBUFS) {
+                    // Too much memory pinned by pending sends: wait for some to complete.
+                    if(reapZeroCopy(fd, state) == 0) { pollfd pfd = {fd, 0, 0}; ::poll(&pfd, 1, 1); }
+                    continue;
+                }
+                detail::throwLastError("Error sending data");
+            }
+            state.sent++;
+            total += sent;
+        }
+        return state.sent - 1;
+    #endif
+    }
+
+    // One gather send of up to MAX_IOV parts, skipping `offset` bytes of the first one.
+    // Returns the bytes sent, or WOULD_BLOCK. Throws on errors.
+    inline long trySendv(sock_t fd, const std::string_view* parts, size_t count, size_t offset=0, IoStats* stats=nullptr) {
+        if(count > MAX_IOV) count = MAX_IOV;
+        size_t requested = 0;
+    #ifdef SO_WINDOWS
+        WSABUF bufs[MAX_IOV];
+        for(size_t i = 0; i < count; i++) {
+            size_t skip = i == 0 ? offset : 0;
+            bufs[i].buf = const_cast<char*>(parts[i].data() + skip);
+            bufs[i].len = (ULONG)(parts[i].size() - skip);
+            requested += bufs[i].len;
+        }
+        DWORD sent = 0;
+        bool failed = WSASend(fd, bufs, (DWORD)count, &sent, 0, nullptr, nullptr) == SOCKET_ERROR;
+        countSend(stats, failed ? -1 : (long)sent, requested);
+        if(failed) {
+    #else
+        iovec bufs[MAX_IOV];
+        for(size_t i = 0; i < count; i++) {
+            size_t skip = i == 0 ? offset : 0;
+            bufs[i].iov_base = const_cast<char*>(parts[i].data() + skip);
+            bufs[i].iov_len = parts[i].size() - skip;
+            requested += bufs[i].iov_len;
+        }
+        msghdr msg{};
+        msg.msg_iov = bufs;
+        msg.msg_iovlen = count;
+        ssize_t sent;
+        do { sent = ::sendmsg(fd, &msg, NOSIGNAL); } while(sent < 0 && errno == EINTR);
+        countSend(stats, (long)sent, requested);
+        if(sent < 0) {
+    #endif
+            if(wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error sending data");
+        }
+        return (long)sent;
+    }
+
+    // Sends all parts, resuming mid-buffer after short writes.
+    inline size_t sendvAll(sock_t fd, const std::string_view* parts, size_t count, IoStats* stats=nullptr) {
+        size_t total = 0, offset = 0;
+        while(count > 0) {
+            // Skip parts that are done, including empty ones.
+            if(offset == parts->size()) { parts++; count--; offset = 0; continue; }
+
+            long sent = trySendv(fd, parts, count, offset, stats);
+            if(sent == WOULD_BLOCK) {
+                waitFor(fd, true);
+                continue;
+            }
+            total += sent;
+
+            size_t left = sent;
+            while(left > 0) {
+                size_t rest = parts->size() - offset;
+                if(left < rest) { offset += left; break; }
+                left -= rest;
+                parts++; count--; offset = 0;
+            }
+        }
+        return total;
+    }
+
+    // One scatter recv into up to MAX_IOV buffers. Returns the bytes received (0 if closed), or WOULD_BLOCK.
+    inline long tryRecvv(sock_t fd, const MutableBuffer* parts, size_t count, IoStats* stats=nullptr) {
+        if(count > MAX_IOV) count = MAX_IOV;
+    #ifdef SO_WINDOWS
+        WSABUF bufs[MAX_IOV];
+        for(size_t i = 0; i < count; i++) {
+            bufs[i].buf = static_cast<char*>(parts[i].data);
+            bufs[i].len = (ULONG)parts[i].size;
+        }
+        DWORD received = 0, flags = 0;
+        bool failed = WSARecv(fd, bufs, (DWORD)count, &received, &flags, nullptr, nullptr) == SOCKET_ERROR;
+        countRecv(stats, failed ? -1 : (long)received);
+        if(failed) {
+    #else
+        iovec bufs[MAX_IOV];
+        for(size_t i = 0; i < count; i++) {
+            bufs[i].iov_base = parts[i].data;
+            bufs[i].iov_len = parts[i].size;
+        }
+        msghdr msg{};
+        msg.msg_iov = bufs;
+        msg.msg_iovlen = count;
+        ssize_t received;
+        do { received = ::recvmsg(fd, &msg, 0); } while(received < 0 && errno == EINTR);
+        countRecv(stats, (long)received);
+        if(received < 0) {
+    #endif
+            if(wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error receiving data");
+        }
+        return (long)received;
+    }
+
+}
+
+class BufferPool;
+
+// PooledBuffer class.
+/**
+ *
+ * @brief ## `skt::PooledBuffer`
+ *
+ * @note - A chunk of memory borrowed from a `skt::BufferPool`. Goes back to the pool when destroyed, or on `release()`.
+ * @note - Move-only. `size()` is how much of it holds data, `capacity()` is the size of the chunk.
+ * @note - The pool must outlive its buffers.
+ * @note #### Examples:
+ * @note `skt::PooledBuffer msg = node.recvPooled();` - Receives into a pooled chunk, no per-connection buffer.
+ * @note `handle(msg.view());` - Reads the data in it. The chunk is returned when `msg` goes out of scope.
+ *
+ */
+class PooledBuffer {
+    BufferPool* pool = nullptr;
+    char* chunk = nullptr;
+    size_t length = 0, chunkSize = 0;
+
+public:
+    PooledBuffer() = default;
+    PooledBuffer(BufferPool* pool, char* chunk, size_t chunkSize) : pool(pool), chunk(chunk), chunkSize(chunkSize) {}
+
+    PooledBuffer(PooledBuffer&& other) noexcept
+        : pool(other.pool), chunk(other.chunk), length(other.length), chunkSize(other.chunkSize) {
+        other.chunk = nullptr;
+        other.length = 0;
+    }
+
+    PooledBuffer& operator=(PooledBuffer&& other) noexcept {
+        if(this != &other) {
+            release();
+            pool = other.pool;
+            chunk = other.chunk;
+            length = other.length;
+            chunkSize = other.chunkSize;
+            other.chunk = nullptr;
+            other.length = 0;
+        }
+        return *this;
+    }
+
+    ~PooledBuffer() { release(); }
+
+    // Gives the chunk back to the pool now. Defined after BufferPool.
+    inline void release();
+
+    char* data() { return chunk; }
+    const char* data() const { return chunk; }
+    size_t size() const { return length; }
+    size_t capacity() const { return chunkSize; }
+    bool empty() const { return length == 0; }
+    explicit operator bool() const { return chunk != nullptr; }
+
+    // Sets how many bytes hold data. Clamped to the capacity.
+    void resize(size_t size) { length = size < chunkSize ? size : chunkSize; }
+
+    std::string_view view() const { return std::string_view(chunk, length); }
+};
+
+// BufferPool class.
+/**
+ *
+ * @brief ## `skt::BufferPool`
+ *
+ * @param chunkSize   The size of every chunk, in bytes. If not set, fallback to 4096.
+ * @param slabChunks  How many chunks are allocated at once, when the pool runs dry. If not set, fallback to 64.
+ * @param threadCache How many free chunks each thread keeps for itself, before giving them back. If not set, fallback to 32.
+ *
+ * @note - A slab allocator of fixed-size receive buffers, shared by every connection.
+ * @note - Memory grows with the buffers in use at the same time, not with the number of connections: 100k idle nodes hold no buffer at all.
+ * @note - Each thread keeps a small cache of free chunks, so acquiring and releasing usually takes no lock.
+ * @note - Slabs are kept until the pool is destroyed, chunks are reused.
+ * @note #### Examples:
+ * @note `skt::BufferPool::global()` - The pool used by `recv()` when no buffer is given.
+ * @note `skt::PooledBuffer buf = pool.acquire();` - Borrows a chunk.
+ *
+ */
+class BufferPool {
+    struct State {
+        std::mutex mutex;
+        std::vector<char*> free;
+        std::vector<std::unique_ptr<char[]>> slabs;
+        size_t chunkSize, slabChunks, threadCache;
+        uint64_t id;
+    };
+
+    struct ThreadCache {
+        uint64_t id;
+        std::weak_ptr<State> state;
+        std::vector<char*> chunks;
+
+        ThreadCache(uint64_t id, std::weak_ptr<State> state) : id(id), state(std::move(state)) {}
+        ThreadCache(ThreadCache&&) = default;
+        ThreadCache& operator=(ThreadCache&&) = default;
+
+        ~ThreadCache() {
+            auto alive = state.lock();
+            if(!alive || chunks.empty()) return;
+            std::lock_guard<std::mutex> lock(alive->mutex);
+            alive->free.insert(alive->free.end(), chunks.begin(), chunks.end());
+        }
+    };
+
+    std::shared_ptr<State> state;
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> counter{0};
+        return ++counter;
+    }
+
+    ThreadCache& cache() {
+        thread_local std::vector<ThreadCache> caches;
+        for(auto& c : caches) {
+            if(c.id == state->id) return c;
+        }
+        // Drop caches of pools that are gone, before adding this one.
+        caches.erase(std::remove_if(caches.begin(), caches.end(),
+                     [](const ThreadCache& c) { return c.state.expired(); }), caches.end());
+        caches.emplace_back(state->id, state);
+        return caches.back();
+    }
+
+    // Moves up to half a thread cache of chunks from the shared list, allocating a slab if needed.
+    void refill(ThreadCache& c) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if(state->free.empty()) {
+            state->slabs.emplace_back(new char[state->chunkSize * state->slabChunks]);
+            char* slab = state->slabs.back().get();
+            for(size_t i = 0; i < state->slabChunks; i++) {
+                state->free.push_back(slab + i * state->chunkSize);
+            }
+        }
+        size_t take = std::min(state->free.size(), std::max<size_t>(1, state->threadCache / 2));
+        c.chunks.insert(c.chunks.end(), state->free.end() - take, state->free.end());
+        state->free.resize(state->free.size() - take);
+    }
+
+public:
+
+    BufferPool(size_t chunkSize=4096, size_t slabChunks=64, size_t threadCache=32) {
+        state = std::make_shared<State>();
+        state->chunkSize = chunkSize;
+        state->slabChunks = slabChunks > 0 ? slabChunks : 1;
+        state->threadCache = threadCache;
+        state->id = nextId();
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // Borrows a chunk.
+    /**
+     *
+     * @brief Borrows a free chunk, allocating a new slab if there is none.
+     *
+     * @returns A `skt::PooledBuffer` of `chunkSize()` capacity, and size 0.
+     *
+     */
+    PooledBuffer acquire() {
+        ThreadCache& c = cache();
+        if(c.chunks.empty()) refill(c);
+
+        char* chunk = c.chunks.back();
+        c.chunks.pop_back();
+        return PooledBuffer(this, chunk, state->chunkSize);
+    }
+
+    // Gives a chunk back. Called by `skt::PooledBuffer`, no need to call it directly.
+    void release(char* chunk) {
+        ThreadCache& c = cache();
+        c.chunks.push_back(chunk);
+        if(c.chunks.size() <= state->threadCache) return;
+
+        // Cache full: hand half of it back, so other threads can use it.
+        size_t give = c.chunks.size() / 2;
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->free.insert(state->free.end(), c.chunks.end() - give, c.chunks.end());
+        c.chunks.resize(c.chunks.size() - give);
+    }
+
+    size_t chunkSize() const {
+        return state->chunkSize;
+    }
+
+    // Returns the bytes allocated by the pool, in use or not.
+    size_t allocated() {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->slabs.size() * state->slabChunks * state->chunkSize;
+    }
+
+    // Returns the pool used when no buffer is given to `recv()`.
+    static BufferPool& global() {
+        return forSize(detail::RECV_SIZE);
+    }
+
+    // Returns a shared pool.
+    /**
+     *
+     * @brief Returns the process-wide pool whose chunks hold at least `size` bytes. Created on first use.
+     *
+     * @param size The minimum chunk size. Rounded up to a power of two, from 4096 up to 64 MB.
+     *
+     * @note Used by `recv()` when a receive size is set with `setRecvSize()`, or grows in adaptive mode.
+     *
+     */
+    static BufferPool& forSize(size_t size) {
+        const size_t classes = 15;  // 4 KB, 8 KB, ... 64 MB
+        static std::unique_ptr<BufferPool> pools[classes];
+        static std::once_flag once[classes];
+
+        size_t index = 0;
+        while(index + 1 < classes && (detail::RECV_SIZE << index) < size) index++;
+
+        std::call_once(once[index], [index] {
+            size_t chunk = detail::RECV_SIZE << index;
+            // Keep slabs and thread caches near 256 KB and 128 KB, so big classes stay cheap.
+            pools[index].reset(new BufferPool(chunk, std::max<size_t>(1, (256 << 10) / chunk),
+                                                     std::max<size_t>(2, (128 << 10) / chunk)));
+        });
+        return *pools[index];
+    }
+};
+
+inline void PooledBuffer::release() {
+    if(chunk == nullptr) return;
+    pool->release(chunk);
+    chunk = nullptr;
+    length = 0;
+}
+
+// Node class.
+/**
+ *
+ * @brief ## `skt::Node`
+ *
+ *
+ * @param sock_fd   The socket file descriptor of the node.
+ * @param ip        The ip of the node.
+ * @param port      The port of the node.
+ *
+ * @note - Used to store data about a client: socket file descriptor, ip, etc.
+ * @note - No parameters are required to create a node, but you will have to set them later.
+ * @note - The destructor will close the socket file descriptor, this behavior can be changed by passing true to the constructor.
+ * @note - Move-only: it owns its socket, so it can't be copied, but can be moved around cheaply. A moved-from node holds no socket.
+ * @note - Holds no receive buffer: `recv()` borrows one from `skt::BufferPool::global()` only while reading.
+ * @note #### Examples:
+ * @note `skt::Node node;` - Creates a node with no parameters.
+ * @note `skt::Node node(true);` - Creates a node with no parameters, but the destructor will not close the socket file descriptor.
+ * @note `skt::Node node(sock_fd, ip, port);` - Creates a node with the given parameters.
+ * @note `skt::Node node = sock.accept();` - Takes ownership of an accepted connection.
+ *
+ */
+class Node {
+    friend class Socket;
+
+    int port{};
+    detail::UniqueFd sock_fd;
+    std::string ip;     // Formatted from `address` on first use.
+    Address address;
+    bool nonBlocking = false;
+    detail::RecvSizer sizer;
+    detail::ZeroCopyState zeroCopy;
+    IoStats stats;
+
+public:
+
+    Node() = default;
+
+    Node(bool noCloseOnDestruct) {
+        sock_fd.setOwned(!noCloseOnDestruct);
+    }
+
+    Node(sock_t sock_fd, std::string ip, int port) {
+        this->sock_fd = detail::UniqueFd(sock_fd);
+        this->ip = ip;
+        this->port = port;
+    }
+
+    Node(Node&&) noexcept = default;
+    Node& operator=(Node&&) noexcept = default;
+
+    void setAddr() {
+        if(std::optional<Address> parsed = Address::parse(ip, port)) address = *parsed;
+    }
+
+    operator sock_t() const { return sock_fd; }
+
+    // Replaces the socket. The previous one is closed, unless the node was created with `noCloseOnDestruct`.
+    void setSock(sock_t sock_fd) {
+        this->sock_fd = detail::UniqueFd(sock_fd, this->sock_fd.isOwned());
+    }
+
+    // True if the node holds a socket.
+    bool isValid() const {
+        return sock_fd != INVALID_SOCKET;
+    }
+
+    // Shuts down a direction of the connection.
+    /**
+     *
+     * @brief ## Ends sending (the default), receiving, or both, without closing the socket.
+     *
+     * @param how `SHUT_WR`: the peer receives everything sent, then 0 bytes, a clean end of stream. `SHUT_RD` or `SHUT_RDWR` end receiving, or both.
+     *
+     * @throw `std::runtime_error()` if it can't be shut down. A peer that already left is not an error.
+     *
+     * @note Unlike closing with data still unread, which makes the kernel reset the connection, nothing sent is lost.
+     *
+     */
+    void shutdown(int how=SHUT_WR) {
+        detail::shutdownSocket(sock_fd, how);
+    }
+
+    // Closes the connection without losing data.
+    /**
+     *
+     * @brief ## Ends sending, reads and drops what the peer still sends until it closes too, then closes the socket.
+     *
+     * @param timeout How long to wait for the peer to close. If not set, fallback to 5s.
+     *
+     * @returns True if the peer closed in time, false if it was closed anyway, on timeout or error.
+     *
+     * @note Closing right away with data unread sends a reset, and the peer may lose the end of a response still in flight. Works on blocking and non-blocking nodes.
+     *
+     */
+    bool closeGracefully(std::chrono::milliseconds timeout=std::chrono::seconds(5)) {
+        if(!isValid()) return true;
+        bool clean = false;
+        try {
+            shutdown(SHUT_WR);
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            char buffer[4096];
+            for(;;) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if(left <= 0 || !detail::waitFor(sock_fd, false, (int)left)) break;
+                int received = detail::tryRecv(sock_fd, buffer, sizeof(buffer), &stats);
+                if(received == 0) { clean = true; break; }
+            }
+        } catch(const std::runtime_error&) {}
+        sock_fd.reset();
+        return clean;
+    }
+
+    // Closes the socket, if owned. Calling it again, or destroying the node afterwards, does nothing.
+    void close() {
+        if(sock_fd.reset() < 0)
+            detail::throwLastError("Error closing socket");
+    }
+
+    void setIp(std::string ip) {
+        this->ip = ip;
+    }
+
+    void setPort(int port) {
+        this->port = port;
+    }
+
+    void setAddrLen(size_t addrLen) {
+        *address.sizePtr() = addrLen;
+    }
+
+    // Replaces the peer address. The ip string is formatted again on the next `getIp()`.
+    void setAddress(const Address& address) {
+        this->address = address;
+        ip.clear();
+    }
+
+    sock_t getSock() {
+        return sock_fd;
+    }
+
+    // Returns the peer ip. For accepted nodes, it is only formatted on the first call.
+    std::string getIp() {
+        if(ip.empty() && address.family() != AF_UNSPEC) ip = address.ip();
+        return ip;
+    }
+
+    std::string getIpStr() {
+        return address.ip();
+    }
+
+    int getPort() {
+        return port;
+    }
+
+    // Returns the peer address. Only a `sockaddr_in` for IPv4 peers, use `getAddress()` for IPv6.
+    sockaddr_in* getAddr() {
+        return reinterpret_cast<sockaddr_in*>(address.data());
+    }
+
+    // Returns the peer address, of any family.
+    const Address& getAddress() const {
+        return address;
+    }
+
+    // Returns the I/O counters of this connection. The non-const one can be `reset()`, ex: per scrape interval.
+    const IoStats& getStats() const {
+        return stats;
+    }
+
+    IoStats& getStats() {
+        return stats;
+    }
+
+    socklen_t* getAddrLen() {
+        return address.sizePtr();
+    }
+
+    // Sets socket options.
+    /**
+     *
+     * @brief Applies the options that are set in `options`, ex: `node.setOptions(skt::SocketOptions::lowLatency());`
+     *
+     * @param options The options to change. Unset fields are left as they are.
+     *
+     * @throw `std::runtime_error()` if an option can't be set.
+     *
+     * @note `cork` can be toggled around a burst of writes: set true, send the pieces, set false to flush.
+     *
+     */
+    void setOptions(const SocketOptions& options) {
+        detail::applyOptions(sock_fd, options, false, !address.isUnix());
+    }
+
+    // Sets the non-blocking mode.
+    /**
+     *
+     * @brief In non-blocking mode, `trySend()` and `tryRecv()` return `skt::WOULD_BLOCK` instead of hanging.
+     *
+     * @param nonBlocking True to enable non-blocking mode, false to go back to blocking.
+     *
+     * @throw `std::runtime_error()` if the mode can't be changed.
+     *
+     * @note Nodes accepted from a non-blocking `skt::Socket` are already non-blocking.
+     *
+     */
+    void setNonBlocking(bool nonBlocking=true) {
+        detail::setNonBlocking(sock_fd, nonBlocking);
+        this->nonBlocking = nonBlocking;
+    }
+
+    bool isNonBlocking() {
+        return nonBlocking;
+    }
+
+    // Send data to the connected server.
+    /**
+     *
+     * @brief Every node is a client, so this method sends data to the server it is connected to.
+     *
+     * @param data The data to be sent. Anything convertible to `std::string_view`, it is not copied.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent.
+     *
+     * @note Sends all the data, even if the kernel takes it in parts. On a non-blocking node, waits for room when needed.
+     *
+     */
+    void send(std::string_view data) {
+        detail::sendAll(sock_fd, data.data(), data.size(), &stats);
+    }
+
+    // Sends data, without exceptions.
+    /**
+     *
+     * @brief Makes a single send call. Never throws, and never allocates.
+     *
+     * @param data The data to be sent.
+     *
+     * @returns The number of bytes sent, maybe less than `data.size()`. Or the error: `skt::isWouldBlock()` if a non-blocking node has no room.
+     *
+     */
+    Result<size_t> sendSome(std::string_view data) noexcept {
+        int sent = ::send(sock_fd, data.data(), data.size(), detail::NOSIGNAL);
+        detail::countSend(&stats, sent, data.size());
+        if(sent < 0) return detail::lastError();
+        return (size_t)sent;
+    }
+
+    // Receives data, without exceptions.
+    /**
+     *
+     * @brief Makes a single recv call into `buffer`. Never throws, and never allocates.
+     *
+     * @param buffer Where to store the data.
+     * @param size   The size of `buffer`.
+     *
+     * @returns The number of bytes received, 0 if the peer closed the connection. Or the error: `skt::isWouldBlock()` if a non-blocking node has no data.
+     *
+     */
+    Result<size_t> recvSome(void* buffer, size_t size) noexcept {
+        int received = ::recv(sock_fd, static_cast<char*>(buffer), size, 0);
+        detail::countRecv(&stats, received);
+        if(received < 0) return detail::lastError();
+        return (size_t)received;
+    }
+
+    // Tries to send data, without waiting.
+    /**
+     *
+     * @brief Makes a single send call. It may send only part of the data, check the returned value.
+     *
+     * @param data The data to be sent.
+     *
+     * @returns The number of bytes sent, or `skt::WOULD_BLOCK` if the node is non-blocking and has no room to send.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent.
+     *
+     */
+    int trySend(std::string_view data) {
+        return detail::trySend(sock_fd, data.data(), data.size(), &stats);
+    }
+
+    // Sends all data.
+    /**
+     *
+     * @brief Sends all the data, resuming after short writes. On a non-blocking node, waits for room when needed.
+     *
+     * @param data The data to be sent.
+     *
+     * @returns The number of bytes sent, always `data.size()`.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent.
+     *
+     */
+    size_t sendAll(std::string_view data) {
+        return detail::sendAll(sock_fd, data.data(), data.size(), &stats);
+    }
+
+    // Receives data from the connected server.
+    /**
+     *
+     * @brief As a client, this method receives data from the server, and stores it in the buffer.
+     *
+     * @param buffer[] The buffer to store the data, at least `getRecvSize()` bytes. If omitted, it will borrow one from a `skt::BufferPool`.
+     *
+     * @returns The data received, as a std::string. If the data bytes is 0, it will return an empty string.
+     *
+     * @throw `std::runtime_error()` if the data can't be received. Also if the node is non-blocking and there is no data, use `tryRecv()` for that.
+     *
+     */
+    std::string recv(char buffer[]=nullptr) {
+        size_t size = sizer.size;
+        PooledBuffer scratch;
+        if(buffer == nullptr) { scratch = BufferPool::forSize(size).acquire(); buffer = scratch.data(); }
+
+        int received = detail::tryRecv(sock_fd, buffer, size, &stats);
+        if(received == WOULD_BLOCK) {
+            detail::throwLastError("Error receiving data");
+        }
+        sizer.update(received);
+        std::string data = std::string(buffer, received);
+        if(received == 0) data = "";
+
+        return data;
+    }
+
+    // Tries to receive data, without waiting.
+    /**
+     *
+     * @brief Makes a single recv call, and stores what was received in `data`.
+     *
+     * @param data     Where to store the data received. Replaced, not appended.
+     * @param buffer[] The buffer to receive into. If omitted, it will borrow one from `skt::BufferPool::global()`.
+     *
+     * @returns The number of bytes received (0 if the peer closed the connection), or `skt::WOULD_BLOCK` if the node is non-blocking and there is no data.
+     *
+     * @throw `std::runtime_error()` if the data can't be received.
+     *
+     */
+    int tryRecv(std::string& data, char buffer[]=nullptr) {
+        size_t size = sizer.size;
+        PooledBuffer scratch;
+        if(buffer == nullptr) { scratch = BufferPool::forSize(size).acquire(); buffer = scratch.data(); }
+
+        int received = detail::tryRecv(sock_fd, buffer, size, &stats);
+        if(received >= 0) sizer.update(received);
+        if(received > 0) data.assign(buffer, received);
+        else data.clear();
+
+        return received;
+    }
+
+    // Receives data into a caller buffer.
+    /**
+     *
+     * @brief Receives directly into `buffer`, with no allocation and no copy.
+     *
+     * @param buffer Where to store the data.
+     * @param size   The size of the buffer. At most this many bytes are received.
+     *
+     * @returns The number of bytes received. 0 if the peer closed the connection.
+     *
+     * @throw `std::runtime_error()` if the data can't be received.
+     *
+     */
+    size_t recv(void* buffer, size_t size) {
+        int received = detail::tryRecv(sock_fd, static_cast<char*>(buffer), size, &stats);
+        if(received == WOULD_BLOCK) {
+            detail::throwLastError("Error receiving data");
+        }
+        return received;
+    }
+
+    // Receives data into a pooled buffer.
+    /**
+     *
+     * @brief Receives into a chunk borrowed from `pool`, and hands the chunk over: no copy, no per-connection buffer.
+     *
+     * @param pool The pool to borrow from. If omitted, the shared pool for the current receive size.
+     *
+     * @returns The filled `skt::PooledBuffer`. Empty if the peer closed the connection. The chunk goes back to the pool when it is destroyed.
+     *
+     * @throw `std::runtime_error()` if the data can't be received.
+     *
+     */
+    PooledBuffer recvPooled(BufferPool& pool) {
+        PooledBuffer buf = pool.acquire();
+        buf.resize(recv(buf.data(), std::min(buf.capacity(), sizer.size)));
+        sizer.update(buf.size());
+        return buf;
+    }
+
+    PooledBuffer recvPooled() {
+        return recvPooled(BufferPool::forSize(sizer.size));
+    }
+
+    // Receives exactly `size` bytes.
+    /**
+     *
+     * @brief Waits until `size` bytes arrived, and returns them. Reads straight into the result, in as few calls as possible.
+     *
+     * @param size The number of bytes to receive.
+     *
+     * @returns The `size` bytes received.
+     *
+     * @throw `std::runtime_error()` if the data can't be received, or the peer closes the connection first.
+     *
+     */
+    std::string recvExact(size_t size) {
+        std::string data(size, '\0');
+        detail::recvExact(sock_fd, &data[0], size, &stats);
+        return data;
+    }
+
+    // Receives exactly `size` bytes into `buffer`. See `recvExact(size_t)`.
+    void recvExact(void* buffer, size_t size) {
+        detail::recvExact(sock_fd, static_cast<char*>(buffer), size, &stats);
+    }
+
+    // Sets the receive size.
+    /**
+     *
+     * @brief Sets how many bytes `recv()` asks for per call. Turns off the adaptive mode.
+     *
+     * @param size The receive size. If not set, 4096. Capped at 64 MB.
+     *
+     * @warning A `buffer[]` given to `recv()` or `tryRecv()` must hold at least this many bytes.
+     *
+     */
+    void setRecvSize(size_t size) {
+        sizer.set(size);
+    }
+
+    size_t getRecvSize() {
+        return sizer.size;
+    }
+
+    // Enables the adaptive receive size.
+    /**
+     *
+     * @brief In adaptive mode, the receive size doubles when a read fills it, and halves after two small reads in a row.
+     *
+     * @param adaptive True to enable, false to keep the current size fixed.
+     * @param min      The smallest receive size. If not set, 4096.
+     * @param max      The largest receive size. If not set, 1 MB.
+     *
+     * @note Bulk transfers quickly move to large reads, while mostly idle connections stay small.
+     *
+     */
+    void setAdaptiveRecv(bool adaptive=true, size_t min=detail::RECV_SIZE, size_t max=size_t(1) << 20) {
+        sizer.setAdaptive(adaptive, min, max);
+    }
+
+    // Sends several buffers at once.
+    /**
+     *
+     * @brief Gather send: sends all `parts` in order, as if concatenated, with a single syscall when possible.
+     *
+     * @param parts The buffers to send, ex: `node.sendv({header, body, trailer});`. They are not copied.
+     *
+     * @returns The number of bytes sent, always the total size of the parts.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent.
+     *
+     * @note Short writes are resumed where they stopped, even in the middle of a part.
+     *
+     */
+    size_t sendv(std::initializer_list<std::string_view> parts) {
+        return detail::sendvAll(sock_fd, parts.begin(), parts.size(), &stats);
+    }
+
+    // Sends `count` buffers from an array. See `sendv(std::initializer_list<std::string_view>)`.
+    size_t sendv(const std::string_view* parts, size_t count) {
+        return detail::sendvAll(sock_fd, parts, count, &stats);
+    }
+
+    // Tries a single gather send, without waiting.
+    /**
+     *
+     * @brief Makes a single vectored send call. It may send only part of the data, check the returned value.
+     *
+     * @param parts The buffers to send.
+     * @param count The number of buffers.
+     *
+     * @returns The number of bytes sent, or `skt::WOULD_BLOCK` if the node is non-blocking and has no room to send.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent.
+     *
+     */
+    long trySendv(const std::string_view* parts, size_t count) {
+        return detail::trySendv(sock_fd, parts, count, 0, &stats);
+    }
+
+    // Receives into several buffers at once.
+    /**
+     *
+     * @brief Scatter receive: fills the buffers in order with a single syscall.
+     *
+     * @param parts The buffers to fill, ex: `node.recvv({{&header, sizeof(header)}, {body, bodySize}});`.
+     *
+     * @returns The number of bytes received, across all buffers. 0 if the peer closed the connection.
+     *
+     * @throw `std::runtime_error()` if the data can't be received.
+     *
+     * @note Like `recv()`, it may return less than the total size of the buffers.
+     *
+     */
+    size_t recvv(std::initializer_list<MutableBuffer> parts) {
+        return recvv(parts.begin(), parts.size());
+    }
+
+    // Receives into `count` buffers from an array. See `recvv(std::initializer_list<MutableBuffer>)`.
+    size_t recvv(const MutableBuffer* parts, size_t count) {
+        long received = detail::tryRecvv(sock_fd, parts, count, &stats);
+        if(received == WOULD_BLOCK) {
+            detail::throwLastError("Error receiving data");
+        }
+        return received;
+    }
+
+    // Sends a file.
+    /**
+     *
+     * @brief Sends a file straight from the page cache, with no copy through user memory (`sendfile` on Linux, `TransmitFile` on Windows).
+     *
+     * @param fileFd The file descriptor to read from, ex: from `open()`. On Linux, pipes are spliced and sockets copied, from their current position.
+     * @param offset Where to start in the file. Must be 0 for a pipe or a socket.
+     * @param length How many bytes to send. If 0, up to the end of the file.
+     *
+     * @returns The number of bytes sent. Less than `length` only if the file is shorter.
+     *
+     * @throw `std::runtime_error()` if the file can't be sent.
+     *
+     * @note The file position is not changed on Linux. On a non-blocking node, waits for room when needed.
+     *
+     */
+    size_t sendFile(int fileFd, int64_t offset=0, size_t length=0) {
+        return detail::sendFile(sock_fd, fileFd, offset, length, &stats);
+    }
+
+    // Enables zero-copy sends.
+    /**
+     *
+     * @brief Sets `SO_ZEROCOPY`, required before `sendZeroCopy()`. Linux 4.14+.
+     *
+     * @throw `std::runtime_error()` if the kernel or platform doesn't support it.
+     *
+     */
+    void enableZeroCopy() {
+    #if defined(SO_WINDOWS) || !defined(SO_ZEROCOPY)
+        throw std::runtime_error("Zero-copy sends are not supported on this platform");
+    #else
+        detail::setOption(sock_fd, SOL_SOCKET, SO_ZEROCOPY, 1);
+        zeroCopy.enabled = true;
+    #endif
+    }
+
+    // Sends data without copying it into the kernel.
+    /**
+     *
+     * @brief Sends all the data with `MSG_ZEROCOPY`: the kernel reads the pages in place, instead of copying them.
+     *
+     * @param data The data to be sent. It must stay alive and unchanged until `isZeroCopyDone()` is true for the returned id.
+     *
+     * @returns The id to wait for with `isZeroCopyDone()` or `waitZeroCopy()`.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent, or `enableZeroCopy()` was not called.
+     *
+     * @note Only worth it for large buffers (roughly 10KB and up): pinning pages and reading completions costs more than copying small ones.
+     * @note Over loopback the kernel copies anyway, see `zeroCopyFallbacks()`.
+     *
+     */
+    uint32_t sendZeroCopy(std::string_view data) {
+        return detail::sendZeroCopy(sock_fd, data.data(), data.size(), zeroCopy, &stats);
+    }
+
+    // Reads zero-copy completions, without waiting. Returns how many notifications were read.
+    size_t pollZeroCopy() {
+        return detail::reapZeroCopy(sock_fd, zeroCopy);
+    }
+
+    // True once the buffer given to the `sendZeroCopy()` call that returned `id` can be reused. Call `pollZeroCopy()` to update it.
+    bool isZeroCopyDone(uint32_t id) const {
+        return (int32_t)(zeroCopy.completed - id) > 0;
+    }
+
+    // Waits until the `sendZeroCopy()` call that returned `id` completes.
+    /**
+     *
+     * @brief Reads completions until the buffer of `id` can be reused.
+     *
+     * @param id        The id returned by `sendZeroCopy()`.
+     * @param timeoutMs How long to wait, in milliseconds. -1 waits forever.
+     *
+     * @returns False on timeout.
+     *
+     * @throw `std::runtime_error()` if the completions can't be read.
+     *
+     */
+    bool waitZeroCopy(uint32_t id, int timeoutMs=-1) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        while(!isZeroCopyDone(id)) {
+            if(detail::reapZeroCopy(sock_fd, zeroCopy) > 0) continue;
+            int waitMs = -1;
+            if(timeoutMs >= 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if(left <= 0) return false;
+                waitMs = (int)left;
+            }
+            // Completions raise POLLERR, which poll always reports.
+        #ifdef SO_WINDOWS
+            return false;
+        #else
+            pollfd pfd = {sock_fd, 0, 0};
+            if(::poll(&pfd, 1, waitMs) < 0 && errno != EINTR) {
+                detail::throwLastError("Error waiting for socket");
+            }
+        #endif
+        }
+        return true;
+    }
+
+    // Returns how many zero-copy sends the kernel copied anyway.
+    size_t zeroCopyFallbacks() const {
+        return zeroCopy.copied;
+    }
+
+    // Passes a file descriptor to the peer process.
+    /**
+     *
+     * @brief ## Sends a copy of `fd` to the process at the other end, with `data`, over a Unix domain socket (`SCM_RIGHTS`).
+     *
+     * @param fd   Any descriptor: a file, a pipe, a socket (ex: an accepted connection, to hand it to another process).
+     * @param data Sent along, at least one byte: the descriptor travels with it. If not set, a single '\0'.
+     *
+     * @throw `std::runtime_error()` if it can't be sent. Ex: not a Unix domain socket, or on Windows.
+     *
+     * @note The peer gets a new descriptor for the same open file. Closing `fd` here afterwards does not affect it.
+     *
+     */
+    void sendFd(int fd, std::string_view data=std::string_view()) {
+    #ifdef SO_WINDOWS
+        (void)fd; (void)data;
+        throw std::runtime_error("Passing file descriptors is not supported on this platform");
+    #else
+        if(data.empty()) data = std::string_view("\0", 1);
+        iovec iov = {const_cast<char*>(data.data()), data.size()};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+        msghdr h{};
+        h.msg_iov = &iov;
+        h.msg_iovlen = 1;
+        h.msg_control = control;
+        h.msg_controllen = sizeof(control);
+        cmsghdr* c = CMSG_FIRSTHDR(&h);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(c), &fd, sizeof(fd));
+
+        ssize_t sent;
+        do { sent = ::sendmsg(sock_fd, &h, MSG_NOSIGNAL); } while(sent < 0 && errno == EINTR);
+        detail::countSend(&stats, (long)sent, data.size());
+        if(sent < 0) {
+            detail::throwLastError("Error sending file descriptor");
+        }
+        // The descriptor went with the first byte: the rest is plain data.
+        if((size_t)sent < data.size()) detail::sendAll(sock_fd, data.data() + sent, data.size() - sent, &stats);
+    #endif
+    }
+
+    // Receives a file descriptor from the peer process.
+    /**
+     *
+     * @brief ## Receives data, and the descriptor sent with it by `sendFd()`.
+     *
+     * @param data Where to store the data received with it, if set. Up to the receive size.
+     *
+     * @returns The new descriptor, close-on-exec, owned by the caller. -1 if the data came with none.
+     *
+     * @throw `std::runtime_error()` if it can't be received, or the peer closed the connection.
+     *
+     * @note Call it when the descriptor is next: a stream read can also take data sent before or after it. Ex: make it the first message.
+     *
+     */
+    int recvFd(std::string* data=nullptr) {
+    #ifdef SO_WINDOWS
+        (void)data;
+        throw std::runtime_error("Passing file descriptors is not supported on this platform");
+    #else
+        PooledBuffer scratch = BufferPool::forSize(sizer.size).acquire();
+        iovec iov = {scratch.data(), std::min(scratch.capacity(), sizer.size)};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * 8)];
+        msghdr h{};
+        h.msg_iov = &iov;
+        h.msg_iovlen = 1;
+        h.msg_control = control;
+        h.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do { received = ::recvmsg(sock_fd, &h, MSG_CMSG_CLOEXEC); } while(received < 0 && errno == EINTR);
+        detail::countRecv(&stats, (long)received);
+        if(received < 0) {
+            detail::throwLastError("Error receiving file descriptor");
+        }
+
+        // Keeps the first descriptor. More than one can only come from another sender: closed, not leaked.
+        int fd = -1;
+        for(cmsghdr* c = CMSG_FIRSTHDR(&h); c != nullptr; c = CMSG_NXTHDR(&h, c)) {
+            if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for(size_t i = 0; i < count; i++) {
+                int passed;
+                std::memcpy(&passed, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                if(fd < 0) fd = passed;
+                else ::close(passed);
+            }
+        }
+        if(received == 0 && fd < 0) {
+            throw std::runtime_error("Connection closed before a file descriptor was received");
+        }
+        if(data) data->assign(scratch.data(), (size_t)received);
+        return fd;
+    #endif
+    }
+
+#ifdef SKT_HAS_SPAN
+    // Sends bytes. See `send(std::string_view)`.
+    void send(std::span<const std::byte> data) {
+        detail::sendAll(sock_fd, reinterpret_cast<const char*>(data.data()), data.size(), &stats);
+    }
+
+    // Receives into a span of bytes. See `recv(void*, size_t)`.
+    size_t recv(std::span<std::byte> buffer) {
+        return recv(buffer.data(), buffer.size());
+    }
+#endif
+
+};
+
+// Socket class.
+/**
+ *
+ * @brief ## `skt::Socket`
+ *
+ * @param port      The port that the socket will connect or bind. No default value, must be set.
+ * @param ip        The ip that the socket will be bind, or to connected to. If not set, fallback to 0.0.0.0 A client also takes a host name, ex: "example.com", resolved on construction.
+ *                  A server given an IPv6 address binds it, `ANY_ADDR6` ("::") being dual-stack: it takes IPv4 and IPv6 connections.
+ *                  "unix:/path" or "unix:@name" (abstract, Linux only) is a Unix domain socket instead, for processes on the same host. The port is ignored.
+ * @param isClient  Tell the socket if it is a client or not. If not set, fallback to false. Check note below.
+ * @param reuseAddr Tell the socket if it should reuse the address or not. If not set, fallback to true.
+ * @param queued    Tell the socket how many connections it should queue until droping requisitions. If not set, fallback to 10.
+ * @param nonBlocking Tell the socket if it should be non-blocking or not. If not set, fallback to false. Accepted nodes inherit it.
+ * @param reusePort Tell the socket to set `SO_REUSEPORT`, so several sockets can listen on the same port and share the connections. Linux only. If not set, fallback to false.
+ *
+ * @throw `std::runtime_error()` if the socket can't be created. Sometimes it can be fixed, so you should try to treat it. Ex: bad port.
+ * @throw Failed system calls throw `std::system_error`, a `std::runtime_error` whose `code()` is the error of the call. Ex: `std::errc::address_in_use`.
+ *
+ * @note If the socket is a client, the ip and port will be used to connect to the server.
+ *
+ * @note The socket is closed when destroyed, or by `close()`. It can be moved, but not copied.
+ *
+ * @note ##### As a Client:
+ * @note - If client, MUST call `connect()` or `connectRef()` to connect to a server. `client.connect()`
+ * @note - As a client, if connecting to localhost, `LOCALHOST` should be used instead of `ANY_ADDR` in windows.
+ * @note - A host name with several addresses is tried on all of them by `connect()`, fastest first. Use `connect(timeout)` against peers that may be down.
+ * @note ##### As a Server:
+ * @note - After a unexpected error, the socket may be in a `TIME_WAIT` state, and even with `SO_REUSEADDR`, it may not be able to bind to the same port. So, if your server can't bind to the same port after a crash, or a Ctrl + C, you should wait a few seconds before trying to bind again, or change port.
+ * @note #### Overloads:
+ * @note `skt::Socket sock(49110);` - Creates a server socket, listening on port 49110, binded to 0.0.0.0
+ * @note `skt::Socket sock(49110, true)` - Creates a client socket, connecting to 127.0.0.0 on port 49110.
+ * @note `skt::Socket sock(49110, LOCALHOST, true);` - Creates a client socket, connecting to localhost on port 49110.
+ * @note `skt::Socket sock(0, "unix:/run/app.sock");` - Creates a Unix domain server socket, replacing a socket file left by a previous run. Fails if a server still listens on it: that server sees the check as a connection closed at once.
+ * @note `skt::Socket sock(49110, ANY_ADDR, false, true, 10);` - Creates a server socket, listening on port 49110, with reuseAddr set to true, and queued set to 10.
+ * @note `skt::Socket sock(49110, ANY_ADDR, false, true, 10, true);` - Same as above, but non-blocking. Use with `skt::EventLoop` and the `try*()` methods.
+ * @note `skt::Socket sock(49110, ANY_ADDR, false, true, skt::MAX_BACKLOG, true, true);` - A non-blocking server socket sharing its port with `SO_REUSEPORT`. See `skt::Acceptor`.
+ *
+ *
+ */
+class Socket {
+    
+    detail::UniqueFd socket;
+    std::string ip;
+    Address addr;
+    bool reuseAddr;
+    bool reusePort = false;
+    int port{}, queued{};
+    bool isClient;
+    bool nonBlocking = false;
+    detail::RecvSizer sizer;
+    std::vector<Address> peers;  // Resolved server addresses, when a client is given a host name.
+    SocketOptions options;
+    IoStats stats;
+
+    sock_t createSocket(int family=AF_INET){
+        detail::startNetworking();
+        sock_t sock = ::socket(family, SOCK_STREAM | detail::CLOEXEC, 0);
+        if (sock == INVALID_SOCKET) {
+            detail::throwLastError("Error creating socket");
+        }
+        try {
+            detail::applyOptions(sock, options, !isClient, family != AF_UNIX);
+        } catch(...) {
+            detail::closeSocket(sock);
+            throw;
+        }
+        return sock;
+    }
+
+    void setAddr() {
+        if(isClient) {
+            // Host names resolve to every address, for connect() to race them. The first one is kept in addr.
+            peers = detail::resolve(ip, port);
+            addr = peers[0];
+            if(peers.size() == 1) peers.clear();
+        }
+        else {
+            // IPv4 servers listen on every interface, as they always did. IPv6 and Unix domain ones bind the given address.
+            std::optional<Address> parsed = Address::parse(ip, port);
+            if(parsed && (parsed->isV6() || parsed->isUnix())) addr = *parsed;
+            else addr = Address::any(AF_INET, port);
+        }
+    }
+
+    // Connects to the first server address that answers, starting a new attempt every `stagger`
+    // while the previous ones are still pending (RFC 8305, "happy eyeballs"). A negative timeout waits forever.
+    void raceConnect(std::chrono::milliseconds timeout, std::chrono::milliseconds stagger=std::chrono::milliseconds(250)) {
+        using Clock = std::chrono::steady_clock;
+        const std::vector<Address> single{addr};
+        const std::vector<Address>& targets = peers.empty() ? single : peers;
+        const bool forever = timeout.count() < 0;
+        const Clock::time_point deadline = Clock::now() + timeout;
+
+        struct Attempt { detail::UniqueFd fd; size_t target; };
+        std::vector<Attempt> pending;
+        size_t next = 0;
+        std::error_code failure = std::make_error_code(std::errc::connection_refused);
+
+        // Starts the next attempt. Returns false if there are no addresses left.
+        auto start = [&]() {
+            while(next < targets.size()) {
+                size_t target = next++;
+                // The first attempt reuses the socket from the constructor, if it is of the right family.
+                bool reuse = pending.empty() && socket != INVALID_SOCKET && target == 0 && targets[0].family() == addr.family();
+                detail::UniqueFd fd = reuse ? detail::UniqueFd(socket.release()) : detail::UniqueFd(createSocket(targets[target].family()));
+                detail::setNonBlocking(fd, true);
+                if(::connect(fd, targets[target].data(), targets[target].size()) == 0 || detail::connectInProgress()) {
+                    pending.push_back({std::move(fd), target});
+                    return true;
+                }
+                failure = detail::lastError();
+                detail::countConnect(&stats, false);
+            }
+            return false;
+        };
+
+        start();
+        Clock::time_point nextStart = Clock::now() + stagger;
+        while(!pending.empty()) {
+            Clock::time_point now = Clock::now();
+            if(!forever && now >= deadline) break;
+
+            Clock::time_point wake = next < targets.size() ? nextStart : Clock::time_point::max();
+            if(!forever) wake = std::min(wake, deadline);
+            int waitMs = wake == Clock::time_point::max() ? -1
+                : (int)std::max<long long>(0, std::chrono::duration_cast<std::chrono::milliseconds>(wake - now).count() + 1);
+
+        #ifdef SO_WINDOWS
+            std::vector<WSAPOLLFD> fds;
+            for(auto& a : pending) fds.push_back({a.fd, POLLWRNORM, 0});
+            int ready = WSAPoll(fds.data(), (ULONG)fds.size(), waitMs);
+        #else
+            std::vector<pollfd> fds;
+            for(auto& a : pending) fds.push_back({a.fd, POLLOUT, 0});
+            int ready = ::poll(fds.data(), fds.size(), waitMs);
+            if(ready < 0 && errno == EINTR) continue;
+        #endif
+            if(ready < 0) {
+                detail::throwLastError("Error waiting for socket");
+            }
+
+            bool failed = false;
+            for(size_t i = fds.size(); i-- > 0;) {
+                if(!fds[i].revents) continue;
+                int err = detail::connectResult(pending[i].fd);
+                detail::countConnect(&stats, err == 0);
+                if(err == 0) {
+                    // Winner: it becomes the socket, the other attempts are closed with `pending`.
+                    addr = targets[pending[i].target];
+                    socket = std::move(pending[i].fd);
+                    detail::setNonBlocking(socket, nonBlocking);
+                    return;
+                }
+                failure = std::error_code(err, std::system_category());
+                pending.erase(pending.begin() + i);
+                failed = true;
+            }
+
+            // A failed attempt hands over to the next address right away, otherwise the stagger does.
+            if(failed || (next < targets.size() && Clock::now() >= nextStart)) {
+                start();
+                nextStart = Clock::now() + stagger;
+            }
+        }
+
+        // Keep a usable descriptor for another try.
+        if(socket == INVALID_SOCKET) socket = createSocket(addr.family());
+        if(nonBlocking) detail::setNonBlocking(socket, true);
+        if(!forever && Clock::now() >= deadline) {
+            detail::countConnect(&stats, false);
+            throw std::system_error(std::make_error_code(std::errc::timed_out), "Connection timed out");
+        }
+        throw std::system_error(failure, "Error connecting to server");
+    }
+
+
+    void bindSocket() {
+        if(reuseAddr) {
+            int opt = 1;
+
+        #ifdef SO_WINDOWS
+            if (setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&opt), sizeof(opt)) < 0) 
+        #else
+            if (setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+        #endif
+                detail::throwLastError("Error setting socket options");
+        }
+
+        if(reusePort) {
+        #ifdef SO_WINDOWS
+            throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+        #else
+            int opt = 1;
+            if (setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+                detail::throwLastError("Error setting socket options");
+        #endif
+        }
+
+        if(addr.isV6()) {
+            // Dual-stack: an IPv6 socket also takes IPv4 connections, as IPv4-mapped addresses.
+            int off = 0;
+            setsockopt(socket, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&off), sizeof(off));
+        }
+
+    #ifndef SO_WINDOWS
+        // A socket file left by a previous run would make bind fail. Only socket files nobody listens on are removed, never regular ones, or a live server's.
+        std::string path = addr.path();
+        struct stat info;
+        if(!path.empty() && path[0] != '@' && stat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+            // Non-blocking, so a live server with a full backlog answers EAGAIN instead of making the probe wait.
+            detail::UniqueFd probe(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0));
+            if(probe != INVALID_SOCKET && ::connect(probe, addr.data(), addr.size()) < 0 && errno == ECONNREFUSED) unlink(path.c_str());
+        }
+    #endif
+
+        if(::bind(socket, addr.data(), addr.size()) < 0) {
+            detail::throwLastError("Error binding socket to IP/Port");
+        }
+    }
+
+    void listenSocket() {
+        if(::listen(socket, queued) < 0) {
+            detail::throwLastError("Error listening to socket");
+        }
+    }
+
+    // For `adopt()`, which fills it in from the descriptor.
+    Socket() : reuseAddr(true), isClient(false) {}
+
+public:
+    
+    Socket(int port, bool isClient){
+        this->ip = LOCALHOST;
+        this->port = port;
+        this->isClient = isClient;
+        this->reuseAddr = true;
+        this->queued = 10;
+        setAddr();
+        this->socket = createSocket(addr.family());
+
+        if(!isClient) {
+            bindSocket();
+            listenSocket();
+        }
+
+    }
+
+    Socket(int port, std::string ip=ANY_ADDR, bool isClient=false, bool reuseAddr=true, int queued=10, bool nonBlocking=false, bool reusePort=false){
+        this->ip = ip;
+        this->port = port;
+        this->isClient = isClient;
+        this->reuseAddr = reuseAddr;
+        this->reusePort = reusePort;
+        this->queued = queued;
+        setAddr();
+        this->socket = createSocket(addr.family());
+        if(nonBlocking) setNonBlocking(true);
+
+        if(!isClient){
+            bindSocket();
+            listenSocket();         
+        }
+    }
+
+    // Creates a socket with tuned options.
+    /**
+     *
+     * @brief Same as the constructor above, with `options` applied before bind/listen (server) or connect (client).
+     *
+     * @note Ex: `skt::Socket sock(49110, ANY_ADDR, false, skt::SocketOptions::lowLatency());`
+     *
+     */
+    Socket(int port, std::string ip, bool isClient, const SocketOptions& options, bool nonBlocking=false, int queued=10, bool reusePort=false){
+        this->ip = ip;
+        this->port = port;
+        this->isClient = isClient;
+        this->reuseAddr = true;
+        this->reusePort = reusePort;
+        this->queued = queued;
+        this->options = options;
+        setAddr();
+        this->socket = createSocket(addr.family());
+        if(nonBlocking) setNonBlocking(true);
+
+        if(!isClient){
+            bindSocket();
+            listenSocket();
+        }
+    }
+
+    // Takes string literals, like `ANY_ADDR6`: without it, `Socket(port, "::")` would pick the `bool isClient` overload.
+    Socket(int port, const char* ip, bool isClient=false, bool reuseAddr=true, int queued=10, bool nonBlocking=false, bool reusePort=false)
+        : Socket(port, std::string(ip), isClient, reuseAddr, queued, nonBlocking, reusePort) {}
+
+    Socket(Socket&&) noexcept = default;
+    Socket& operator=(Socket&&) noexcept = default;
+
+    // Accepts a new connection.
+    /**
+     * 
+     * @brief ## Accepts a new connection.
+     * 
+     * @note Hangs until a new connection is made.
+     * 
+     * @throw `std::runtime_error()` if the socket can't be accepted, or if it is a client socket.
+     * 
+     * @returns A `skt::Node` owning the new socket file descriptor, with its ip and port. See skt::Node class.
+     * 
+     * @note The node is returned by value, no heap allocation is made. Move it where it has to live: `skt::Node client = sock.accept();`
+     * 
+     */
+    Node accept() {
+        std::optional<Node> node = tryAccept();
+        if(!node) {
+            detail::throwLastError("Error accepting connection");
+        }
+        return std::move(*node);
+    }
+
+    // Tries to accept a new connection, without waiting.
+    /**
+     * 
+     * @brief ## Accepts a new connection, if there is one pending.
+     * 
+     * @note On a blocking socket, behaves like `accept()`. The new node inherits the non-blocking mode of the socket.
+     * 
+     * @throw `std::runtime_error()` if the socket can't be accepted, or if it is a client socket.
+     * 
+     * @returns The new `skt::Node`, or an empty optional if the socket is non-blocking and there are no pending connections.
+     * 
+     */
+    std::optional<Node> tryAccept() {
+        if(isClient) {
+            throw std::runtime_error("Can't accept connections on a client socket");
+        }
+
+        Result<Node> node = acceptSome();
+        if(node) return std::move(*node);
+        if(isWouldBlock(node.error())) return std::nullopt;
+        throw std::system_error(node.error(), "Error accepting connection");
+    }
+
+    // Accepts a new connection, without exceptions.
+    /**
+     * 
+     * @brief ## Accepts one pending connection. Never throws, and does no formatting or allocation.
+     * 
+     * @returns The new `skt::Node`, or the error: `skt::isWouldBlock()` if the socket is non-blocking and there are no pending connections.
+     * 
+     * @note A non-blocking server can accept in a loop until `isWouldBlock()`, with no exception on the steady-state path.
+     * 
+     */
+    Result<Node> acceptSome() noexcept {
+        Address peer;
+    #ifdef SO_WINDOWS
+        sock_t fd = ::accept(socket, peer.data(), peer.sizePtr());
+    #else
+        sock_t fd = ::accept4(socket, peer.data(), peer.sizePtr(), SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0));
+    #endif
+        detail::countAccept(&stats, fd != INVALID_SOCKET);
+        if(fd == INVALID_SOCKET) {
+            return detail::lastError();
+        }
+
+    #ifndef SO_WINDOWS
+        // The kernel copies most options from the listener, not these.
+        if(!addr.isUnix() && ((options.quickAck && !detail::trySetOption(fd, IPPROTO_TCP, TCP_QUICKACK, *options.quickAck))
+            || (options.cork && !detail::trySetOption(fd, IPPROTO_TCP, TCP_CORK, *options.cork)))) {
+            std::error_code error = detail::lastError();
+            detail::closeSocket(fd);
+            return error;
+        }
+    #endif
+
+        // The peer ip is not formatted here: `getIp()` does it, if it is ever called.
+        Node node(fd, std::string(), port);
+        node.address = peer;
+        node.nonBlocking = nonBlocking;
+        return node;
+    }
+
+    // Connects to a server.
+    /**
+     * 
+     * @brief ## Connects to a server.
+     * 
+     * @throw `std::runtime_error()` if the socket can't be connected, or it it is a server socket.
+     * 
+     * @returns A `skt::Node` for the connection, with the ip and port of the server. See skt::Node class.
+     * 
+     * @note The node shares the socket file descriptor, which stays owned by this socket: destroying the node does not close it.
+     * @warning IMPORTANT: on windows, as a client, if connecting to localhost, `ANY_ADDR` 0.0.0.0 will fail. Use `LOCALHOST` macro instead.
+     * 
+     */
+    Node connectRef(){
+        connect();
+
+        Node node(true);
+        node.setSock(socket);
+        node.setIp(ip);
+        node.setPort(port);
+        node.address = addr;
+        node.nonBlocking = nonBlocking;
+        return node;
+    }
+
+    // Connects to a server.
+    /**
+     * 
+     * @brief ## Connects to a server. 
+     * 
+     * @note Stores the socket file descriptor, ip and port in the socket object.
+     * 
+     * @throw `std::runtime_error()` if the socket can't be connected, or if it is a server socket.
+     * 
+     * @warning IMPORTANT: on windows, as a client, if connecting to localhost, `ANY_ADDR` 0.0.0.0 will fail. Use `LOCALHOST` macro instead.
+     * 
+     * @note Hangs until connected, or refused. With a dead peer, that can take minutes: use `connect(timeout)` to bound it.
+     * 
+     */
+    void connect(){
+        if(!isClient) {
+            throw std::runtime_error("Can't connect on a server socket");
+        }
+        if(!peers.empty()) {
+            raceConnect(std::chrono::milliseconds(-1));
+            return;
+        }
+
+        if(::connect(socket, addr.data(), addr.size()) < 0) {
+            if(!nonBlocking || !detail::connectInProgress()) {
+                detail::countConnect(&stats, false);
+                detail::throwLastError("Error connecting to server");
+            }
+
+            // Non-blocking connect: wait for the handshake, then check how it went.
+            detail::waitFor(socket, true);
+            if(int err = detail::connectResult(socket)) {
+                detail::countConnect(&stats, false);
+                throw std::system_error(std::error_code(err, std::system_category()), "Error connecting to server");
+            }
+        }
+        detail::countConnect(&stats, true);
+    }
+
+    // Connects to a server, with a deadline.
+    /**
+     * 
+     * @brief ## Connects to a server, giving up after `timeout`.
+     * 
+     * @param timeout How long to wait for the connection, in total. 0 (or less) sets no deadline: waits until the OS gives up, like `connect()`.
+     * 
+     * @throw `std::runtime_error()` if the socket can't be connected in time, or if it is a server socket.
+     * 
+     * @note If the host resolved to several addresses, they are raced: a new attempt starts every 250ms while the previous ones are pending,
+     * @note or right away when one fails. The first to connect wins, the others are closed.
+     * @note After a failure, the socket can be connected again.
+     * 
+     */
+    void connect(std::chrono::milliseconds timeout) {
+        if(!isClient) {
+            throw std::runtime_error("Can't connect on a server socket");
+        }
+        // A deadline of now would give up before the first attempt was even waited for.
+        raceConnect(timeout.count() > 0 ? timeout : std::chrono::milliseconds(-1));
+    }
+
+    // Sets socket options.
+    /**
+     * 
+     * @brief ## Applies the options that are set in `options`, now.
+     * 
+     * @param options The options to change. Unset fields are left as they are.
+     * 
+     * @throw `std::runtime_error()` if an option can't be set.
+     * 
+     * @note On a server, connections accepted afterwards get them too. Buffer sizes set after listen/connect don't resize the TCP window scale.
+     * 
+     */
+    void setOptions(const SocketOptions& options) {
+        detail::applyOptions(socket, options, !isClient, !addr.isUnix());
+        this->options.merge(options);
+    }
+
+    // Returns the options set on the socket, by the constructor or `setOptions()`.
+    const SocketOptions& getOptions() const {
+        return options;
+    }
+
+    // Sets the non-blocking mode.
+    /**
+     * 
+     * @brief ## Sets the non-blocking mode of the socket.
+     * 
+     * @param nonBlocking True to enable non-blocking mode, false to go back to blocking.
+     * 
+     * @throw `std::runtime_error()` if the mode can't be changed.
+     * 
+     * @note Connections accepted afterwards inherit the mode. `connect()` still waits for the connection to be made.
+     * 
+     */
+    void setNonBlocking(bool nonBlocking=true) {
+        detail::setNonBlocking(socket, nonBlocking);
+        this->nonBlocking = nonBlocking;
+    }
+
+    bool isNonBlocking() {
+        return nonBlocking;
+    }
+
+    // Sends data to the socket.
+    /**
+     * 
+     * @brief ## Sends data to a socket.
+     * 
+     * @param data The data to be sent. Anything convertible to `std::string_view`, it is not copied.
+     * @param socket The socket to send the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent, always `data.size()`.
+     * 
+     * @throw `std::runtime_error()` if the data can't be sent.
+     * 
+     * @note Sends all the data, even if the kernel takes it in parts. On a non-blocking socket, waits for room when needed.
+     * 
+     */
+    int send(std::string_view data, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+        return (int)detail::sendAll(socket, data.data(), data.size(), &stats);
+    }
+
+    // Receives data from the socket.
+    /**
+     * 
+     * @brief ## Receives data from a socket.
+     * 
+     * 
+     * @param socket The socket to receive the data. If a client, it can be omitted.
+     * @param buffer[] The buffer to store the data. If omitted, it will borrow one from `skt::BufferPool::global()`.
+     * 
+     * @return The data received. If the data bytes is 0, it will return an empty string.
+     * 
+     * @throw `std::runtime_error()` if the data can't be received.
+     * 
+     * @note Hangs until data is received.
+     */
+    std::string recv(sock_t socket=INVALID_SOCKET, char buffer[]=nullptr) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+        size_t size = sizer.size;
+        PooledBuffer scratch;
+        if(buffer == nullptr) { scratch = BufferPool::forSize(size).acquire(); buffer = scratch.data(); }
+
+        int received = detail::tryRecv(socket, buffer, size, &stats);
+        if(received == WOULD_BLOCK) {
+            detail::throwLastError("Error receiving data");
+        }
+        sizer.update(received);
+        if(received == 0) return "";
+
+        return std::string(buffer, received);
+    }
+
+    // Sends data, without exceptions.
+    /**
+     * 
+     * @brief ## Makes a single send call. Never throws, and never allocates.
+     * 
+     * @param data The data to be sent.
+     * @param socket The socket to send the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent, maybe less than `data.size()`. Or the error: `skt::isWouldBlock()` if a non-blocking socket has no room.
+     * 
+     */
+    Result<size_t> sendSome(std::string_view data, sock_t socket=INVALID_SOCKET) noexcept {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        int sent = ::send(socket, data.data(), data.size(), detail::NOSIGNAL);
+        detail::countSend(&stats, sent, data.size());
+        if(sent < 0) return detail::lastError();
+        return (size_t)sent;
+    }
+
+    // Receives data, without exceptions.
+    /**
+     * 
+     * @brief ## Makes a single recv call into `buffer`. Never throws, and never allocates.
+     * 
+     * @param buffer Where to store the data.
+     * @param size   The size of `buffer`.
+     * @param socket The socket to receive from. If a client, it can be omitted.
+     * 
+     * @return The number of bytes received, 0 if the peer closed the connection. Or the error: `skt::isWouldBlock()` if a non-blocking socket has no data.
+     * 
+     */
+    Result<size_t> recvSome(void* buffer, size_t size, sock_t socket=INVALID_SOCKET) noexcept {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        int received = ::recv(socket, static_cast<char*>(buffer), size, 0);
+        detail::countRecv(&stats, received);
+        if(received < 0) return detail::lastError();
+        return (size_t)received;
+    }
+
+    // Tries to send data, without waiting.
+    /**
+     * 
+     * @brief ## Makes a single send call. It may send only part of the data, check the returned value.
+     * 
+     * @param data The data to be sent.
+     * @param socket The socket to send the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent, or `skt::WOULD_BLOCK` if the socket is non-blocking and has no room to send.
+     * 
+     * @throw `std::runtime_error()` if the data can't be sent.
+     * 
+     */
+    int trySend(std::string_view data, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        return detail::trySend(socket, data.data(), data.size(), &stats);
+    }
+
+    // Sends all data.
+    /**
+     * 
+     * @brief ## Sends all the data, resuming after short writes.
+     * 
+     * @param data The data to be sent.
+     * @param socket The socket to send the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent, always `data.size()`.
+     * 
+     * @throw `std::runtime_error()` if the data can't be sent.
+     * 
+     * @note On a non-blocking socket, waits for room when needed.
+     */
+    size_t sendAll(std::string_view data, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        return detail::sendAll(socket, data.data(), data.size(), &stats);
+    }
+
+    // Tries to receive data, without waiting.
+    /**
+     * 
+     * @brief ## Makes a single recv call, and stores what was received in `data`.
+     * 
+     * @param data Where to store the data received. Replaced, not appended.
+     * @param socket The socket to receive the data. If a client, it can be omitted.
+     * @param buffer[] The buffer to receive into. If omitted, it will borrow one from `skt::BufferPool::global()`.
+     * 
+     * @return The number of bytes received (0 if the peer closed the connection), or `skt::WOULD_BLOCK` if the socket is non-blocking and there is no data.
+     * 
+     * @throw `std::runtime_error()` if the data can't be received.
+     * 
+     */
+    int tryRecv(std::string& data, sock_t socket=INVALID_SOCKET, char buffer[]=nullptr) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+        size_t size = sizer.size;
+        PooledBuffer scratch;
+        if(buffer == nullptr) { scratch = BufferPool::forSize(size).acquire(); buffer = scratch.data(); }
+
+        int received = detail::tryRecv(socket, buffer, size, &stats);
+        if(received >= 0) sizer.update(received);
+        if(received > 0) data.assign(buffer, received);
+        else data.clear();
+
+        return received;
+    }
+
+    // Receives data into a caller buffer.
+    /**
+     * 
+     * @brief ## Receives directly into `buffer`, with no allocation and no copy.
+     * 
+     * @param buffer Where to store the data.
+     * @param size The size of the buffer. At most this many bytes are received.
+     * @param socket The socket to receive the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes received. 0 if the peer closed the connection.
+     * 
+     * @throw `std::runtime_error()` if the data can't be received.
+     * 
+     * @note Hangs until data is received.
+     */
+    size_t recv(void* buffer, size_t size, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        int received = detail::tryRecv(socket, static_cast<char*>(buffer), size, &stats);
+        if(received == WOULD_BLOCK) {
+            detail::throwLastError("Error receiving data");
+        }
+        return received;
+    }
+
+    // Receives data into a pooled buffer.
+    /**
+     * 
+     * @brief ## Receives into a chunk borrowed from `pool`, and hands the chunk over: no copy, no per-socket buffer.
+     * 
+     * @param socket The socket to receive the data. If a client, it can be omitted.
+     * @param pool The pool to borrow from. If omitted, the shared pool for the current receive size.
+     * 
+     * @return The filled `skt::PooledBuffer`. Empty if the peer closed the connection. The chunk goes back to the pool when it is destroyed.
+     * 
+     * @throw `std::runtime_error()` if the data can't be received.
+     * 
+     */
+    PooledBuffer recvPooled(sock_t socket, BufferPool& pool) {
+        PooledBuffer buf = pool.acquire();
+        buf.resize(recv(buf.data(), std::min(buf.capacity(), sizer.size), socket));
+        sizer.update(buf.size());
+        return buf;
+    }
+
+    PooledBuffer recvPooled(sock_t socket=INVALID_SOCKET) {
+        return recvPooled(socket, BufferPool::forSize(sizer.size));
+    }
+
+    // Receives exactly `size` bytes.
+    /**
+     * 
+     * @brief ## Waits until `size` bytes arrived, and returns them. Reads straight into the result, in as few calls as possible.
+     * 
+     * @param size The number of bytes to receive.
+     * @param socket The socket to receive the data. If a client, it can be omitted.
+     * 
+     * @return The `size` bytes received.
+     * 
+     * @throw `std::runtime_error()` if the data can't be received, or the peer closes the connection first.
+     * 
+     */
+    std::string recvExact(size_t size, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        std::string data(size, '\0');
+        detail::recvExact(socket, &data[0], size, &stats);
+        return data;
+    }
+
+    // Receives exactly `size` bytes into `buffer`. See `recvExact(size_t, sock_t)`.
+    void recvExact(void* buffer, size_t size, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        detail::recvExact(socket, static_cast<char*>(buffer), size, &stats);
+    }
+
+    // Sets the receive size.
+    /**
+     * 
+     * @brief ## Sets how many bytes `recv()` asks for per call. Turns off the adaptive mode.
+     * 
+     * @param size The receive size. If not set, 4096. Capped at 64 MB.
+     * 
+     * @warning A `buffer[]` given to `recv()` or `tryRecv()` must hold at least this many bytes.
+     * 
+     */
+    void setRecvSize(size_t size) {
+        sizer.set(size);
+    }
+
+    size_t getRecvSize() {
+        return sizer.size;
+    }
+
+    // Enables the adaptive receive size.
+    /**
+     * 
+     * @brief ## In adaptive mode, the receive size doubles when a read fills it, and halves after two small reads in a row.
+     * 
+     * @param adaptive True to enable, false to keep the current size fixed.
+     * @param min The smallest receive size. If not set, 4096.
+     * @param max The largest receive size. If not set, 1 MB.
+     * 
+     */
+    void setAdaptiveRecv(bool adaptive=true, size_t min=detail::RECV_SIZE, size_t max=size_t(1) << 20) {
+        sizer.setAdaptive(adaptive, min, max);
+    }
+
+    // Sends several buffers at once.
+    /**
+     * 
+     * @brief ## Gather send: sends all `parts` in order, as if concatenated, with a single syscall when possible.
+     * 
+     * @param parts The buffers to send, ex: `sock.sendv({header, body, trailer}, client);`. They are not copied.
+     * @param socket The socket to send the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent, always the total size of the parts.
+     * 
+     * @throw `std::runtime_error()` if the data can't be sent.
+     * 
+     * @note Short writes are resumed where they stopped, even in the middle of a part.
+     */
+    size_t sendv(std::initializer_list<std::string_view> parts, sock_t socket=INVALID_SOCKET) {
+        return sendv(parts.begin(), parts.size(), socket);
+    }
+
+    // Sends `count` buffers from an array. See `sendv(std::initializer_list<std::string_view>, sock_t)`.
+    size_t sendv(const std::string_view* parts, size_t count, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        return detail::sendvAll(socket, parts, count, &stats);
+    }
+
+    // Tries a single gather send, without waiting.
+    /**
+     * 
+     * @brief ## Makes a single vectored send call. It may send only part of the data, check the returned value.
+     * 
+     * @param parts The buffers to send.
+     * @param count The number of buffers.
+     * @param socket The socket to send the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent, or `skt::WOULD_BLOCK` if the socket is non-blocking and has no room to send.
+     * 
+     * @throw `std::runtime_error()` if the data can't be sent.
+     * 
+     */
+    long trySendv(const std::string_view* parts, size_t count, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        return detail::trySendv(socket, parts, count, 0, &stats);
+    }
+
+    // Receives into several buffers at once.
+    /**
+     * 
+     * @brief ## Scatter receive: fills the buffers in order with a single syscall.
+     * 
+     * @param parts The buffers to fill, ex: `sock.recvv({{&header, sizeof(header)}, {body, bodySize}}, client);`.
+     * @param socket The socket to receive the data. If a client, it can be omitted.
+     * 
+     * @return The number of bytes received, across all buffers. 0 if the peer closed the connection.
+     * 
+     * @throw `std::runtime_error()` if the data can't be received.
+     * 
+     * @note Like `recv()`, it may return less than the total size of the buffers.
+     */
+    size_t recvv(std::initializer_list<MutableBuffer> parts, sock_t socket=INVALID_SOCKET) {
+        return recvv(parts.begin(), parts.size(), socket);
+    }
+
+    // Receives into `count` buffers from an array. See `recvv(std::initializer_list<MutableBuffer>, sock_t)`.
+    size_t recvv(const MutableBuffer* parts, size_t count, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        long received = detail::tryRecvv(socket, parts, count, &stats);
+        if(received == WOULD_BLOCK) {
+            detail::throwLastError("Error receiving data");
+        }
+        return received;
+    }
+
+    // Sends a file.
+    /**
+     * 
+     * @brief ## Sends a file straight from the page cache, with no copy through user memory (`sendfile` on Linux, `TransmitFile` on Windows).
+     * 
+     * @param fileFd The file descriptor to read from, ex: from `open()`. On Linux, pipes are spliced and sockets copied, from their current position.
+     * @param offset Where to start in the file. Must be 0 for a pipe or a socket.
+     * @param length How many bytes to send. If 0, up to the end of the file.
+     * @param socket The socket to send the file. If a client, it can be omitted.
+     * 
+     * @return The number of bytes sent. Less than `length` only if the file is shorter.
+     * 
+     * @throw `std::runtime_error()` if the file can't be sent.
+     * 
+     * @note For `MSG_ZEROCOPY` sends of user buffers, see `skt::Node::sendZeroCopy()`.
+     */
+    size_t sendFile(int fileFd, int64_t offset=0, size_t length=0, sock_t socket=INVALID_SOCKET) {
+        if(socket == INVALID_SOCKET) { socket = this->socket; }
+
+        return detail::sendFile(socket, fileFd, offset, length, &stats);
+    }
+
+#ifdef SKT_HAS_SPAN
+    // Sends bytes. See `send(std::string_view, sock_t)`.
+    int send(std::span<const std::byte> data, sock_t socket=INVALID_SOCKET) {
+        return send(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()), socket);
+    }
+
+    // Receives into a span of bytes. See `recv(void*, size_t, sock_t)`.
+    size_t recv(std::span<std::byte> buffer, sock_t socket=INVALID_SOCKET) {
+        return recv(buffer.data(), buffer.size(), socket);
+    }
+#endif
+
+    // Closes the socket.
+    /**
+     * 
+     * @brief ## Closes the socket.
+     * 
+     * @throw `std::runtime_error()` if the socket can't be closed.
+     * 
+     * @note Calling it again, or destroying the socket afterwards, does nothing.
+     * 
+     */
+    void close() {
+        if(socket.reset() < 0)
+            detail::throwLastError("Error closing socket");
+    }
+
+    // Returns the socket file descriptor.
+    sock_t getSocket() {
+        return socket;
+    }
+
+    // Shuts down a direction of a client connection. See `skt::Node::shutdown()`.
+    void shutdown(int how=SHUT_WR) {
+        detail::shutdownSocket(socket, how);
+    }
+
+    // Gives up the socket file descriptor, without closing it. The socket is left empty. Ex: to pass a listener on, with `adopt()`.
+    sock_t release() {
+        return socket.release();
+    }
+
+    // Sets whether processes started from now on inherit the socket. Created sockets are not inherited, by default.
+    void setInheritable(bool inheritable=true) {
+    #ifdef SO_WINDOWS
+        if(!SetHandleInformation((HANDLE)socket, HANDLE_FLAG_INHERIT, inheritable ? HANDLE_FLAG_INHERIT : 0))
+            throw std::system_error((int)GetLastError(), std::system_category(), "Error setting socket inheritance");
+    #else
+        int flags = fcntl(socket, F_GETFD);
+        if(flags < 0 || fcntl(socket, F_SETFD, inheritable ? (flags & ~FD_CLOEXEC) : (flags | FD_CLOEXEC)) < 0)
+            detail::throwLastError("Error setting socket inheritance");
+    #endif
+    }
+
+    // Hands the listening socket to the next process.
+    /**
+     *
+     * @brief ## Lets the processes started from now on inherit the socket, and names it in the environment variable `name`, for their `inherit()`.
+     *
+     * @param name The variable. If not set, fallback to "SKT_LISTEN_FD".
+     *
+     * @throw `std::runtime_error()` if the socket can't be made inheritable.
+     *
+     * @note Zero-downtime restart: `handOff()`, start the new version (fork and exec, or CreateProcess with inherited handles), then `skt::Server::drain()`.
+     * @note Both processes share one accept queue: connections waiting in it are not lost, the new process accepts them. Then close it here.
+     *
+     */
+    void handOff(const char* name="SKT_LISTEN_FD") {
+        setInheritable(true);
+        std::string fd = std::to_string((long long)(sock_t)socket);
+    #ifdef SO_WINDOWS
+        _putenv_s(name, fd.c_str());
+    #else
+        setenv(name, fd.c_str(), 1);
+    #endif
+    }
+
+    // Takes over an open socket.
+    /**
+     *
+     * @brief ## Makes a `skt::Socket` of an open descriptor: a listening socket (a server) or a connected one (a client).
+     *
+     * @param fd The descriptor. Owned by the socket from now on. Its address, port and mode are read from the system.
+     *
+     * @throw `std::runtime_error()` if `fd` is not a stream socket. It is not closed then.
+     *
+     * @note The descriptor is made close-on-exec again, so it is not handed further by accident.
+     *
+     */
+    static Socket adopt(sock_t fd) {
+        int type = 0, listening = 0;
+        socklen_t length = sizeof(type);
+        if(getsockopt(fd, SOL_SOCKET, SO_TYPE, reinterpret_cast<char*>(&type), &length) < 0) {
+            detail::throwLastError("Error adopting socket");
+        }
+        if(type != SOCK_STREAM) {
+            throw std::runtime_error("Error adopting socket: not a stream socket");
+        }
+        length = sizeof(listening);
+        getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, reinterpret_cast<char*>(&listening), &length);
+
+        Socket sock;
+        sock.isClient = !listening;
+        sock.queued = MAX_BACKLOG;
+        // A server's own address, a client's peer.
+        if(listening) getsockname(fd, sock.addr.data(), sock.addr.sizePtr());
+        else getpeername(fd, sock.addr.data(), sock.addr.sizePtr());
+        sock.port = sock.addr.port();
+        sock.ip = sock.addr.ip();
+        sock.socket = detail::UniqueFd(fd);
+    #ifndef SO_WINDOWS
+        int flags = fcntl(fd, F_GETFL, 0);
+        sock.nonBlocking = flags >= 0 && (flags & O_NONBLOCK);
+    #endif
+        sock.setInheritable(false);
+        return sock;
+    }
+
+    // Takes over the socket handed down by the previous process.
+    /**
+     *
+     * @brief ## Adopts the listening socket named by the environment variable `name` (see `handOff()`), or passed by systemd socket activation.
+     *
+     * @param name The variable. If not set, fallback to "SKT_LISTEN_FD".
+     *
+     * @returns The socket, or an empty optional if none was handed down: then create one as usual.
+     *
+     * @throw `std::runtime_error()` if the variable names something that is not a stream socket.
+     *
+     * @note The variables are removed once read, like `sd_listen_fds(1)` does: children started afterwards don't take the socket for theirs.
+     * @note `skt::Socket sock = skt::Socket::inherit().value_or(skt::Socket(49110));` - Works for both a first start and a restart.
+     *
+     */
+    static std::optional<Socket> inherit(const char* name="SKT_LISTEN_FD") {
+        const char* found = std::getenv(name);
+        std::string value = found ? found : "";
+    #ifdef SO_WINDOWS
+        if(found) _putenv_s(name, "");
+    #else
+        if(found) unsetenv(name);
+        // systemd: LISTEN_FDS descriptors from 3, meant for this process only.
+        const char* pid = std::getenv("LISTEN_PID");
+        const char* fds = std::getenv("LISTEN_FDS");
+        if(pid && fds && std::strtol(pid, nullptr, 10) == (long)getpid()) {
+            if(!found && std::strtol(fds, nullptr, 10) >= 1) value = "3";
+            unsetenv("LISTEN_PID");
+            unsetenv("LISTEN_FDS");
+            unsetenv("LISTEN_FDNAMES");
+        }
+    #endif
+        if(value.empty()) return std::nullopt;
+        char* end = nullptr;
+        long long fd = std::strtoll(value.c_str(), &end, 10);
+        if(end == value.c_str() || *end != '\0' || fd < 0) {
+            throw std::runtime_error("Invalid inherited socket descriptor");
+        }
+        return adopt((sock_t)fd);
+    }
+
+    // Returns the address, as IPv4. Use `getAddress()` for IPv6.
+    sockaddr_in* getAddr() {
+        return reinterpret_cast<sockaddr_in*>(addr.data());
+    }
+
+    // Returns the address, of any family: the server address for a client, the bound one for a server.
+    const Address& getAddress() const {
+        return addr;
+    }
+
+    // Returns the I/O counters of this socket: accepts for a server, connects and traffic for a client.
+    const IoStats& getStats() const {
+        return stats;
+    }
+
+    IoStats& getStats() {
+        return stats;
+    }
+
+    // Returns the port.
+    int getPort() {
+	return port;
+    }
+};
+
+// Creates a connected pair of sockets.
+/**
+ *
+ * @brief ## Creates two connected `AF_UNIX` stream sockets, as `skt::Node`s: what is sent on one is received on the other.
+ *
+ * @param nonBlocking If true, both are non-blocking. If not set, fallback to false.
+ *
+ * @returns The two nodes, owning their sockets.
+ *
+ * @throw `std::runtime_error()` if they can't be created, or on Windows, which has no `socketpair`.
+ *
+ * @note For a parent and child process, or two threads: the whole `skt::Node` API works on them, including `sendFd()` and `recvFd()`.
+ *
+ */
+inline std::pair<Node, Node> socketPair(bool nonBlocking=false) {
+#ifdef SO_WINDOWS
+    (void)nonBlocking;
+    throw std::runtime_error("socketpair is not supported on this platform");
+#else
+    int fds[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        detail::throwLastError("Error creating socket pair");
+    }
+    std::pair<Node, Node> pair(Node(fds[0], std::string(), 0), Node(fds[1], std::string(), 0));
+    // Both ends are unnamed.
+    sockaddr_un unnamed{};
+    unnamed.sun_family = AF_UNIX;
+    Address address(reinterpret_cast<const sockaddr*>(&unnamed), sizeof(sa_family_t));
+    pair.first.setAddress(address);
+    pair.second.setAddress(address);
+    if(nonBlocking) {
+        pair.first.setNonBlocking(true);
+        pair.second.setNonBlocking(true);
+    }
+    return pair;
+#endif
+}
+
+// Datagram struct.
+/**
+ *
+ * @brief A datagram to send with `skt::UdpSocket::sendBatch()`: the payload, and where to. Only views: nothing is copied.
+ *
+ */
+struct Datagram {
+    std::string_view data;
+    const Address* address = nullptr;  // The destination. If null, the connected peer.
+};
+
+// DatagramBatch class.
+/**
+ *
+ * @brief ## `skt::DatagramBatch`
+ *
+ * @param capacity   Datagrams received per call, at most. If not set, fallback to 64.
+ * @param bufferSize Bytes per datagram. Longer ones are truncated. If not set, fallback to 2048. Use 65535 with GRO, where one buffer holds many datagrams.
+ *
+ * @note - The receive side of `skt::UdpSocket::recvBatch()`: buffers, source addresses and kernel headers, allocated once and reused by every call.
+ * @note - With GRO, the kernel hands over consecutive datagrams of one sender as a single buffer of equal `segmentSize()` parts. `forEach()` splits them again.
+ * @note #### Examples:
+ * @note `skt::DatagramBatch batch;` - Up to 64 datagrams of up to 2KB per call.
+ * @note `udp.recvBatch(batch); batch.forEach([](std::string_view payload, const skt::Address& from) { ... });`
+ *
+ */
+class DatagramBatch {
+    friend class UdpSocket;
+
+    size_t bufferSize;
+    std::vector<char> buffers;
+    std::vector<Address> addresses;
+    std::vector<size_t> lengths;
+    std::vector<size_t> segments;
+    size_t count = 0;
+#ifndef SO_WINDOWS
+    static constexpr size_t CONTROL_SIZE = CMSG_SPACE(sizeof(int));
+    std::vector<mmsghdr> headers;
+    std::vector<iovec> iovs;
+    std::vector<char> controls;
+
+    // Resets what the kernel overwrites on each call.
+    void prepare() {
+        for(size_t i = 0; i < headers.size(); i++) {
+            msghdr& h = headers[i].msg_hdr;
+            h.msg_namelen = sizeof(sockaddr_storage);
+            h.msg_controllen = CONTROL_SIZE;
+            h.msg_flags = 0;
+        }
+    }
+
+    // Reads what the kernel filled in, for the first `received` headers.
+    void collect(size_t received) {
+        count = received;
+        for(size_t i = 0; i < received; i++) {
+            msghdr& h = headers[i].msg_hdr;
+            lengths[i] = headers[i].msg_len;
+            *addresses[i].sizePtr() = h.msg_namelen;
+            segments[i] = lengths[i];
+            for(cmsghdr* c = CMSG_FIRSTHDR(&h); c != nullptr; c = CMSG_NXTHDR(&h, c)) {
+                if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                    int size;
+                    std::memcpy(&size, CMSG_DATA(c), sizeof(size));
+                    if(size > 0) segments[i] = (size_t)size;
+                }
+            }
+        }
+    }
+#endif
+
+public:
+
+    DatagramBatch(size_t capacity=64, size_t bufferSize=2048)
+        : bufferSize(std::max<size_t>(bufferSize, 1)) {
+        capacity = std::max<size_t>(capacity, 1);
+        buffers.resize(capacity * this->bufferSize);
+        addresses.resize(capacity);
+        lengths.resize(capacity);
+        segments.resize(capacity);
+    #ifndef SO_WINDOWS
+        headers.resize(capacity);
+        iovs.resize(capacity);
+        controls.resize(capacity * CONTROL_SIZE);
+        for(size_t i = 0; i < capacity; i++) {
+            iovs[i] = {buffers.data() + i * this->bufferSize, this->bufferSize};
+            msghdr& h = headers[i].msg_hdr;
+            h = msghdr{};
+            h.msg_name = addresses[i].data();
+            h.msg_iov = &iovs[i];
+            h.msg_iovlen = 1;
+            h.msg_control = controls.data() + i * CONTROL_SIZE;
+        }
+    #endif
+    }
+
+    // The batch points into itself: no copies.
+    DatagramBatch(const DatagramBatch&) = delete;
+    DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+    // Returns how many datagrams the last call received.
+    size_t size() const {
+        return count;
+    }
+
+    // Returns how many datagrams fit.
+    size_t capacity() const {
+        return addresses.size();
+    }
+
+    // Returns the payload of the i-th datagram received.
+    std::string_view data(size_t i) const {
+        return std::string_view(buffers.data() + i * bufferSize, lengths[i]);
+    }
+
+    // Returns who sent the i-th datagram.
+    const Address& from(size_t i) const {
+        return addresses[i];
+    }
+
+    // Returns the size of the datagrams coalesced into the i-th buffer by GRO. The whole payload if there was no coalescing. The last one may be shorter.
+    size_t segmentSize(size_t i) const {
+        return segments[i];
+    }
+
+    // Calls `f(std::string_view payload, const skt::Address& from)` for every datagram received, splitting the GRO buffers.
+    template<typename F>
+    void forEach(F&& f) const {
+        for(size_t i = 0; i < count; i++) {
+            std::string_view payload = data(i);
+            size_t step = std::max<size_t>(segments[i], 1);
+            do {
+                f(payload.substr(0, step), addresses[i]);
+                payload.remove_prefix(std::min(step, payload.size()));
+            } while(!payload.empty());
+        }
+    }
+};
+
+// UdpSocket class.
+/**
+ *
+ * @brief ## `skt::UdpSocket`
+ *
+ * @param port        The port to bind. If not set, or 0, the system picks one: enough to send, and to receive the replies.
+ * @param ip          The ip to bind, or a host name. IPv6 ones (ex: `ANY_ADDR6`) are dual-stack. If not set, fallback to 0.0.0.0
+ * @param nonBlocking If true, the calls that would wait return `skt::WOULD_BLOCK` instead. If not set, fallback to false.
+ * @param options     Socket options. Only `sendBuffer`, `recvBuffer` and `busyPoll` apply to UDP, the TCP ones are ignored.
+ * @param reusePort   If true, binds with `SO_REUSEPORT`, so one socket per thread can share the port. Linux only. If not set, fallback to false.
+ *
+ * @throw `std::runtime_error()` if the socket can't be created or bound.
+ *
+ * @note - A datagram socket, with the same `skt::Address` addressing, error model and `skt::IoStats` counters as `skt::Socket`.
+ * @note - Batching: `recvBatch()` and `sendBatch()` move many datagrams per syscall, with `recvmmsg`/`sendmmsg`.
+ * @note - Segmentation offload: `sendSegments()` hands the kernel one buffer to cut into equal datagrams (UDP GSO), and `enableGro()` has it coalesce the received ones.
+ * @note - Can be `connect()`ed to one peer: `send()` and `recv()` then need no address, and datagrams from others are filtered out.
+ * @note - Windows has no batching or offload: the same calls work, with one datagram per syscall.
+ * @note #### Examples:
+ * @note `skt::UdpSocket udp(9000);` - Receives datagrams sent to port 9000.
+ * @note `udp.sendTo("ping", *skt::Address::parse("10.0.0.2", 9000));` - Sends one datagram.
+ * @note `skt::DatagramBatch batch; while(udp.recvBatch(batch) > 0) batch.forEach(onDatagram);` - Up to 64 datagrams per syscall.
+ *
+ */
+class UdpSocket {
+    detail::UniqueFd socket;
+    Address local;
+    bool nonBlocking = false;
+    bool connected = false;
+    int gso = -1;  // UDP_SEGMENT support: -1 not tried yet, 0 no, 1 yes.
+    IoStats stats;
+
+    static bool gsoUnsupported(int error) {
+    #ifdef SO_WINDOWS
+        (void)error;
+        return true;
+    #else
+        return error == EIO || error == EINVAL || error == ENOPROTOOPT || error == EOPNOTSUPP;
+    #endif
+    }
+
+public:
+
+    UdpSocket(int port=0, std::string ip=ANY_ADDR, bool nonBlocking=false, const SocketOptions& options=SocketOptions(), bool reusePort=false) {
+        std::optional<Address> parsed = Address::parse(ip, port);
+        local = parsed ? *parsed : detail::resolve(ip, port)[0];
+
+        detail::startNetworking();
+        socket = detail::UniqueFd(::socket(local.family(), SOCK_DGRAM | detail::CLOEXEC, 0));
+        if(socket == INVALID_SOCKET) {
+            detail::throwLastError("Error creating socket");
+        }
+
+        SocketOptions udp;
+        udp.sendBuffer = options.sendBuffer;
+        udp.recvBuffer = options.recvBuffer;
+        udp.busyPoll = options.busyPoll;
+        detail::applyOptions(socket, udp, false);
+        if(reusePort) {
+        #ifdef SO_WINDOWS
+            throw std::runtime_error("SO_REUSEPORT is not supported on this platform");
+        #else
+            detail::setOption(socket, SOL_SOCKET, SO_REUSEPORT, 1);
+        #endif
+        }
+        if(local.isV6()) detail::trySetOption(socket, IPPROTO_IPV6, IPV6_V6ONLY, 0);
+
+        if(::bind(socket, local.data(), local.size()) < 0) {
+            detail::throwLastError("Error binding socket to IP/Port");
+        }
+        // Reads back the port the system picked.
+        *local.sizePtr() = sizeof(sockaddr_storage);
+        getsockname(socket, local.data(), local.sizePtr());
+        if(nonBlocking) setNonBlocking(true);
+    }
+
+    // Takes string literals, like `ANY_ADDR6`.
+    UdpSocket(int port, const char* ip, bool nonBlocking=false, const SocketOptions& options=SocketOptions(), bool reusePort=false)
+        : UdpSocket(port, std::string(ip), nonBlocking, options, reusePort) {}
+
+    UdpSocket(UdpSocket&&) noexcept = default;
+    UdpSocket& operator=(UdpSocket&&) noexcept = default;
+
+    operator sock_t() const { return socket; }
+
+    // Sets a default peer.
+    /**
+     *
+     * @brief Sends to `peer` when no address is given, and only receives from it.
+     *
+     * @throw `std::runtime_error()` if the socket can't be connected. Ex: a family mismatch.
+     *
+     * @note No packet is sent: UDP has no handshake. An unreachable peer shows up as a `ECONNREFUSED` error on a later call.
+     *
+     */
+    void connect(const Address& peer) {
+        if(::connect(socket, peer.data(), peer.size()) < 0) {
+            detail::throwLastError("Error connecting socket");
+        }
+        connected = true;
+    }
+
+    void connect(const std::string& host, int port) {
+        connect(detail::resolve(host, port)[0]);
+    }
+
+    // Sends one datagram.
+    /**
+     *
+     * @brief ## Sends `data` as a single datagram, to `to`.
+     *
+     * @returns The bytes sent: all of `data`, or `skt::WOULD_BLOCK` if the socket is non-blocking and its buffer is full.
+     *
+     * @throw `std::runtime_error()` if the datagram can't be sent. Ex: larger than 65507 bytes (EMSGSIZE).
+     *
+     */
+    int sendTo(std::string_view data, const Address& to) {
+        int sent = ::sendto(socket, data.data(), (int)data.size(), 0, to.data(), to.size());
+        detail::countSend(&stats, sent, data.size());
+        if(sent < 0) {
+            if(detail::wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error sending data");
+        }
+        return sent;
+    }
+
+    // Sends one datagram to the connected peer. See `sendTo()`.
+    int send(std::string_view data) {
+        return detail::trySend(socket, data.data(), data.size(), &stats);
+    }
+
+    // Receives one datagram.
+    /**
+     *
+     * @brief ## Receives one datagram into `buffer`, and who sent it into `from`.
+     *
+     * @returns The size of the datagram, or `skt::WOULD_BLOCK` if the socket is non-blocking and there is none. Waits for one otherwise.
+     *
+     * @throw `std::runtime_error()` if it can't be received.
+     *
+     * @note A datagram larger than `size` is truncated: the rest of it is lost.
+     *
+     */
+    int recvFrom(void* buffer, size_t size, Address& from) {
+        *from.sizePtr() = sizeof(sockaddr_storage);
+        int received = ::recvfrom(socket, static_cast<char*>(buffer), (int)size, 0, from.data(), from.sizePtr());
+        detail::countRecv(&stats, received);
+        if(received < 0) {
+            if(detail::wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error receiving data");
+        }
+        return received;
+    }
+
+    // Receives one datagram from the connected peer. See `recvFrom()`.
+    int recv(void* buffer, size_t size) {
+        return detail::tryRecv(socket, static_cast<char*>(buffer), size, &stats);
+    }
+
+    // Receives many datagrams.
+    /**
+     *
+     * @brief ## Receives as many datagrams as are queued, up to the batch capacity, in one `recvmmsg` call.
+     *
+     * @param batch Where to store them. Replaces what it held.
+     *
+     * @returns How many were received, or `skt::WOULD_BLOCK` if the socket is non-blocking and there are none. A blocking socket waits for the first one only.
+     *
+     * @throw `std::runtime_error()` if they can't be received.
+     *
+     */
+    int recvBatch(DatagramBatch& batch) {
+        batch.count = 0;
+    #ifdef SO_WINDOWS
+        int received = recvFrom(batch.buffers.data(), batch.bufferSize, batch.addresses[0]);
+        if(received < 0) return received;
+        batch.lengths[0] = batch.segments[0] = received;
+        batch.count = 1;
+        return 1;
+    #else
+        batch.prepare();
+        int received = ::recvmmsg(socket, batch.headers.data(), (unsigned)batch.capacity(), MSG_WAITFORONE, nullptr);
+        if(received < 0) {
+            detail::countRecv(&stats, -1);
+            if(detail::wouldBlock()) return WOULD_BLOCK;
+            detail::throwLastError("Error receiving data");
+        }
+        batch.collect(received);
+        size_t bytes = 0;
+        for(int i = 0; i < received; i++) bytes += batch.lengths[i];
+        detail::countRecv(&stats, (long)bytes);
+        return received;
+    #endif
+    }
+
+    // Sends many datagrams.
+    /**
+     *
+     * @brief ## Sends `count` datagrams, in `sendmmsg` calls of up to `skt::detail::MAX_IOV` datagrams.
+     *
+     * @returns How many were sent, in order. Less than `count` only if the socket is non-blocking and its buffer filled, `skt::WOULD_BLOCK` if none.
+     *
+     * @throw `std::runtime_error()` if one can't be sent. The ones before it were.
+     *
+     */
+    int sendBatch(const Datagram* datagrams, size_t count) {
+        size_t sent = 0;
+    #ifdef SO_WINDOWS
+        for(; sent < count; sent++) {
+            const Datagram& d = datagrams[sent];
+            int result = d.address ? sendTo(d.data, *d.address) : send(d.data);
+            if(result == WOULD_BLOCK) break;
+        }
+    #else
+        mmsghdr headers[detail::MAX_IOV];
+        iovec iovs[detail::MAX_IOV];
+        while(sent < count) {
+            size_t n = std::min(count - sent, detail::MAX_IOV);
+            size_t bytes = 0;
+            for(size_t i = 0; i < n; i++) {
+                const Datagram& d = datagrams[sent + i];
+                iovs[i] = {const_cast<char*>(d.data.data()), d.data.size()};
+                headers[i] = mmsghdr{};
+                headers[i].msg_hdr.msg_iov = &iovs[i];
+                headers[i].msg_hdr.msg_iovlen = 1;
+                if(d.address) {
+                    headers[i].msg_hdr.msg_name = const_cast<sockaddr*>(d.address->data());
+                    headers[i].msg_hdr.msg_namelen = d.address->size();
+                }
+                bytes += d.data.size();
+            }
+            int result = ::sendmmsg(socket, headers, (unsigned)n, 0);
+            if(result < 0) {
+                detail::countSend(&stats, -1, bytes);
+                if(detail::wouldBlock()) break;
+                detail::throwLastError("Error sending data");
+            }
+            size_t done = 0;
+            for(int i = 0; i < result; i++) done += headers[i].msg_len;
+            detail::countSend(&stats, (long)done, bytes);
+            sent += result;
+            if((size_t)result < n) break;
+        }
+    #endif
+        if(sent == 0 && count > 0) return WOULD_BLOCK;
+        return (int)sent;
+    }
+
+    int sendBatch(std::initializer_list<Datagram> datagrams) {
+        return sendBatch(datagrams.begin(), datagrams.size());
+    }
+
+    // Sends a buffer as equal datagrams.
+    /**
+     *
+     * @brief ## Cuts `data` into datagrams of `segmentSize` bytes (the last one may be shorter), and sends them to `to`.
+     *
+     * @param data        The payload of all the datagrams, back to back.
+     * @param segmentSize The size of each datagram, ex: the path MTU minus the headers.
+     * @param to          The destination. If null, the connected peer.
+     *
+     * @returns The bytes sent, a whole number of datagrams. Less than `data.size()` only if the socket is non-blocking and its buffer filled, `skt::WOULD_BLOCK` if none.
+     *
+     * @throw `std::runtime_error()` if they can't be sent.
+     *
+     * @note On Linux 4.18+, the kernel cuts up to 64 datagrams per call (UDP GSO, `UDP_SEGMENT`): one trip down the stack, instead of one per datagram.
+     * @note Where that is missing (older kernels, Windows, some devices), falls back to `sendBatch()`, once and for all.
+     *
+     */
+    long sendSegments(std::string_view data, size_t segmentSize, const Address* to=nullptr) {
+        segmentSize = std::max<size_t>(segmentSize, 1);
+        size_t sent = 0;
+    #ifndef SO_WINDOWS
+        // The kernel takes up to 64 segments, and 64KB, per call.
+        size_t perCall = std::max<size_t>(std::min<size_t>(64, 65000 / segmentSize), 1) * segmentSize;
+        while(gso != 0 && sent < data.size()) {
+            size_t n = std::min(perCall, data.size() - sent);
+            iovec iov = {const_cast<char*>(data.data() + sent), n};
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+            msghdr h{};
+            h.msg_iov = &iov;
+            h.msg_iovlen = 1;
+            if(to) {
+                h.msg_name = const_cast<sockaddr*>(to->data());
+                h.msg_namelen = to->size();
+            }
+            if(n > segmentSize) {
+                h.msg_control = control;
+                h.msg_controllen = sizeof(control);
+                cmsghdr* c = CMSG_FIRSTHDR(&h);
+                c->cmsg_level = SOL_UDP;
+                c->cmsg_type = UDP_SEGMENT;
+                c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                uint16_t size = (uint16_t)segmentSize;
+                std::memcpy(CMSG_DATA(c), &size, sizeof(size));
+            }
+            ssize_t result = ::sendmsg(socket, &h, 0);
+            detail::countSend(&stats, (long)result, n);
+            if(result < 0) {
+                if(detail::wouldBlock()) break;
+                if(n > segmentSize && gso != 1 && gsoUnsupported(errno)) { gso = 0; break; }
+                detail::throwLastError("Error sending data");
+            }
+            if(n > segmentSize) gso = 1;
+            sent += (size_t)result;
+        }
+        if(gso != 0 || sent == data.size()) {
+            if(sent == 0 && !data.empty()) return WOULD_BLOCK;
+            return (long)sent;
+        }
+    #endif
+        Datagram datagrams[detail::MAX_IOV];
+        while(sent < data.size()) {
+            size_t n = 0, bytes = 0;
+            for(; n < detail::MAX_IOV && sent + bytes < data.size(); n++) {
+                std::string_view part = data.substr(sent + bytes, segmentSize);
+                datagrams[n] = {part, to};
+                bytes += part.size();
+            }
+            int result = sendBatch(datagrams, n);
+            if(result == WOULD_BLOCK) break;
+            for(int i = 0; i < result; i++) sent += datagrams[i].data.size();
+            if((size_t)result < n) break;
+        }
+        if(sent == 0 && !data.empty()) return WOULD_BLOCK;
+        return (long)sent;
+    }
+
+    // Turns on receive coalescing.
+    /**
+     *
+     * @brief Has the kernel coalesce the datagrams of a flow into large buffers (UDP GRO, `UDP_GRO`), handed over by `recvBatch()` in one go.
+     *
+     * @returns False if the system has no UDP GRO (before Linux 5.0, Windows): datagrams keep coming one per buffer.
+     *
+     * @note Use `skt::DatagramBatch` buffers of 65535 bytes, and `forEach()` to split them. `recvFrom()` would truncate the coalesced buffers.
+     *
+     */
+    bool enableGro(bool enable=true) {
+    #ifdef SO_WINDOWS
+        (void)enable;
+        return false;
+    #else
+        return detail::trySetOption(socket, SOL_UDP, UDP_GRO, enable);
+    #endif
+    }
+
+    // Sets non-blocking mode.
+    void setNonBlocking(bool nonBlocking=true) {
+        detail::setNonBlocking(socket, nonBlocking);
+        this->nonBlocking = nonBlocking;
+    }
+
+    bool isNonBlocking() const {
+        return nonBlocking;
+    }
+
+    // True after `connect()`.
+    bool isConnected() const {
+        return connected;
+    }
+
+    // Closes the socket. Calling it again, or destroying the socket afterwards, does nothing.
+    void close() {
+        if(socket.reset() < 0)
+            detail::throwLastError("Error closing socket");
+    }
+
+    // Returns the socket file descriptor.
+    sock_t getSocket() const {
+        return socket;
+    }
+
+    // Returns the bound address, with the port the system picked if it was 0.
+    const Address& getAddress() const {
+        return local;
+    }
+
+    int getPort() const {
+        return local.port();
+    }
+
+    // Returns the I/O counters of this socket. A batch call counts as one call.
+    const IoStats& getStats() const {
+        return stats;
+    }
+
+    IoStats& getStats() {
+        return stats;
+    }
+};
+
+#ifndef SO_WINDOWS
+// ShmChannel class.
+/**
+ *
+ * @brief ## `skt::ShmChannel`
+ *
+ * @note - A byte stream between two processes on the same host, through shared memory: `send()` and `recv()` are memory copies, with no syscall while both sides are busy.
+ * @note - Set up over an `skt::Node` connected through a Unix domain socket: one side `offer()`s, the other `accept()`s, and the memory is passed with `sendFd()`.
+ * @note - Two lock-free single producer, single consumer rings, one per direction. A side that waits spins briefly, then sleeps on a futex: the peer only makes the wake up syscall when it sleeps.
+ * @note - The node stays open, to notice the peer going away: a channel whose peer closed or died reads its last bytes, then 0, like a socket. Watch it on an `skt::EventLoop` to learn of it without calling `tryRecv()`.
+ * @note - The peer is not trusted: the memory is sealed to its size, and ring positions that make no sense break the channel, with `std::runtime_error()`, instead of reading or writing out of bounds.
+ * @note - One thread per direction: one sender and one receiver at a time. Linux only.
+ * @note #### Examples:
+ * @note `auto channel = skt::ShmChannel::offer(std::move(node));` - On one side, ex: the client.
+ * @note `auto channel = skt::ShmChannel::accept(std::move(node));` - On the other, ex: on an accepted node.
+ * @note `channel.send(request); size_t n = channel.recv(buffer, sizeof(buffer));` - Same calls as an `skt::Node`.
+ *
+ */
+class ShmChannel {
+    // The shared state of one direction. Each field the two sides write has its own cache line.
+    struct Ring {
+        alignas(64) std::atomic<uint64_t> head;  // Bytes written, by the producer.
+        alignas(64) std::atomic<uint64_t> tail;  // Bytes read, by the consumer.
+        alignas(64) std::atomic<uint32_t> consumerSleeping;
+        std::atomic<uint32_t> producerSleeping;
+        std::atomic<uint32_t> closed;            // Set by the producer: no more data.
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+        "Shared memory rings need lock-free atomics");
+
+    static constexpr size_t HEADER = 4096;       // Ring, padded to a page ahead of its data.
+    static constexpr uint64_t MAX_CAPACITY = uint64_t(1) << 40;
+    static constexpr int SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL;
+    static constexpr char HELLO[8] = {'S', 'K', 'T', 'S', 'H', 'M', '0', '1'};
+    static constexpr char ACCEPTED[8] = {'S', 'K', 'T', 'S', 'H', 'M', 'O', 'K'};
+
+    Node node;
+    char* memory = nullptr;
+    size_t mapped = 0;
+    size_t capacity = 0;
+    Ring* tx = nullptr;
+    Ring* rx = nullptr;
+    char* txData = nullptr;
+    char* rxData = nullptr;
+    uint64_t sendHead = 0;       // Our own positions: the copies in the shared memory are only for the peer to read.
+    uint64_t recvTail = 0;
+    unsigned spin = std::thread::hardware_concurrency() > 1 ? 2000 : 0;  // On one core, spinning only delays the peer.
+    bool peerGone = false;
+    bool corrupt = false;
+    IoStats stats;
+
+    static long futex(std::atomic<uint32_t>* word, int op, uint32_t value, const timespec* timeout=nullptr) {
+        return ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, nullptr, 0);
+    }
+
+    // Maps both rings. The offering side sends on the first one.
+    ShmChannel(Node&& node, int memfd, size_t capacity, bool offering) : node(std::move(node)), capacity(capacity) {
+        mapped = 2 * (HEADER + capacity);
+        void* map = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if(map == MAP_FAILED) {
+            detail::throwLastError("Error mapping shared memory");
+        }
+        memory = static_cast<char*>(map);
+        Ring* first = reinterpret_cast<Ring*>(memory);
+        Ring* second = reinterpret_cast<Ring*>(memory + HEADER + capacity);
+        if(offering) {
+            // The memory is zeroed: constructing the atomics there only makes it official.
+            new (first) Ring{};
+            new (second) Ring{};
+        }
+        tx = offering ? first : second;
+        rx = offering ? second : first;
+        txData = reinterpret_cast<char*>(tx) + HEADER;
+        rxData = reinterpret_cast<char*>(rx) + HEADER;
+    }
+
+    // Wakes a side sleeping on `word`, if it is. Called after publishing.
+    static void wake(std::atomic<uint32_t>& word) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(word.load(std::memory_order_relaxed) && word.exchange(0)) futex(&word, FUTEX_WAKE, 1);
+    }
+
+    // Waits until `ready()`. Spins first, then sleeps on `word` until the peer wakes it. Returns false if the peer went away instead.
+    template<typename Ready>
+    bool waitUntil(std::atomic<uint32_t>& word, Ready ready) {
+        for(unsigned i = 0; i < spin; i++) {
+            if(ready()) return true;
+        }
+        while(!ready()) {
+            word.store(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(ready()) { word.store(0, std::memory_order_relaxed); return true; }
+            // Wakes up now and then, to notice a peer that died without closing.
+            timespec timeout = {0, 100 * 1000 * 1000};
+            futex(&word, FUTEX_WAIT, 1, &timeout);
+            word.store(0, std::memory_order_relaxed);
+            if(!ready() && isPeerGone()) return false;
+        }
+        return true;
+    }
+
+    [[noreturn]] void broken() {
+        corrupt = true;
+        throw std::runtime_error("Shared memory channel corrupted by peer");
+    }
+
+    // The bytes in a ring, from our position and the peer's. Anything but 0 to `capacity` ahead is a broken peer.
+    size_t used(uint64_t head, uint64_t tail) {
+        if(head < tail || head - tail > capacity) broken();
+        return (size_t)(head - tail);
+    }
+
+    size_t writeSome(const char* data, size_t size) {
+        uint64_t head = sendHead;
+        uint64_t tail = tx->tail.load(std::memory_order_acquire);
+        size_t n = std::min(size, capacity - used(head, tail));
+        if(n == 0) return 0;
+        size_t at = (size_t)(head & (capacity - 1));
+        size_t first = std::min(n, capacity - at);
+        std::memcpy(txData + at, data, first);
+        std::memcpy(txData, data + first, n - first);
+        sendHead = head + n;
+        tx->head.store(sendHead, std::memory_order_release);
+        wake(tx->consumerSleeping);
+        return n;
+    }
+
+    size_t readSome(char* buffer, size_t size) {
+        uint64_t tail = recvTail;
+        uint64_t head = rx->head.load(std::memory_order_acquire);
+        size_t n = std::min(size, used(head, tail));
+        if(n == 0) return 0;
+        size_t at = (size_t)(tail & (capacity - 1));
+        size_t first = std::min(n, capacity - at);
+        std::memcpy(buffer, rxData + at, first);
+        std::memcpy(buffer + first, rxData, n - first);
+        recvTail = tail + n;
+        rx->tail.store(recvTail, std::memory_order_release);
+        wake(rx->producerSleeping);
+        return n;
+    }
+
+    // Also true on a broken ring, for the next call to report it.
+    bool readable() const {
+        return rx->head.load(std::memory_order_acquire) != recvTail || rx->closed.load(std::memory_order_acquire);
+    }
+
+    bool writable() const {
+        return sendHead - tx->tail.load(std::memory_order_acquire) != capacity || rx->closed.load(std::memory_order_acquire);
+    }
+
+    void release() {
+        if(memory) ::munmap(memory, mapped);
+        memory = nullptr;
+    }
+
+    // One ring write. The blocking calls leave watching the peer to `waitUntil()`, to not make a syscall each time the ring is full or empty.
+    int transmit(std::string_view data, bool checkPeer) {
+        if(!memory || tx->closed.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("Shared memory channel is closed");
+        }
+        if(corrupt) broken();
+        if(rx->closed.load(std::memory_order_acquire)) {
+            throw std::runtime_error("Shared memory channel closed by peer");
+        }
+        size_t sent = writeSome(data.data(), std::min<size_t>(data.size(), INT32_MAX));
+        if(sent == 0 && !data.empty()) {
+            if(checkPeer && isPeerGone()) throw std::runtime_error("Shared memory channel peer went away");
+            return WOULD_BLOCK;
+        }
+        detail::countSend(&stats, (long)sent, data.size());
+        return (int)sent;
+    }
+
+    int receive(void* buffer, size_t size, bool checkPeer) {
+        if(!memory) return 0;
+        if(corrupt) broken();
+        size = std::min<size_t>(size, INT32_MAX);
+        size_t received = readSome(static_cast<char*>(buffer), size);
+        if(received == 0 && size > 0) {
+            // The peer writes its last bytes before closing, or dying: look again once that is seen.
+            if(rx->closed.load(std::memory_order_acquire) || peerGone || (checkPeer && isPeerGone())) received = readSome(static_cast<char*>(buffer), size);
+            else return WOULD_BLOCK;
+            if(received == 0) return 0;
+        }
+        detail::countRecv(&stats, (long)received);
+        return (int)received;
+    }
+
+public:
+
+    // Sets up a channel, on the side that creates the memory.
+    /**
+     *
+     * @brief ## Creates the shared memory, passes it over `node`, and waits for the peer to `accept()` it.
+     *
+     * @param node     A connected node, over a Unix domain socket (`"unix:/path"` addresses, or `skt::socketPair()`). Owned by the channel from now on.
+     * @param capacity Bytes each direction can hold before `send()` waits. Rounded up to a power of two. If not set, fallback to 1MB.
+     *
+     * @returns The channel.
+     *
+     * @throw `std::runtime_error()` if the node is not a Unix domain socket, the memory can't be created, or the peer did not accept it.
+     *
+     */
+    static ShmChannel offer(Node&& node, size_t capacity=1 << 20) {
+        if(!node.getAddress().isUnix()) {
+            throw std::runtime_error("Shared memory channels need a Unix domain socket connection");
+        }
+        size_t size = 4096;
+        while(size < capacity) size *= 2;
+
+        // Sealed to its size: neither side can shrink it under the other's mapping, which would fault on access.
+        detail::UniqueFd memfd(::memfd_create("skt-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+        if(memfd == INVALID_SOCKET || ::ftruncate(memfd, (off_t)(2 * (HEADER + size))) < 0 || ::fcntl(memfd, F_ADD_SEALS, SEALS) < 0) {
+            detail::throwLastError("Error creating shared memory");
+        }
+        ShmChannel channel(std::move(node), memfd, size, true);
+
+        char hello[16];
+        uint64_t announced = size;
+        std::memcpy(hello, HELLO, 8);
+        std::memcpy(hello + 8, &announced, 8);
+        channel.node.sendFd(memfd, std::string_view(hello, sizeof(hello)));
+
+        char reply[8];
+        channel.node.recvExact(reply, sizeof(reply));
+        if(std::memcmp(reply, ACCEPTED, 8) != 0) {
+            throw std::runtime_error("Peer did not accept the shared memory channel");
+        }
+        return channel;
+    }
+
+    // Sets up a channel, on the side that receives the memory.
+    /**
+     *
+     * @brief ## Receives the shared memory sent by the peer's `offer()` over `node`, and maps it.
+     *
+     * @param node A connected node, over a Unix domain socket. Owned by the channel from now on.
+     *
+     * @returns The channel.
+     *
+     * @throw `std::runtime_error()` if the peer sent no valid offer, its memory is not sealed to its size, or it can't be mapped.
+     *
+     */
+    static ShmChannel accept(Node&& node) {
+        std::string hello;
+        detail::UniqueFd memfd(node.recvFd(&hello));
+        if(hello.size() < 16 && hello.size() >= 1) {
+            char rest[16];
+            node.recvExact(rest, 16 - hello.size());
+            hello.append(rest, 16 - hello.size());
+        }
+        uint64_t size = 0;
+        if(hello.size() == 16) std::memcpy(&size, hello.data() + 8, 8);
+        struct stat info;
+        if(memfd == INVALID_SOCKET || hello.size() != 16 || std::memcmp(hello.data(), HELLO, 8) != 0
+            || size < 4096 || size > MAX_CAPACITY || (size & (size - 1)) != 0 || ::fstat(memfd, &info) < 0 || (uint64_t)info.st_size < 2 * (HEADER + size)
+            || (::fcntl(memfd, F_GET_SEALS) & SEALS) != SEALS) {
+            throw std::runtime_error("Invalid shared memory channel offer");
+        }
+
+        ShmChannel channel(std::move(node), memfd, (size_t)size, false);
+        channel.node.send(std::string_view(ACCEPTED, sizeof(ACCEPTED)));
+        return channel;
+    }
+
+    ShmChannel(ShmChannel&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    ShmChannel& operator=(ShmChannel&& other) noexcept {
+        if(this != &other) {
+            close();
+            release();
+            node = std::move(other.node);
+            memory = std::exchange(other.memory, nullptr);
+            mapped = other.mapped;
+            capacity = other.capacity;
+            tx = other.tx; rx = other.rx;
+            txData = other.txData; rxData = other.rxData;
+            sendHead = other.sendHead;
+            recvTail = other.recvTail;
+            spin = other.spin;
+            peerGone = other.peerGone;
+            corrupt = other.corrupt;
+            stats = other.stats;
+        }
+        return *this;
+    }
+
+    ~ShmChannel() {
+        close();
+        release();
+    }
+
+    // Sends data.
+    /**
+     *
+     * @brief ## Copies all of `data` into the ring, waiting for room when it is full.
+     *
+     * @throw `std::runtime_error()` if the channel was closed, the peer closed or went away, or it broke the ring.
+     *
+     */
+    void send(std::string_view data) {
+        while(!data.empty()) {
+            int sent = transmit(data, false);
+            if(sent > 0) { data.remove_prefix(sent); continue; }
+            if(!waitUntil(tx->producerSleeping, [this] { return writable(); })) {
+                throw std::runtime_error("Shared memory channel peer went away");
+            }
+        }
+    }
+
+    // Sends what fits now. Returns the bytes sent, or `skt::WOULD_BLOCK` if the ring is full. Throws `std::runtime_error()` if closed, or the peer went away.
+    int trySend(std::string_view data) {
+        return transmit(data, true);
+    }
+
+    // Receives data.
+    /**
+     *
+     * @brief ## Copies what is in the ring into `buffer`, up to `size` bytes, waiting for data if there is none.
+     *
+     * @returns The number of bytes received. 0 once the peer closed, or went away, and everything it sent was read.
+     *
+     * @throw `std::runtime_error()` if the peer broke the ring.
+     *
+     */
+    size_t recv(void* buffer, size_t size) {
+        while(true) {
+            int received = receive(buffer, size, false);
+            if(received != WOULD_BLOCK) return received;
+            if(!waitUntil(rx->consumerSleeping, [this] { return readable(); })) return 0;
+        }
+    }
+
+    // Receives up to the default receive size, as a string. Empty once the peer closed.
+    std::string recv() {
+        std::string data(detail::RECV_SIZE, '\0');
+        data.resize(recv(data.data(), data.size()));
+        return data;
+    }
+
+    // Receives what is there now. Returns the bytes received, 0 if the peer closed or went away, or `skt::WOULD_BLOCK` if the ring is empty.
+    int tryRecv(void* buffer, size_t size) {
+        return receive(buffer, size, true);
+    }
+
+    // Closes the channel: the peer reads what was sent, then 0, and its sends fail. Also done by the destructor.
+    void close() {
+        if(!memory || tx->closed.load(std::memory_order_relaxed)) return;
+        tx->closed.store(1, std::memory_order_release);
+        wake(tx->consumerSleeping);
+        wake(rx->producerSleeping);
+    }
+
+    // True once the peer closed the node, or its process died. Only checks the node, without waiting: a peer that `close()`d the channel but keeps the node open is seen by `tryRecv()` returning 0.
+    bool isPeerGone() {
+        if(peerGone) return true;
+        pollfd pfd = {node, POLLIN | POLLRDHUP, 0};
+        if(::poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLHUP | POLLRDHUP | POLLERR))) peerGone = true;
+        return peerGone;
+    }
+
+    // Sets how many times a waiting call checks the ring before sleeping. More trades CPU for latency. If not set, 2000, or 0 on a single core.
+    void setSpin(unsigned spin) {
+        this->spin = spin;
+    }
+
+    // Returns the bytes each direction holds.
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    // Returns the node the channel was set up over.
+    Node& getNode() {
+        return node;
+    }
+
+    // Returns the I/O counters of this channel. Calls are ring operations, not syscalls.
+    const IoStats& getStats() const {
+        return stats;
+    }
+
+    IoStats& getStats() {
+        return stats;
+    }
+};
+#endif
+
+// ReadBuffer class.
+/**
+ *
+ * @brief ## `skt::ReadBuffer`
+ *
+ * @param capacity The initial capacity, in bytes. If not set, fallback to 64 KB. Grows when needed.
+ *
+ * @note - Allocates nothing until the first `reserve()`: a connection that never receives costs no buffer.
+ * @note - The input buffer of `skt::FramedConnection`: data is appended at the back and consumed from the front.
+ * @note - The unread data is always contiguous. When the back runs out of room, only the unread bytes are moved to the front, so every frame can be viewed in place.
+ * @note - Each byte is moved at most a few times whatever the message sizes, so buffering stays linear instead of quadratic like `std::string` concatenation.
+ *
+ */
+class ReadBuffer {
+    std::unique_ptr<char[]> storage;
+    size_t initial, cap = 0, head = 0, tail = 0;
+
+public:
+    ReadBuffer(size_t capacity=64 << 10) : initial(capacity) {}
+
+    const char* readPtr() const { return storage.get() + head; }
+    size_t readable() const { return tail - head; }
+    std::string_view view() const { return std::string_view(readPtr(), readable()); }
+
+    char* writePtr() { return storage.get() + tail; }
+    size_t writable() const { return cap - tail; }
+    size_t capacity() const { return cap; }
+
+    // Marks `n` bytes written at `writePtr()` as data.
+    void commit(size_t n) { tail += n; }
+
+    // Drops `n` bytes from the front.
+    void consume(size_t n) {
+        head += n;
+        if(head == tail) head = tail = 0;
+    }
+
+    // Makes room for at least `n` more bytes at the back, compacting first, and growing only if that is not enough.
+    void reserve(size_t n) {
+        if(writable() >= n) return;
+        if(!storage) {
+            cap = std::max(initial, n);
+            storage.reset(new char[cap]);
+            return;
+        }
+
+        size_t unread = readable();
+        if(head > 0 && cap - unread >= n) {
+            memmove(storage.get(), readPtr(), unread);
+        } else {
+            size_t grown = std::max(cap * 2, unread + n);
+            std::unique_ptr<char[]> bigger(new char[grown]);
+            memcpy(bigger.get(), readPtr(), unread);
+            storage = std::move(bigger);
+            cap = grown;
+        }
+        head = 0;
+        tail = unread;
+    }
+};
+
+// Message framing.
+/**
+ *
+ * @brief How `skt::FramedConnection` splits the stream into messages.
+ *
+ * @param LengthU32 Every frame starts with its length, as a 4 bytes big-endian unsigned integer.
+ * @param Varint    Every frame starts with its length, as a base 128 varint (the protobuf encoding), 1 to 10 bytes.
+ * @param Delimiter Frames end with a delimiter, ex: `"\r\n"`. The delimiter is not part of the frame.
+ *
+ */
+enum class Framing {
+    LengthU32,
+    Varint,
+    Delimiter,
+};
+
+// FramedConnection class.
+/**
+ *
+ * @brief ## `skt::FramedConnection`
+ *
+ * @param fd        The connection. A `skt::Node` converts to it, a client `skt::Socket` can be passed as is.
+ * @param framing   The framing codec. If not set, fallback to `skt::Framing::LengthU32`.
+ * @param delimiter The frame delimiter, used with `skt::Framing::Delimiter`. If not set, fallback to `"\r\n"`.
+ * @param maxFrame  The largest frame accepted, in bytes. If not set, fallback to 16 MB.
+ *
+ * @note - Turns the byte stream into messages: `recvFrame()` returns whole frames, however they were split across reads.
+ * @note - Frames are views into the internal `skt::ReadBuffer`, with no copy. A view is valid until the next receive call.
+ * @note - Does not own the connection, the node or socket must outlive it.
+ * @note - Works on blocking and non-blocking connections. With `skt::EventLoop`, call `tryRecvFrame()` in a loop on readable.
+ * @note #### Examples:
+ * @note `skt::FramedConnection conn(node);` - Length-prefixed frames over an accepted node.
+ * @note `skt::FramedConnection conn(client, skt::Framing::Delimiter, "\n");` - Line-based protocol over a client socket.
+ * @note `while(auto frame = conn.recvFrame()) handle(*frame);` - Reads frames until the peer closes.
+ * @note `conn.sendFrame(payload);` - Sends the header and payload in a single gather send, without copying the payload.
+ *
+ */
+class FramedConnection {
+    sock_t fd;
+    Framing framing;
+    std::string delimiter;
+    size_t maxFrame;
+    ReadBuffer in;
+    size_t pending = 0;   // Bytes of the last returned frame, consumed on the next call.
+    size_t scanned = 0;   // Bytes already searched for the delimiter.
+    bool closed = false;
+
+    // Parses a header at the front. Returns its size, or 0 if it is not complete yet.
+    size_t parseHeader(size_t& length) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(in.readPtr());
+        size_t available = in.readable();
+
+        if(framing == Framing::LengthU32) {
+            if(available < 4) return 0;
+            length = (size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]);
+            return 4;
+        }
+
+        length = 0;
+        for(size_t i = 0; i < available && i < 10; i++) {
+            length |= size_t(p[i] & 0x7f) << (7 * i);
+            if((p[i] & 0x80) == 0) return i + 1;
+        }
+        if(available >= 10) {
+            throw std::runtime_error("Invalid frame header");
+        }
+        return 0;
+    }
+
+    // Finds a complete frame in the buffer. Returns false if more data is needed, and how much in `need`.
+    bool parse(std::string_view& frame, size_t& need) {
+        in.consume(pending);
+        pending = 0;
+        need = 1;
+
+        if(framing == Framing::Delimiter) {
+            std::string_view data = in.view();
+            size_t from = scanned >= delimiter.size() ? scanned - delimiter.size() + 1 : 0;
+            size_t end = data.find(delimiter, from);
+            if(end == std::string_view::npos) {
+                scanned = data.size();
+                // The delimiter can't start within `maxFrame` bytes anymore.
+                if(scanned >= maxFrame + delimiter.size()) {
+                    throw std::runtime_error("Frame too large");
+                }
+                return false;
+            }
+            // Also when the whole frame came in one read, and was never scanned in parts.
+            if(end > maxFrame) {
+                throw std::runtime_error("Frame too large");
+            }
+            frame = data.substr(0, end);
+            pending = end + delimiter.size();
+            scanned = 0;
+            return true;
+        }
+
+        size_t length;
+        size_t header = parseHeader(length);
+        if(header == 0) return false;
+        if(length > maxFrame) {
+            throw std::runtime_error("Frame too large");
+        }
+        if(in.readable() < header + length) {
+            need = header + length - in.readable();
+            return false;
+        }
+        frame = std::string_view(in.readPtr() + header, length);
+        pending = header + length;
+        return true;
+    }
+
+    // One read into the buffer. Returns the bytes read, 0 if closed, or WOULD_BLOCK.
+    int fill(size_t need) {
+        in.reserve(std::max<size_t>(need, detail::RECV_SIZE));
+        int received = detail::tryRecv(fd, in.writePtr(), in.writable());
+        if(received > 0) in.commit(received);
+        if(received == 0) closed = true;
+        return received;
+    }
+
+    void checkClean() {
+        if(in.readable() > 0) {
+            throw std::runtime_error("Connection closed in the middle of a frame");
+        }
+    }
+
+public:
+
+    FramedConnection(sock_t fd, Framing framing=Framing::LengthU32, std::string_view delimiter="\r\n", size_t maxFrame=16 << 20)
+        : fd(fd), framing(framing), delimiter(delimiter), maxFrame(maxFrame) {
+        if(framing == Framing::Delimiter && this->delimiter.empty()) {
+            throw std::runtime_error("Empty frame delimiter");
+        }
+    }
+
+    FramedConnection(Socket& socket, Framing framing=Framing::LengthU32, std::string_view delimiter="\r\n", size_t maxFrame=16 << 20)
+        : FramedConnection(socket.getSocket(), framing, delimiter, maxFrame) {}
+
+    // Receives a frame.
+    /**
+     *
+     * @brief Waits for a whole frame, and returns a view of it.
+     *
+     * @returns The frame, valid until the next receive call. Empty optional if the peer closed the connection between frames.
+     *
+     * @throw `std::runtime_error()` if the data can't be received, a frame is larger than `maxFrame`, or the peer closed in the middle of a frame.
+     *
+     */
+    std::optional<std::string_view> recvFrame() {
+        std::string_view frame;
+        size_t need;
+        while(!parse(frame, need)) {
+            if(closed) { checkClean(); return std::nullopt; }
+
+            int received = fill(need);
+            if(received == WOULD_BLOCK) detail::waitFor(fd, false);
+        }
+        return frame;
+    }
+
+    // Tries to receive a frame, without waiting.
+    /**
+     *
+     * @brief Returns a frame if one is complete, reading what is available from the socket otherwise.
+     *
+     * @returns The frame, valid until the next receive call. Empty optional if no whole frame is available yet, or the peer closed (see `isClosed()`).
+     *
+     * @throw `std::runtime_error()` if the data can't be received, a frame is larger than `maxFrame`, or the peer closed in the middle of a frame.
+     *
+     */
+    std::optional<std::string_view> tryRecvFrame() {
+        std::string_view frame;
+        size_t need;
+        while(!parse(frame, need)) {
+            if(closed) { checkClean(); return std::nullopt; }
+            if(fill(need) == WOULD_BLOCK) return std::nullopt;
+        }
+        return frame;
+    }
+
+    // Sends a frame.
+    /**
+     *
+     * @brief Sends `payload` as one frame: header (or delimiter) and payload go out in a single gather send, the payload is not copied.
+     *
+     * @param payload The frame to send.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent, or the payload is larger than `maxFrame`.
+     *
+     * @note With `skt::Framing::Delimiter`, the payload must not contain the delimiter.
+     *
+     */
+    void sendFrame(std::string_view payload) {
+        if(payload.size() > maxFrame) {
+            throw std::runtime_error("Frame too large");
+        }
+
+        if(framing == Framing::Delimiter) {
+            std::string_view parts[2] = {payload, delimiter};
+            detail::sendvAll(fd, parts, 2);
+            return;
+        }
+
+        unsigned char header[10];
+        size_t headerSize = 0;
+        if(framing == Framing::LengthU32) {
+            uint32_t length = (uint32_t)payload.size();
+            header[0] = length >> 24; header[1] = length >> 16; header[2] = length >> 8; header[3] = length;
+            headerSize = 4;
+        } else {
+            size_t length = payload.size();
+            do {
+                header[headerSize++] = (length & 0x7f) | (length > 0x7f ? 0x80 : 0);
+                length >>= 7;
+            } while(length > 0);
+        }
+
+        std::string_view parts[2] = {std::string_view(reinterpret_cast<char*>(header), headerSize), payload};
+        detail::sendvAll(fd, parts, 2);
+    }
+
+    // True once the peer closed the connection.
+    bool isClosed() const {
+        return closed;
+    }
+
+    // Returns the buffered bytes, not returned as frames yet.
+    size_t buffered() const {
+        return in.readable() - pending;
+    }
+};
+
+// Readiness events.
+/**
+ *
+ * @brief Events an `skt::EventLoop` can watch for and dispatch.
+ *
+ * @param READABLE Data is available, or a connection is pending on a server socket.
+ * @param WRITABLE The send buffer has room for more data.
+ * @param CLOSED   The peer hung up or the socket errored. Always watched, no need to ask for it.
+ * @param ONESHOT  Not an event: stop watching the socket after one dispatch, until it is re-armed with `modify()`.
+ *
+ * @note Flags can be combined: `skt::READABLE | skt::WRITABLE`.
+ * @note With `ONESHOT`, a socket can be handed to another thread when ready, with no risk of being dispatched again meanwhile.
+ *
+ */
+enum Event : uint32_t {
+    READABLE = 1u << 0,
+    WRITABLE = 1u << 1,
+    CLOSED   = 1u << 2,
+    ONESHOT  = 1u << 3,
+};
+
+// Socket deadlines.
+/**
+ *
+ * @brief The deadlines an `skt::EventLoop` can enforce on a watched socket, see `setDeadline()`.
+ *
+ * @param Read  The socket must become readable within the timeout: of being set, or of the last time it was readable.
+ * @param Write While it waits for `WRITABLE`, the socket must get room to write within the timeout.
+ * @param Idle  The socket must see some event, readable or writable, within the timeout.
+ *
+ */
+enum class Deadline {
+    Read,
+    Write,
+    Idle,
+};
+
+// TimerWheel class.
+/**
+ *
+ * @brief ## `skt::TimerWheel`
+ *
+ * @note - Timers in a hierarchical timing wheel: 5 levels of 64 slots, with 1ms ticks. Delays up to 12 days, longer ones are capped there and re-queued.
+ * @note - `add()`, `cancel()` and `reset()` are O(1): no sorted heap, timers are linked into the slot of their expiry and cascade down as time passes.
+ * @note - Timers live in one vector, recycled through a free list: no allocation per timer once it has grown.
+ * @note - Not thread-safe. `skt::EventLoop` has one, see `addTimer()` and `setDeadline()`. It may fire a timer up to a tick late, never early.
+ * @note #### Examples:
+ * @note `auto id = wheel.add(std::chrono::seconds(30), [&]{ close(); });` - Runs the callback from `advance()`, 30s from now.
+ * @note `wheel.reset(id, std::chrono::seconds(30));` - Pushes it back, ex: on activity.
+ *
+ */
+class TimerWheel {
+public:
+    using Callback = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+    // Names a timer. 0 is never used: it can stand for "no timer". Stale ids are detected, cancelling them does nothing.
+    using TimerId = uint64_t;
+
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned LEVELS = 5;
+    static constexpr uint32_t SLOTS = 1u << LEVEL_BITS;
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr uint32_t DUE = LEVELS * SLOTS;  // The extra list of the timers being run.
+    static constexpr uint64_t MAX_DELAY = (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1;
+
+    struct Timer {
+        uint64_t expires = 0;    // In ticks.
+        Callback callback;
+        uint32_t prev = NIL, next = NIL;
+        uint32_t slot = NIL;     // Index in `heads`, NIL when not queued.
+        uint32_t generation = 1;
+    };
+
+    std::vector<Timer> timers;
+    std::vector<uint32_t> freeList;
+    uint32_t heads[LEVELS * SLOTS + 1];
+    uint64_t current = 0;        // The next tick to run.
+    size_t count = 0;
+    Clock::time_point start = Clock::now();
+
+    static TimerId makeId(uint32_t index, uint32_t generation) {
+        return (uint64_t(generation) << 32) | (index + 1);
+    }
+
+    // Returns the index of a live timer, or NIL.
+    uint32_t find(TimerId id) const {
+        uint32_t index = (uint32_t)(id & 0xffffffffu) - 1;
+        if(id == 0 || index >= timers.size()) return NIL;
+        const Timer& t = timers[index];
+        if(t.generation != (uint32_t)(id >> 32) || t.slot == NIL) return NIL;
+        return index;
+    }
+
+    uint64_t ticksAt(Clock::time_point when) const {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(when - start).count();
+    }
+
+    // The tick a delay from now ends on, rounded up so timers don't fire early.
+    uint64_t expiryOf(std::chrono::milliseconds delay) const {
+        auto elapsed = Clock::now() - start + std::max(delay, std::chrono::milliseconds(0));
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed + std::chrono::milliseconds(1) - std::chrono::nanoseconds(1)).count();
+    }
+
+    // Links a timer into its slot: the lowest level whose span reaches its expiry.
+    void link(uint32_t index) {
+        Timer& t = timers[index];
+        uint64_t expires = std::max(t.expires, current);
+        uint64_t delta = expires - current;
+        if(delta > MAX_DELAY) { delta = MAX_DELAY; expires = current + MAX_DELAY; }
+
+        unsigned level = 0;
+        while(level + 1 < LEVELS && delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1)))) level++;
+        uint32_t slot = level * SLOTS + (uint32_t)((expires >> (LEVEL_BITS * level)) & (SLOTS - 1));
+
+        t.slot = slot;
+        t.prev = NIL;
+        t.next = heads[slot];
+        if(t.next != NIL) timers[t.next].prev = index;
+        heads[slot] = index;
+    }
+
+    void unlink(uint32_t index) {
+        Timer& t = timers[index];
+        if(t.prev != NIL) timers[t.prev].next = t.next;
+        else heads[t.slot] = t.next;
+        if(t.next != NIL) timers[t.next].prev = t.prev;
+        t.prev = t.next = t.slot = NIL;
+    }
+
+    void release(uint32_t index) {
+        Timer& t = timers[index];
+        t.callback = nullptr;
+        t.generation++;
+        freeList.push_back(index);
+        count--;
+    }
+
+    // Moves a whole slot to the `DUE` list. Its timers stay cancellable while they are run.
+    void takeSlot(uint32_t slot) {
+        for(uint32_t i = heads[slot]; i != NIL; i = timers[i].next) timers[i].slot = DUE;
+        heads[DUE] = heads[slot];
+        heads[slot] = NIL;
+    }
+
+    // Moves the timers of a higher level slot down, now that its span has begun.
+    void cascade(unsigned level) {
+        takeSlot(level * SLOTS + (uint32_t)((current >> (LEVEL_BITS * level)) & (SLOTS - 1)));
+        while(heads[DUE] != NIL) {
+            uint32_t i = heads[DUE];
+            unlink(i);
+            link(i);
+        }
+    }
+
+    // Runs the timers of the current tick. Returns how many fired.
+    size_t runTick() {
+        // At each wrap of a level, the next slot of the level above comes down.
+        for(unsigned level = 1; level < LEVELS; level++) {
+            if((current & ((uint64_t(1) << (LEVEL_BITS * level)) - 1)) != 0) break;
+            cascade(level);
+        }
+
+        // Timers added by the callbacks go after this tick.
+        uint64_t tick = current++;
+        takeSlot((uint32_t)(tick & (SLOTS - 1)));
+        size_t fired = 0;
+        while(heads[DUE] != NIL) {
+            uint32_t i = heads[DUE];
+            unlink(i);
+            if(timers[i].expires > tick) {
+                link(i);  // Capped at the maximum delay: still has to wait.
+                continue;
+            }
+            // Freed before the call: the callback may add timers, which can reuse this one.
+            Callback callback = std::move(timers[i].callback);
+            release(i);
+            callback();
+            fired++;
+        }
+        return fired;
+    }
+
+public:
+
+    TimerWheel() {
+        std::fill(std::begin(heads), std::end(heads), NIL);
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Adds a timer.
+    /**
+     *
+     * @brief Calls `callback` from `advance()`, once `delay` has passed.
+     *
+     * @returns The id of the timer, for `cancel()` and `reset()`.
+     *
+     */
+    TimerId add(std::chrono::milliseconds delay, Callback callback) {
+        uint32_t index;
+        if(!freeList.empty()) { index = freeList.back(); freeList.pop_back(); }
+        else { index = (uint32_t)timers.size(); timers.emplace_back(); }
+
+        Timer& t = timers[index];
+        t.expires = expiryOf(delay);
+        t.callback = std::move(callback);
+        link(index);
+        count++;
+        return makeId(index, t.generation);
+    }
+
+    // Cancels a timer. Returns false if it already fired, or was cancelled.
+    bool cancel(TimerId id) {
+        uint32_t index = find(id);
+        if(index == NIL) return false;
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    // Moves a pending timer to `delay` from now, keeping its callback. Returns false if it already fired, or was cancelled.
+    bool reset(TimerId id, std::chrono::milliseconds delay) {
+        uint32_t index = find(id);
+        if(index == NIL) return false;
+        unlink(index);
+        timers[index].expires = expiryOf(delay);
+        link(index);
+        return true;
+    }
+
+    // Runs the timers that are due.
+    /**
+     *
+     * @brief Runs every timer whose delay has passed, in expiry order (by tick, timers due on the same tick run in any order).
+     *
+     * @returns The number of timers that fired.
+     *
+     */
+    size_t advance() {
+        uint64_t now = ticksAt(Clock::now());
+        size_t fired = 0;
+        while(current <= now) {
+            // Nothing queued: skip the empty ticks.
+            if(count == 0) { current = now + 1; break; }
+            fired += runTick();
+        }
+        return fired;
+    }
+
+    // Returns how long until the next timer may fire, in milliseconds, to use as a poll timeout. -1 if there are none.
+    int nextTimeout() const {
+        if(count == 0) return -1;
+        uint64_t now = ticksAt(Clock::now());
+        if(current <= now) return 0;
+
+        // The first busy slot of level 0, or the first slot of a higher level that comes down, whichever is earlier.
+        uint64_t next = UINT64_MAX;
+        for(uint32_t k = 0; k < SLOTS; k++) {
+            if(heads[(current + k) & (SLOTS - 1)] != NIL) { next = current + k; break; }
+        }
+        for(unsigned level = 1; level < LEVELS; level++) {
+            unsigned shift = LEVEL_BITS * level;
+            uint64_t base = current >> shift;
+            // On a boundary of the level, its current slot has not come down yet: it is the next one to.
+            uint32_t first = (current & ((uint64_t(1) << shift) - 1)) == 0 ? 0 : 1;
+            for(uint32_t k = first; k < first + SLOTS; k++) {
+                if(heads[level * SLOTS + ((base + k) & (SLOTS - 1))] == NIL) continue;
+                next = std::min(next, (base + k) << shift);
+                break;
+            }
+        }
+        if(next == UINT64_MAX) return -1;
+        return (int)std::min<uint64_t>(next - now, INT32_MAX);
+    }
+
+    // Returns the number of pending timers.
+    size_t size() const {
+        return count;
+    }
+
+    // Returns the time, in ticks (ms) since the wheel was created.
+    uint64_t now() const {
+        return ticksAt(Clock::now());
+    }
+};
+
+#ifdef SKT_HAS_COROUTINES
+namespace detail { struct IoAwaiter; }
+#endif
+
+// EventLoop class.
+/**
+ *
+ * @brief ## `skt::EventLoop`
+ *
+ * @note - A reactor: watches many sockets at once from a single thread, and calls back when they are ready.
+ * @note - Uses epoll on Linux, and WSAPoll on Windows. Level-triggered: a callback keeps firing while the socket stays ready.
+ * @note - Works on raw socket descriptors, so both the listening `skt::Socket` (`getSocket()`) and accepted `skt::Node`s can be added.
+ * @note - Callbacks run on the thread calling `run()` or `runOnce()`. It is safe to add, modify or remove sockets from inside a callback.
+ * @note - The loop is not thread-safe, except for `post()` and `stop()`: other threads use `post()` to run code on the loop thread.
+ * @note - If `onReadable` is set, a peer half-close is seen as a 0 bytes read, like with blocking code. `onClosed` is called on hang ups and errors.
+ * @note - The loop does not own the sockets, remove them before closing. Sockets awaited by coroutines stay watched between awaits too.
+ * @note #### Examples:
+ * @note `loop.add(sock.getSocket(), skt::READABLE, {[&]{ auto node = sock.accept(); ... }});` - Accepts connections as they come.
+ * @note `loop.add(*node, skt::READABLE, {onData, nullptr, onHangUp});` - Reads from a client, and cleans up on hang up.
+ * @note `loop.run();` - Dispatches events until `stop()` is called.
+ *
+ */
+class EventLoop {
+public:
+    using Callback = std::function<void()>;
+
+    // The callbacks of a watched socket. Any of them can be left empty.
+    struct Handlers {
+        Callback onReadable;
+        Callback onWritable;
+        Callback onClosed;
+    };
+
+private:
+    struct DeadlineState {
+        TimerWheel::TimerId timer = 0;
+        uint64_t timeout = 0;     // In ms. 0 when not set, or spent.
+        uint64_t lastActive = 0;  // The tick of the last event that pushes it back.
+        Callback onTimeout;
+    };
+
+    struct Entry {
+        sock_t fd;
+        uint32_t interest;
+        Handlers handlers;
+        bool active = true;
+        bool armed = true;
+        std::unique_ptr<DeadlineState[]> deadlines;  // One per `skt::Deadline`, allocated by the first `setDeadline()`.
+    };
+
+    std::unordered_map<sock_t, std::shared_ptr<Entry>> entries;
+    std::atomic<bool> stopRequested{false};  // Set by `stop()`, cleared by the `run()` it ends.
+
+    std::mutex postedMutex;
+    std::vector<Callback> posted;
+    std::vector<Callback> deferred;
+    LatencyHistogram ticks;
+    TimerWheel timers;
+    uint64_t tick = 0;  // The wheel time of the current iteration.
+
+    // Records how long an iteration ran callbacks for. Idle wakeups with nothing to run are left out.
+    void recordTick(std::chrono::steady_clock::time_point start, bool busy) {
+    #ifndef SKT_NO_STATS
+        if(busy) ticks.record(std::chrono::steady_clock::now() - start);
+    #else
+        (void)start; (void)busy;
+    #endif
+    }
+
+    void armDeadline(const std::shared_ptr<Entry>& entry, Deadline kind, uint64_t delay) {
+        std::weak_ptr<Entry> weak = entry;
+        entry->deadlines[(int)kind].timer = timers.add(std::chrono::milliseconds(delay), [this, weak, kind] { expireDeadline(weak, kind); });
+    }
+
+    // Activity only records a time: the timer itself is moved lazily, when it fires early.
+    void expireDeadline(const std::weak_ptr<Entry>& weak, Deadline kind) {
+        std::shared_ptr<Entry> entry = weak.lock();
+        if(!entry || !entry->active) return;
+        DeadlineState& d = entry->deadlines[(int)kind];
+        d.timer = 0;
+        if(d.timeout == 0) return;
+        // Not waiting to write anymore: `modify()` arms it again when it does.
+        if(kind == Deadline::Write && !(entry->interest & WRITABLE)) return;
+
+        uint64_t quiet = timers.now() - d.lastActive;
+        if(quiet < d.timeout) {
+            armDeadline(entry, kind, d.timeout - quiet);
+            return;
+        }
+        d.timeout = 0;
+        Callback onTimeout = std::move(d.onTimeout);
+        onTimeout();
+    }
+
+#ifdef SO_WINDOWS
+    std::vector<WSAPOLLFD> pollFds;
+    bool dirty = true;
+    sock_t wakeSock = INVALID_SOCKET;
+#else
+    int epfd = -1;
+    int wakeFd = -1;
+    std::vector<epoll_event> events = std::vector<epoll_event>(256);
+
+    static uint32_t toEpoll(uint32_t interest) {
+        uint32_t ev = EPOLLRDHUP;
+        if(interest & READABLE) ev |= EPOLLIN;
+        if(interest & WRITABLE) ev |= EPOLLOUT;
+        if(interest & ONESHOT) ev |= EPOLLONESHOT;
+        return ev;
+    }
+#endif
+
+    void dispatch(const std::shared_ptr<Entry>& entry, bool readable, bool writable, bool hangUp, bool halfClosed) {
+        Handlers& h = entry->handlers;
+        if(entry->deadlines) {
+            if(readable) entry->deadlines[(int)Deadline::Read].lastActive = tick;
+            if(writable) entry->deadlines[(int)Deadline::Write].lastActive = tick;
+            if(readable || writable) entry->deadlines[(int)Deadline::Idle].lastActive = tick;
+        }
+        if(halfClosed && !h.onReadable) hangUp = true;
+        if(entry->interest & ONESHOT) {
+            // The kernel already disarmed it on Linux, WSAPoll needs it left out of the poll set.
+            entry->armed = false;
+        #ifdef SO_WINDOWS
+            dirty = true;
+        #endif
+        }
+
+        if(readable && h.onReadable && entry->active) h.onReadable();
+        if(writable && h.onWritable && entry->active) h.onWritable();
+        if(hangUp && h.onClosed && entry->active) h.onClosed();
+    }
+
+#ifdef SKT_HAS_COROUTINES
+    friend struct detail::IoAwaiter;
+
+    // A coroutine suspended on a socket, until it is ready or `timer` fires.
+    struct Waiter {
+        std::coroutine_handle<> handle;
+        TimerWheel::TimerId timer = 0;
+        bool* timedOut = nullptr;
+    };
+
+    // The coroutines awaiting a socket: one reading and one writing.
+    struct Waiters {
+        Waiter reader, writer;
+    };
+
+    // The sockets registered by awaits. They stay registered between awaits, only their interest changes.
+    std::unordered_map<sock_t, Waiters> waiters;
+
+    // Suspends `handle` until `fd` is ready for `event`, or `timeout` (if not 0) passed.
+    void await(sock_t fd, Event event, std::coroutine_handle<> handle, std::chrono::milliseconds timeout, bool* timedOut) {
+        bool writer = event == WRITABLE;
+        auto it = waiters.find(fd);
+        if(it != waiters.end()) {
+            if((writer ? it->second.writer : it->second.reader).handle) {
+                throw std::runtime_error(writer ? "Socket already awaited for writing" : "Socket already awaited for reading");
+            }
+            try {
+                modify(fd, interest(fd) | event);
+            } catch(const std::system_error& e) {
+                // Closed without being removed, and the descriptor reused since: watch the new socket.
+                if(e.code().value() != ENOENT) throw;
+                remove(fd);
+                it = waiters.end();
+            }
+        }
+        if(it == waiters.end()) {
+            add(fd, event, {[this, fd] { wake(fd, false, false); }, [this, fd] { wake(fd, true, false); }, [this, fd] { hangUp(fd); }});
+            it = waiters.emplace(fd, Waiters{}).first;
+        }
+
+        Waiter& w = writer ? it->second.writer : it->second.reader;
+        w.handle = handle;
+        w.timedOut = timedOut;
+        if(timeout.count() > 0) w.timer = timers.add(timeout, [this, fd, writer] { wake(fd, writer, true); });
+    }
+
+    // Stops waiting for the event of one waiter, and resumes it.
+    void wake(sock_t fd, bool writer, bool expired) {
+        auto it = waiters.find(fd);
+        if(it == waiters.end()) return;
+        Waiter w = std::exchange(writer ? it->second.writer : it->second.reader, Waiter{});
+        if(!w.handle) return;
+        if(expired) *w.timedOut = true;
+        else timers.cancel(w.timer);
+        modify(fd, interest(fd) & ~(uint32_t)(writer ? WRITABLE : READABLE));
+        w.handle.resume();
+    }
+
+    // Resumes both waiters, to see the error. With nobody waiting, stops watching: a hang up would fire on every tick.
+    void hangUp(sock_t fd) {
+        auto it = waiters.find(fd);
+        if(it == waiters.end()) return;
+        if(!it->second.reader.handle && !it->second.writer.handle) {
+            remove(fd);
+            return;
+        }
+        wake(fd, false, false);
+        wake(fd, true, false);
+    }
+#endif
+
+    void wakeup() {
+    #ifdef SO_WINDOWS
+        char byte = 0;
+        ::send(wakeSock, &byte, 1, 0);
+    #else
+        uint64_t one = 1;
+        if(::write(wakeFd, &one, sizeof(one)) < 0) {}
+    #endif
+    }
+
+    void runPosted() {
+        std::vector<Callback> batch;
+        {
+            std::lock_guard<std::mutex> lock(postedMutex);
+            batch.swap(posted);
+        }
+        for(auto& fn : batch) fn();
+    }
+
+    void runDeferred() {
+        // Callbacks deferred from here run on the next tick, which then doesn't wait.
+        std::vector<Callback> batch;
+        batch.swap(deferred);
+        for(auto& fn : batch) fn();
+    }
+
+    void drainWakeup() {
+    #ifdef SO_WINDOWS
+        char buf[64];
+        while(::recv(wakeSock, buf, sizeof(buf), 0) > 0) {}
+    #else
+        uint64_t count;
+        if(::read(wakeFd, &count, sizeof(count)) < 0) {}
+    #endif
+    }
+
+public:
+
+    // Creates the loop.
+    /**
+     *
+     * @brief Creates the underlying poller (epoll instance on Linux).
+     *
+     * @throw `std::runtime_error()` if the poller can't be created.
+     *
+     */
+    EventLoop() {
+        detail::startNetworking();
+    #ifdef SO_WINDOWS
+        // A loopback UDP socket connected to itself, used to wake WSAPoll from stop().
+        wakeSock = ::socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in self{};
+        int selfLen = sizeof(self);
+        self.sin_family = AF_INET;
+        self.sin_addr.s_addr = inet_addr(LOCALHOST);
+        u_long nonBlocking = 1;
+        if(wakeSock == INVALID_SOCKET
+            || ::bind(wakeSock, (struct sockaddr *)&self, sizeof(self)) < 0
+            || getsockname(wakeSock, (struct sockaddr *)&self, &selfLen) < 0
+            || ::connect(wakeSock, (struct sockaddr *)&self, sizeof(self)) < 0
+            || ioctlsocket(wakeSock, FIONBIO, &nonBlocking) != 0) {
+            detail::throwLastError("Error creating event loop");
+        }
+    #else
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(epfd < 0 || wakeFd < 0) {
+            detail::throwLastError("Error creating event loop");
+        }
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeFd;
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, wakeFd, &ev) < 0) {
+            detail::throwLastError("Error creating event loop");
+        }
+    #endif
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    ~EventLoop() {
+    #ifdef SO_WINDOWS
+        closesocket(wakeSock);
+    #else
+        ::close(wakeFd);
+        ::close(epfd);
+    #endif
+    }
+
+    // Watches a socket.
+    /**
+     *
+     * @brief ## Starts watching a socket.
+     *
+     * @param fd       The socket file descriptor. `skt::Node` converts to it, for a `skt::Socket` use `getSocket()`.
+     * @param interest The events to watch for, ex: `skt::READABLE | skt::WRITABLE`. `skt::CLOSED` is always watched.
+     * @param handlers The callbacks to call when the socket is ready.
+     *
+     * @throw `std::runtime_error()` if the socket is already watched, or can't be watched.
+     *
+     */
+    void add(sock_t fd, uint32_t interest, Handlers handlers) {
+        if(entries.count(fd)) {
+            throw std::runtime_error("Socket already added to the event loop");
+        }
+
+        auto entry = std::make_shared<Entry>();
+        entry->fd = fd;
+        entry->interest = interest;
+        entry->handlers = std::move(handlers);
+
+    #ifdef SO_WINDOWS
+        dirty = true;
+    #else
+        epoll_event ev{};
+        ev.events = toEpoll(interest);
+        ev.data.fd = fd;
+        if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            detail::throwLastError("Error adding socket to the event loop");
+        }
+    #endif
+        entries.emplace(fd, std::move(entry));
+    }
+
+    // Changes the watched events of a socket.
+    /**
+     *
+     * @brief ## Changes what a watched socket is waiting for.
+     *
+     * @param fd       The socket file descriptor.
+     * @param interest The new events to watch for. Ex: add `skt::WRITABLE` only while there is pending data to send.
+     *                 For a `skt::ONESHOT` socket, also re-arms it.
+     *
+     * @throw `std::runtime_error()` if the socket is not watched, or can't be modified.
+     *
+     */
+    void modify(sock_t fd, uint32_t interest) {
+        auto it = entries.find(fd);
+        if(it == entries.end()) {
+            throw std::runtime_error("Socket not added to the event loop");
+        }
+        // One-shot sockets are re-armed even with the same interest.
+        if(it->second->interest == interest && !(interest & ONESHOT)) return;
+        bool startsWriting = (interest & WRITABLE) && !(it->second->interest & WRITABLE);
+        it->second->interest = interest;
+        it->second->armed = true;
+
+        if(startsWriting && it->second->deadlines) {
+            DeadlineState& d = it->second->deadlines[(int)Deadline::Write];
+            d.lastActive = timers.now();
+            if(d.timeout && !d.timer) armDeadline(it->second, Deadline::Write, d.timeout);
+        }
+
+    #ifdef SO_WINDOWS
+        dirty = true;
+    #else
+        epoll_event ev{};
+        ev.events = toEpoll(interest);
+        ev.data.fd = fd;
+        if(epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+            detail::throwLastError("Error modifying socket on the event loop");
+        }
+    #endif
+    }
+
+    // Stops watching a socket.
+    /**
+     *
+     * @brief ## Stops watching a socket. Does nothing if it is not watched.
+     *
+     * @param fd The socket file descriptor.
+     *
+     * @note Pending callbacks of the socket are dropped, even inside the current dispatch.
+     *
+     */
+    void remove(sock_t fd) {
+        auto it = entries.find(fd);
+        if(it == entries.end()) return;
+
+        it->second->active = false;
+        if(it->second->deadlines) {
+            for(int kind = 0; kind < 3; kind++) timers.cancel(it->second->deadlines[kind].timer);
+        }
+        entries.erase(it);
+    #ifdef SKT_HAS_COROUTINES
+        auto awaited = waiters.find(fd);
+        if(awaited != waiters.end()) {
+            timers.cancel(awaited->second.reader.timer);
+            timers.cancel(awaited->second.writer.timer);
+            waiters.erase(awaited);
+        }
+    #endif
+    #ifdef SO_WINDOWS
+        dirty = true;
+    #else
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+    #endif
+    }
+
+    // Waits for events once, and dispatches them.
+    /**
+     *
+     * @brief ## Waits for ready sockets once, and calls their callbacks. Then runs the code queued with `post()`, then with `defer()`.
+     *
+     * @param timeoutMs How long to wait, in milliseconds. -1 waits forever, 0 returns immediately.
+     *
+     * @return The number of sockets that were ready.
+     *
+     * @throw `std::runtime_error()` if waiting fails.
+     *
+     */
+    int runOnce(int timeoutMs=-1) {
+        bool hadDeferred = !deferred.empty();
+        if(hadDeferred) timeoutMs = 0;
+        int timerMs = timers.nextTimeout();
+        if(timerMs >= 0 && (timeoutMs < 0 || timerMs < timeoutMs)) timeoutMs = timerMs;
+    #ifdef SO_WINDOWS
+        if(dirty) {
+            pollFds.clear();
+            pollFds.push_back({wakeSock, POLLRDNORM, 0});
+            for(auto& kv : entries) {
+                if(!kv.second->armed) continue;
+                short ev = 0;
+                if(kv.second->interest & READABLE) ev |= POLLRDNORM;
+                if(kv.second->interest & WRITABLE) ev |= POLLWRNORM;
+                pollFds.push_back({kv.first, ev, 0});
+            }
+            dirty = false;
+        }
+
+        int ready = WSAPoll(pollFds.data(), (ULONG)pollFds.size(), timeoutMs);
+        if(ready < 0) {
+            detail::throwLastError("Error waiting for events");
+        }
+        auto tickStart = detail::statsClock();
+        tick = timers.now();
+
+        // Dispatch from a copy, callbacks may rebuild the poll set.
+        std::vector<WSAPOLLFD> fired;
+        for(auto& pfd : pollFds) {
+            if(pfd.revents) fired.push_back(pfd);
+        }
+
+        int dispatched = 0;
+        for(auto& pfd : fired) {
+            if(pfd.fd == wakeSock) { drainWakeup(); continue; }
+
+            auto it = entries.find(pfd.fd);
+            if(it == entries.end()) continue;
+            auto entry = it->second;
+
+            dispatch(entry, pfd.revents & POLLRDNORM, pfd.revents & POLLWRNORM,
+                     pfd.revents & (POLLHUP | POLLERR | POLLNVAL), false);
+            dispatched++;
+        }
+        size_t timersFired = timers.advance();
+        runPosted();
+        runDeferred();
+        recordTick(tickStart, ready > 0 || hadDeferred || timersFired > 0);
+        return dispatched;
+    #else
+        int ready = epoll_wait(epfd, events.data(), (int)events.size(), timeoutMs);
+        if(ready < 0) {
+            if(errno != EINTR) detail::throwLastError("Error waiting for events");
+            ready = 0;
+        }
+        auto tickStart = detail::statsClock();
+        tick = timers.now();
+
+        int dispatched = 0;
+        for(int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            uint32_t ev = events[i].events;
+            if(fd == wakeFd) { drainWakeup(); continue; }
+
+            auto it = entries.find(fd);
+            if(it == entries.end()) continue;
+            auto entry = it->second;
+
+            dispatch(entry, ev & EPOLLIN, ev & EPOLLOUT, ev & (EPOLLHUP | EPOLLERR), ev & EPOLLRDHUP);
+            dispatched++;
+        }
+
+        if(ready == (int)events.size()) events.resize(events.size() * 2);
+        size_t timersFired = timers.advance();
+        runPosted();
+        runDeferred();
+        recordTick(tickStart, ready > 0 || hadDeferred || timersFired > 0);
+        return dispatched;
+    #endif
+    }
+
+    // Runs the loop.
+    /**
+     *
+     * @brief ## Dispatches events until `stop()` is called.
+     *
+     * @throw `std::runtime_error()` if waiting fails.
+     *
+     * @note A `stop()` from another thread before `run()` started is not lost: `run()` returns at once. Stops don't add up, one ends the next `run()`.
+     *
+     */
+    void run() {
+        while(!stopRequested) {
+            runOnce(-1);
+        }
+        stopRequested = false;
+    }
+
+    // Runs code on the loop thread.
+    /**
+     *
+     * @brief ## Queues `fn` to run on the loop thread, after the current or next dispatch. Wakes the loop if it is waiting.
+     *
+     * @param fn The code to run.
+     *
+     * @note Safe to call from any thread. This is how other threads add, modify or remove sockets.
+     *
+     */
+    void post(Callback fn) {
+        {
+            std::lock_guard<std::mutex> lock(postedMutex);
+            posted.push_back(std::move(fn));
+        }
+        wakeup();
+    }
+
+    // Runs code at the end of the current tick.
+    /**
+     *
+     * @brief ## Queues `fn` to run once the ready sockets of this tick were dispatched. Ex: to send everything written during the tick in one call.
+     *
+     * @param fn The code to run.
+     *
+     * @note Not thread-safe: call it from the loop thread, other threads use `post()`. If called outside of a tick, the next `runOnce()` does not wait.
+     *
+     */
+    void defer(Callback fn) {
+        deferred.push_back(std::move(fn));
+    }
+
+    // Stops the loop.
+    /**
+     *
+     * @brief ## Makes `run()` return after the current dispatch, or right away if it was not running yet.
+     *
+     * @note Safe to call from any thread, or from inside a callback.
+     *
+     */
+    void stop() {
+        stopRequested = true;
+        wakeup();
+    }
+
+    // Returns the events a socket is watched for, or 0 if it is not watched.
+    uint32_t interest(sock_t fd) const {
+        auto it = entries.find(fd);
+        return it == entries.end() ? 0 : it->second->interest;
+    }
+
+    // Replaces one callback of a watched socket.
+    /**
+     *
+     * @brief ## Replaces the callback of one event, keeping the others. Ex: a write queue taking over `onWritable`.
+     *
+     * @param fd    The socket file descriptor.
+     * @param event `skt::READABLE`, `skt::WRITABLE` or `skt::CLOSED`.
+     * @param fn    The new callback, or nullptr to clear it.
+     *
+     * @returns The callback it replaced, to restore it later.
+     *
+     * @throw `std::runtime_error()` if the socket is not watched.
+     *
+     */
+    Callback setHandler(sock_t fd, Event event, Callback fn) {
+        auto it = entries.find(fd);
+        if(it == entries.end()) {
+            throw std::runtime_error("Socket not added to the event loop");
+        }
+        Handlers& h = it->second->handlers;
+        if(event == READABLE) return std::exchange(h.onReadable, std::move(fn));
+        if(event == WRITABLE) return std::exchange(h.onWritable, std::move(fn));
+        if(event == CLOSED) return std::exchange(h.onClosed, std::move(fn));
+        return nullptr;
+    }
+
+    // Sets a deadline on a watched socket.
+    /**
+     *
+     * @brief ## Calls `onTimeout` if the socket stays quiet for `timeout`. See `skt::Deadline` for what counts as activity.
+     *
+     * @param fd        The watched socket.
+     * @param kind      `skt::Deadline::Read`, `Write` or `Idle`. Each socket can have one of each.
+     * @param timeout   How long the socket may stay quiet. 0 clears the deadline.
+     * @param onTimeout Called once, on the loop thread, when the deadline passes. Ex: removes and closes the socket.
+     *
+     * @throw `std::runtime_error()` if the socket is not watched.
+     *
+     * @note Activity only stores the time: an active socket costs no timer operation per event, its timer is moved when it fires early.
+     * @note Fires at most once: set it again to keep enforcing it. Removing the socket cancels its deadlines.
+     *
+     */
+    void setDeadline(sock_t fd, Deadline kind, std::chrono::milliseconds timeout, Callback onTimeout) {
+        auto it = entries.find(fd);
+        if(it == entries.end()) {
+            throw std::runtime_error("Socket not added to the event loop");
+        }
+        Entry& entry = *it->second;
+        if(!entry.deadlines) {
+            if(timeout.count() <= 0) return;
+            entry.deadlines.reset(new DeadlineState[3]);
+        }
+
+        DeadlineState& d = entry.deadlines[(int)kind];
+        timers.cancel(d.timer);
+        d.timer = 0;
+        d.timeout = timeout.count() > 0 ? (uint64_t)timeout.count() : 0;
+        d.onTimeout = std::move(onTimeout);
+        d.lastActive = timers.now();
+        if(d.timeout && (kind != Deadline::Write || (entry.interest & WRITABLE))) {
+            armDeadline(it->second, kind, d.timeout);
+        }
+    }
+
+    // Adds a timer.
+    /**
+     *
+     * @brief ## Calls `callback` on the loop thread once `delay` has passed. The loop wakes up for it.
+     *
+     * @returns The id of the timer, for `cancelTimer()` and `resetTimer()`.
+     *
+     * @note O(1), see `skt::TimerWheel`. Millisecond resolution. Loop thread only, other threads `post()` it.
+     *
+     */
+    TimerWheel::TimerId addTimer(std::chrono::milliseconds delay, Callback callback) {
+        return timers.add(delay, std::move(callback));
+    }
+
+    // Cancels a timer. Returns false if it already fired, or was cancelled.
+    bool cancelTimer(TimerWheel::TimerId id) {
+        return timers.cancel(id);
+    }
+
+    // Moves a pending timer to `delay` from now. Returns false if it already fired, or was cancelled.
+    bool resetTimer(TimerWheel::TimerId id, std::chrono::milliseconds delay) {
+        return timers.reset(id, delay);
+    }
+
+    // Returns the number of watched sockets.
+    size_t size() const {
+        return entries.size();
+    }
+
+    // Returns how long the loop iterations took, from the wakeup to the last callback. Safe to read from any thread.
+    const LatencyHistogram& tickLatency() const {
+        return ticks;
+    }
+};
+
+// WriteQueue class.
+/**
+ *
+ * @brief ## `skt::WriteQueue`
+ *
+ * @param loop          The event loop the socket is on.
+ * @param fd            The socket to write to, non-blocking. `skt::Node` converts to it.
+ * @param highWatermark Queued bytes above which `write()` returns false, and `onHighWatermark` is called. If not set, fallback to 1MB.
+ * @param lowWatermark  Queued bytes under which, after going above the high watermark, `onLowWatermark` is called. If not set, fallback to 256KB.
+ *
+ * @note - An outbound queue for one connection: writes are queued, and everything written during an event loop tick goes out in one vectored send at the end of it.
+ * @note - Owned buffers are taken by move (`write(std::move(str))`) and shared ones by reference count, with no copy. Small views are copied, and packed together.
+ * @note - When the kernel buffer is full, the queue watches the socket for `skt::WRITABLE` and resumes by itself. If the socket is already on the loop, its `onWritable` callback still runs (after the queue's flush, if it was watching for `skt::WRITABLE`), and it is put back after.
+ * @note - Backpressure: stop producing when `write()` returns false, or on `onHighWatermark`, and start again on `onLowWatermark`.
+ * @note - Not thread-safe: use it from the loop thread, other threads go through `EventLoop::post()`. Destroy it before the socket is closed.
+ * @note #### Examples:
+ * @note `skt::WriteQueue out(loop, node);` - A queue for an accepted, non-blocking node.
+ * @note `out.write(std::move(response));` - Queued without copy, sent at the end of the tick.
+ * @note `out.onLowWatermark = [&]{ loop.modify(node, skt::READABLE); };` - Resume reading requests once the backlog drained.
+ *
+ */
+class WriteQueue {
+public:
+    using Callback = std::function<void()>;
+
+    Callback onHighWatermark;  // The queue went above the high watermark.
+    Callback onLowWatermark;   // The queue went back under the low watermark.
+    Callback onError;          // A send failed. The queue is dropped, and later writes are ignored.
+
+private:
+    struct Chunk {
+        std::string owned;
+        std::shared_ptr<const std::string> shared;
+
+        std::string_view data() const { return shared ? std::string_view(*shared) : std::string_view(owned); }
+    };
+
+    // Views up to this size are copied into the previous chunk, instead of making a chunk of their own.
+    static const size_t PACK_SIZE = 16 * 1024;
+
+    EventLoop& loop;
+    sock_t fd;
+    size_t highWatermark, lowWatermark;
+
+    std::deque<Chunk> chunks;
+    size_t offset = 0;   // Bytes of the first chunk already sent.
+    size_t queued = 0;   // Bytes not sent yet.
+    bool scheduled = false;
+    bool watching = false;    // Waiting for WRITABLE, the kernel buffer was full.
+    bool registered = false;  // Added the socket to the loop itself.
+    Callback savedWritable;   // The socket's own `onWritable`, while watching.
+    bool savedInterest = false;  // Whether the socket was watched for WRITABLE before.
+    bool above = false;
+    bool failed = false;
+    std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+
+    void schedule() {
+        if(scheduled || watching || failed) return;
+        scheduled = true;
+        std::weak_ptr<bool> token = alive;
+        loop.defer([this, token] {
+            if(token.expired()) return;
+            scheduled = false;
+            flush();
+        });
+    }
+
+    void queue(Chunk chunk, size_t size) {
+        chunks.push_back(std::move(chunk));
+        queued += size;
+    }
+
+    bool afterWrite() {
+        schedule();
+        if(queued > highWatermark) {
+            if(!above) {
+                above = true;
+                if(onHighWatermark) onHighWatermark();
+            }
+            return false;
+        }
+        return true;
+    }
+
+    void consume(size_t sent) {
+        queued -= sent;
+        while(sent > 0) {
+            size_t left = chunks.front().data().size() - offset;
+            if(sent < left) { offset += sent; return; }
+            sent -= left;
+            chunks.pop_front();
+            offset = 0;
+        }
+    }
+
+    void watchWritable() {
+        watching = true;
+        std::weak_ptr<bool> token = alive;
+        Callback resume = [this, token] {
+            if(token.expired()) return;
+            // A copy: the flush may put it back, and it may destroy the queue.
+            Callback own = savedInterest ? savedWritable : nullptr;
+            flush();
+            if(own) own();
+        };
+        uint32_t interest = loop.interest(fd);
+        if(interest == 0) {
+            loop.add(fd, WRITABLE, {nullptr, resume, nullptr});
+            registered = true;
+        } else {
+            savedInterest = (interest & WRITABLE) != 0;
+            savedWritable = loop.setHandler(fd, WRITABLE, resume);
+            loop.modify(fd, interest | WRITABLE);
+        }
+    }
+
+    void unwatchWritable() {
+        watching = false;
+        if(registered) {
+            loop.remove(fd);
+            registered = false;
+            return;
+        }
+        uint32_t interest = loop.interest(fd);
+        if(interest != 0) {
+            loop.setHandler(fd, WRITABLE, std::move(savedWritable));
+            if(!savedInterest) loop.modify(fd, interest & ~WRITABLE);
+        }
+        savedWritable = nullptr;
+        savedInterest = false;
+    }
+
+    void fail() {
+        if(watching) unwatchWritable();
+        failed = true;
+        chunks.clear();
+        queued = offset = 0;
+        if(onError) onError();
+    }
+
+public:
+
+    WriteQueue(EventLoop& loop, sock_t fd, size_t highWatermark=1 << 20, size_t lowWatermark=256 << 10)
+        : loop(loop), fd(fd), highWatermark(highWatermark), lowWatermark(std::min(lowWatermark, highWatermark)) {}
+
+    WriteQueue(const WriteQueue&) = delete;
+    WriteQueue& operator=(const WriteQueue&) = delete;
+
+    ~WriteQueue() {
+        if(watching) unwatchWritable();
+    }
+
+    // Queues data.
+    /**
+     *
+     * @brief ## Queues `data`, to be sent at the end of the current tick.
+     *
+     * @param data The data. A `std::string&&` is taken without copy, a `std::shared_ptr<const std::string>` is shared, anything else is copied.
+     *
+     * @returns False if the queue is above the high watermark (the data is queued anyway), or the queue failed (the data is dropped).
+     *
+     */
+    bool write(std::string&& data) {
+        if(failed) return false;
+        if(data.empty()) return true;
+        // Its own chunk, whatever its size: packing it would copy it. Small views written next are packed into it.
+        size_t size = data.size();
+        queue({std::move(data), nullptr}, size);
+        return afterWrite();
+    }
+
+    bool write(std::string_view data) {
+        if(failed) return false;
+        if(data.empty()) return true;
+        if(!chunks.empty() && !chunks.back().shared && chunks.back().owned.size() + data.size() <= PACK_SIZE) {
+            chunks.back().owned += data;
+            queued += data.size();
+        } else {
+            queue({std::string(data), nullptr}, data.size());
+        }
+        return afterWrite();
+    }
+
+    bool write(const char* data) {
+        return write(std::string_view(data));
+    }
+
+    bool write(std::shared_ptr<const std::string> data) {
+        if(failed) return false;
+        if(!data || data->empty()) return true;
+        size_t size = data->size();
+        queue({std::string(), std::move(data)}, size);
+        return afterWrite();
+    }
+
+    // Sends now.
+    /**
+     *
+     * @brief ## Sends as much of the queue as the kernel takes now, in vectored calls of up to `skt::detail::MAX_IOV` buffers.
+     *
+     * @note Called at the end of each tick with queued data, no need to call it. If the kernel buffer fills up, resumes when the socket is writable.
+     *
+     */
+    void flush() {
+        if(failed) return;
+        std::string_view parts[detail::MAX_IOV];
+        while(!chunks.empty()) {
+            size_t count = std::min(chunks.size(), detail::MAX_IOV);
+            for(size_t i = 0; i < count; i++) parts[i] = chunks[i].data();
+
+            long sent;
+            try {
+                sent = detail::trySendv(fd, parts, count, offset);
+            } catch(const std::runtime_error&) {
+                fail();
+                return;
+            }
+            if(sent == WOULD_BLOCK) break;
+            consume(sent);
+        }
+
+        if(above && queued <= lowWatermark) {
+            above = false;
+            if(onLowWatermark) onLowWatermark();
+        }
+        if(chunks.empty() && watching) unwatchWritable();
+        else if(!chunks.empty() && !watching) watchWritable();
+    }
+
+    // Returns the bytes queued, not sent yet.
+    size_t pending() const {
+        return queued;
+    }
+
+    // True while above the high watermark, until back under the low one.
+    bool isFull() const {
+        return above;
+    }
+
+    // True if a send failed.
+    bool hasFailed() const {
+        return failed;
+    }
+};
+
+// Group class.
+/**
+ *
+ * @brief ## `skt::Group`
+ *
+ * @param loop       The event loop the members are on.
+ * @param policy     What to do with a member that is too far behind. See `skt::Group::SlowPolicy`. If not set, fallback to `Drop`.
+ * @param maxPending Bytes queued for a member above which it counts as slow. If not set, fallback to 1MB.
+ *
+ * @note - A set of connections to publish to: `broadcast()` queues one immutable, reference counted buffer to every member, with no copy per member.
+ * @note - Each member has its own `skt::WriteQueue`: what is broadcast during a tick goes out in one vectored send per member, at the end of it.
+ * @note - A slow consumer never holds the others back: past `maxPending`, it misses messages (`Drop`), or is removed (`Disconnect`).
+ * @note - Members whose send failed are removed too, and reported to `onRemoved`. The group does not own the sockets: close them there.
+ * @note - Not thread-safe: use it from the loop thread, other threads go through `EventLoop::post()`.
+ * @note #### Examples:
+ * @note `skt::Group room(loop, skt::Group::SlowPolicy::Disconnect);` - A chat room that kicks out clients that don't keep up.
+ * @note `room.add(*node);` - Joins a non-blocking node.
+ * @note `room.broadcast(std::move(message), *sender);` - Sends to every member but the sender.
+ *
+ */
+class Group {
+public:
+    // What `broadcast()` does with a member that has more than `maxPending` bytes queued.
+    enum class SlowPolicy {
+        Drop,        // Skips it for this message: it gets the next ones once it catches up.
+        Disconnect,  // Removes it from the group, and calls `onRemoved`.
+    };
+
+    // A member was removed by the group: its send failed, or it was too slow with `Disconnect`.
+    std::function<void(sock_t fd)> onRemoved;
+
+private:
+    struct Member {
+        WriteQueue queue;
+        uint64_t dropped = 0;
+
+        Member(EventLoop& loop, sock_t fd, size_t maxPending) : queue(loop, fd, SIZE_MAX, maxPending) {}
+    };
+
+    EventLoop& loop;
+    SlowPolicy policy;
+    size_t maxPending;
+    std::unordered_map<sock_t, std::shared_ptr<Member>> members;
+    std::vector<sock_t> slow;
+    uint64_t dropped = 0;
+    std::shared_ptr<bool> alive = std::make_shared<bool>(true);
+
+    void removed(sock_t fd) {
+        if(onRemoved) onRemoved(fd);
+    }
+
+public:
+
+    Group(EventLoop& loop, SlowPolicy policy=SlowPolicy::Drop, size_t maxPending=1 << 20)
+        : loop(loop), policy(policy), maxPending(maxPending) {}
+
+    Group(const Group&) = delete;
+    Group& operator=(const Group&) = delete;
+
+    // Adds a member.
+    /**
+     *
+     * @brief ## Adds a connection to the group. It gets the messages broadcast from now on.
+     *
+     * @param fd The socket, non-blocking. `skt::Node` converts to it. It may already be on the loop, for reading.
+     *
+     * @returns False if it was already a member.
+     *
+     */
+    bool add(sock_t fd) {
+        if(members.count(fd)) return false;
+        auto member = std::make_shared<Member>(loop, fd, maxPending);
+        std::weak_ptr<Member> weak = member;
+        std::weak_ptr<bool> token = alive;
+        // Removed later: the queue is still running when it reports the error.
+        member->queue.onError = [this, token, weak, fd] {
+            loop.defer([this, token, weak, fd] {
+                if(token.expired()) return;
+                auto it = members.find(fd);
+                if(it == members.end() || it->second != weak.lock()) return;
+                members.erase(it);
+                removed(fd);
+            });
+        };
+        members.emplace(fd, std::move(member));
+        return true;
+    }
+
+    // Removes a member, dropping what is still queued for it. Returns false if it was not a member. Call it before closing the socket.
+    bool remove(sock_t fd) {
+        return members.erase(fd) > 0;
+    }
+
+    // Sends to every member.
+    /**
+     *
+     * @brief ## Queues `data` to every member, to be sent at the end of the current tick.
+     *
+     * @param data   The message. Shared by all the members, and freed once the last one sent it.
+     * @param except A member to leave out, ex: the sender. If not set, sends to all.
+     *
+     * @returns The number of members it was queued to.
+     *
+     * @note Members with more than `maxPending` bytes the kernel did not take yet are skipped, or removed, depending on the policy. `onRemoved` is called after the message was queued to the others.
+     *
+     */
+    size_t broadcast(std::shared_ptr<const std::string> data, sock_t except=INVALID_SOCKET) {
+        if(!data || data->empty()) return 0;
+        size_t sent = 0;
+        for(auto& [fd, member] : members) {
+            if(fd == except || member->queue.hasFailed()) continue;
+            // Only what the kernel refused counts: a burst within one tick is not sent yet, send it before judging.
+            if(member->queue.pending() > maxPending) member->queue.flush();
+            if(member->queue.hasFailed()) continue;
+            if(member->queue.pending() > maxPending) {
+                member->dropped++;
+                dropped++;
+                if(policy == SlowPolicy::Disconnect) slow.push_back(fd);
+                continue;
+            }
+            member->queue.write(data);
+            sent++;
+        }
+
+        if(!slow.empty()) {
+            std::vector<sock_t> kicked;
+            kicked.swap(slow);
+            for(sock_t fd : kicked) members.erase(fd);
+            for(sock_t fd : kicked) removed(fd);
+        }
+        return sent;
+    }
+
+    size_t broadcast(std::string&& data, sock_t except=INVALID_SOCKET) {
+        return broadcast(std::make_shared<const std::string>(std::move(data)), except);
+    }
+
+    size_t broadcast(std::string_view data, sock_t except=INVALID_SOCKET) {
+        return broadcast(std::make_shared<const std::string>(data), except);
+    }
+
+    // Returns the queue of a member, to send it something of its own, in order with the broadcasts. Throws `std::runtime_error()` if not a member.
+    WriteQueue& queueOf(sock_t fd) {
+        auto it = members.find(fd);
+        if(it == members.end()) {
+            throw std::runtime_error("Socket not in the group");
+        }
+        return it->second->queue;
+    }
+
+    // True if `fd` is a member.
+    bool contains(sock_t fd) const {
+        return members.count(fd) > 0;
+    }
+
+    // Returns the number of members.
+    size_t size() const {
+        return members.size();
+    }
+
+    // Returns how many messages were skipped for slow members, in total, or for one member.
+    uint64_t droppedCount() const {
+        return dropped;
+    }
+
+    uint64_t droppedCount(sock_t fd) const {
+        auto it = members.find(fd);
+        return it == members.end() ? 0 : it->second->dropped;
+    }
+};
+
+// Returns the CPUs this process may run on, in order. Ex: `skt::Acceptor acceptor(49110, ANY_ADDR, 0, skt::MAX_BACKLOG, {}, skt::availableCpus());`
+inline std::vector<int> availableCpus() {
+    std::vector<int> cpus;
+#ifdef SO_WINDOWS
+    DWORD_PTR process, system;
+    if(GetProcessAffinityMask(GetCurrentProcess(), &process, &system)) {
+        for(int i = 0; i < (int)sizeof(DWORD_PTR) * 8; i++) {
+            if(process & ((DWORD_PTR)1 << i)) cpus.push_back(i);
+        }
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int i = 0; i < CPU_SETSIZE; i++) {
+            if(CPU_ISSET(i, &set)) cpus.push_back(i);
+        }
+    }
+#endif
+    for(int i = 0; cpus.empty() && i < (int)std::max(1u, std::thread::hardware_concurrency()); i++) cpus.push_back(i);
+    return cpus;
+}
+
+// Returns the CPUs of a NUMA node, ex: to keep every worker next to the memory and the NIC of node 0. Empty if there is no such node.
+inline std::vector<int> cpusOfNode(int node) {
+    std::vector<int> cpus;
+#ifdef SO_WINDOWS
+    ULONGLONG mask = 0;
+    if(node >= 0 && node < 256 && GetNumaNodeProcessorMask((UCHAR)node, &mask)) {
+        for(int i = 0; i < 64; i++) {
+            if(mask & (1ull << i)) cpus.push_back(i);
+        }
+    }
+#else
+    // A list of ranges, ex: "0-7,16-23".
+    std::string path = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+    FILE* file = node >= 0 ? std::fopen(path.c_str(), "r") : nullptr;
+    if(file == nullptr) return cpus;
+    int first, last;
+    while(std::fscanf(file, "%d", &first) == 1) {
+        last = first;
+        int c = std::fgetc(file);
+        if(c == '-' && std::fscanf(file, "%d", &last) == 1) c = std::fgetc(file);
+        for(int i = first; i <= last; i++) cpus.push_back(i);
+        if(c != ',') break;
+    }
+    std::fclose(file);
+#endif
+    return cpus;
+}
+
+// Returns the NUMA node of a CPU. 0 on machines without NUMA, -1 if the CPU is unknown.
+inline int numaNode(int cpu) {
+#ifdef SO_WINDOWS
+    UCHAR node;
+    if(cpu < 0 || cpu > 255 || !GetNumaProcessorNode((UCHAR)cpu, &node)) return -1;
+    return node;
+#else
+    bool numa = false;
+    for(int node = 0; node < 64; node++) {
+        std::vector<int> cpus = cpusOfNode(node);
+        numa = numa || !cpus.empty();
+        if(std::find(cpus.begin(), cpus.end(), cpu) != cpus.end()) return node;
+    }
+    return numa || cpu < 0 ? -1 : 0;
+#endif
+}
+
+// Returns the CPU the calling thread is running on, -1 if unknown. It can change right after, unless the thread is pinned.
+inline int currentCpu() {
+#ifdef SO_WINDOWS
+    return (int)GetCurrentProcessorNumber();
+#else
+    return sched_getcpu();
+#endif
+}
+
+// Pins the calling thread.
+/**
+ *
+ * @brief ## Restricts the calling thread to `cpu`: the scheduler no longer moves it, so its caches, and its memory, stay local.
+ *
+ * @returns False if it can't be pinned. Ex: the CPU is not in the process affinity set, like in a container limited with `--cpuset-cpus`.
+ *
+ * @note Memory is placed on the NUMA node of the thread that first writes it (first touch): allocate per-thread buffers after pinning.
+ *
+ */
+inline bool pinThread(int cpu) {
+#ifdef SO_WINDOWS
+    if(cpu < 0 || cpu >= (int)sizeof(DWORD_PTR) * 8) return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#else
+    if(cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+// Acceptor class.
+/**
+ *
+ * @brief ## `skt::Acceptor`
+ *
+ * @param port    The port to listen on. Must be set, as every worker binds its own socket to it.
+ * @param ip      The ip to bind. If not set, fallback to 0.0.0.0
+ * @param threads How many worker threads. If not set, or 0, one per core.
+ * @param backlog How many connections each worker queues until dropping requisitions. If not set, fallback to `skt::MAX_BACKLOG`.
+ * @param options Options for the listening sockets, inherited by the accepted connections. See `skt::SocketOptions`.
+ * @param cpus    The CPU to pin each worker to, wrapped if there are more workers, ex: `skt::availableCpus()`. If not set, workers are not pinned.
+ *
+ * @throw `std::runtime_error()` if a listening socket can't be created. Ex: port in use without `SO_REUSEPORT`.
+ *
+ * @note - A multi-threaded server front: N workers, each with its own non-blocking listening `skt::Socket` and its own `skt::EventLoop`.
+ * @note - On Linux, every socket is bound with `SO_REUSEPORT`, so the kernel spreads new connections across workers, and accepts scale with cores.
+ * @note - On Windows, where `SO_REUSEPORT` does not exist, the workers share a single listening socket.
+ * @note - The callback runs on the worker that accepted the connection, with its loop: register the node there, and it stays on that thread.
+ * @note - Placement: pinned workers keep their connections on one core. `steerByCpu()` also hands each connection to the worker on the core that took its interrupts,
+ * @note   and `bufferPool()` gives each worker buffers from its own NUMA node.
+ * @note #### Examples:
+ * @note `skt::Acceptor acceptor(49110);` - One worker per core, all listening on port 49110.
+ * @note `skt::Acceptor acceptor(49110, ANY_ADDR, 8, skt::MAX_BACKLOG, {}, skt::cpusOfNode(0));` - 8 workers pinned to the cores of NUMA node 0.
+ * @note `acceptor.start([](skt::Node node, skt::EventLoop& loop) { ... });` - Starts the workers.
+ * @note `acceptor.stop();` - Stops and joins the workers. Also done by the destructor.
+ *
+ */
+class Acceptor {
+public:
+    // Called for every accepted connection, on the worker thread that accepted it.
+    using OnConnection = std::function<void(Node&& node, EventLoop& loop)>;
+
+private:
+    struct Worker {
+        std::unique_ptr<Socket> socket;  // Null if sharing the first worker's socket.
+        Socket* listener = nullptr;
+        EventLoop loop;
+        std::thread thread;
+        int cpu = -1;                    // -1 if not pinned.
+        std::unique_ptr<BufferPool> pool;
+        std::exception_ptr error;        // What ended the worker, rethrown by `stop()`.
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    OnConnection onConnection;
+
+    static Worker*& currentWorker() {
+        thread_local Worker* worker = nullptr;
+        return worker;
+    }
+
+    void run(Worker& worker) {
+        // Pinned first, so the pool's memory is first touched on the worker's node.
+        if(worker.cpu >= 0) pinThread(worker.cpu);
+        if(!worker.pool) worker.pool = std::make_unique<BufferPool>();
+        currentWorker() = &worker;
+        Socket& listener = *worker.listener;
+        worker.loop.add(listener.getSocket(), READABLE, {[this, &worker, &listener] {
+            while(std::optional<Node> node = listener.tryAccept()) {
+                onConnection(std::move(*node), worker.loop);
+            }
+        }, nullptr, nullptr});
+        worker.loop.run();
+        worker.loop.remove(listener.getSocket());
+    }
+
+public:
+
+    Acceptor(int port, std::string ip=ANY_ADDR, size_t threads=0, int backlog=MAX_BACKLOG, const SocketOptions& options=SocketOptions(), const std::vector<int>& cpus={}) {
+        if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for(size_t i = 0; i < threads; i++) {
+            auto worker = std::make_unique<Worker>();
+            if(!cpus.empty()) worker->cpu = cpus[i % cpus.size()];
+        #ifdef SO_WINDOWS
+            if(i == 0) worker->socket = std::make_unique<Socket>(port, ip, false, options, true, backlog);
+            worker->listener = workers.empty() ? worker->socket.get() : workers[0]->listener;
+        #else
+            worker->socket = std::make_unique<Socket>(port, ip, false, options, true, backlog, true);
+            worker->listener = worker->socket.get();
+        #endif
+            workers.push_back(std::move(worker));
+        }
+    }
+
+    Acceptor(const Acceptor&) = delete;
+    Acceptor& operator=(const Acceptor&) = delete;
+
+    ~Acceptor() {
+        try { stop(); } catch(...) {}
+    }
+
+    // Starts the workers.
+    /**
+     *
+     * @brief ## Starts the worker threads, each accepting and running its own loop.
+     *
+     * @param onConnection Called with every new connection and the loop of the worker that accepted it. Take ownership of the node, or it is closed.
+     *
+     * @throw `std::runtime_error()` if already started.
+     *
+     * @note Exceptions thrown by the callback, or by the loop, end that worker and close its listening socket, so the kernel stops queueing connections to it. `stop()` rethrows the first one.
+     *
+     */
+    void start(OnConnection onConnection) {
+        for(auto& worker : workers) {
+            if(worker->thread.joinable()) {
+                throw std::runtime_error("Acceptor already started");
+            }
+        }
+        this->onConnection = std::move(onConnection);
+        for(auto& worker : workers) {
+            Worker* w = worker.get();
+            w->error = nullptr;
+            w->thread = std::thread([this, w] {
+                try { run(*w); } catch(...) {
+                    w->error = std::current_exception();
+                    w->loop.remove(w->listener->getSocket());
+                    // With SO_REUSEPORT, an open socket nobody accepts from still gets its share of the connections.
+                    if(w->socket) try { w->socket->close(); } catch(const std::runtime_error&) {}
+                }
+            });
+        }
+    }
+
+    // Stops the workers.
+    /**
+     * 
+     * @brief ## Stops every worker loop, and waits for the threads to exit. The listening sockets stay open.
+     * 
+     * @throw The exception that ended a worker early, if one did. Every worker is stopped and joined first.
+     * 
+     */
+    void stop() {
+        for(auto& worker : workers) {
+            if(worker->thread.joinable()) worker->loop.stop();
+        }
+        std::exception_ptr error;
+        for(auto& worker : workers) {
+            if(worker->thread.joinable()) worker->thread.join();
+            if(!error) error = worker->error;
+            worker->error = nullptr;
+        }
+        if(error) std::rethrow_exception(error);
+    }
+
+    // Returns the number of workers.
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Returns the loop of a worker.
+    EventLoop& loop(size_t worker) {
+        return workers.at(worker)->loop;
+    }
+
+    // Steers connections by CPU.
+    /**
+     *
+     * @brief ## Hands every new connection to the worker pinned to the CPU that received it, instead of spreading them by hash.
+     *
+     * @returns False if not supported: before Linux 4.6, on Windows, or if the workers are not pinned.
+     *
+     * @note Uses a classic BPF program on the `SO_REUSEPORT` group (`SO_ATTACH_REUSEPORT_CBPF`), reading the CPU like `SO_INCOMING_CPU` does.
+     * @note CPUs with no worker go to worker `cpu % size()`. The connection, the interrupts and the worker then share a core, and a NUMA node.
+     * @warning Connections follow the NIC interrupts: spread them over every worker's CPU (RSS, or RPS), or a few workers take all the load.
+     *
+     */
+    bool steerByCpu() {
+    #ifdef SO_WINDOWS
+        return false;
+    #else
+        if(workers.empty() || workers[0]->cpu < 0) return false;
+        // A = cpu; for each worker: if A == its cpu, return its index. Otherwise return A % workers.
+        std::vector<sock_filter> code;
+        code.push_back(BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)));
+        for(size_t i = 0; i < workers.size(); i++) {
+            code.push_back(BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)workers[i]->cpu, 0, 1));
+            code.push_back(BPF_STMT(BPF_RET | BPF_K, (uint32_t)i));
+        }
+        code.push_back(BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t)workers.size()));
+        code.push_back(BPF_STMT(BPF_RET | BPF_A, 0));
+        sock_fprog program = {(unsigned short)code.size(), code.data()};
+        // The sockets joined the group in worker order, which is what the returned index picks from.
+        return setsockopt(workers[0]->listener->getSocket(), SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) == 0;
+    #endif
+    }
+
+    // Returns the CPU a worker is pinned to, -1 if not pinned.
+    int cpuOf(size_t worker) const {
+        return workers.at(worker)->cpu;
+    }
+
+    // Returns the buffer pool of the calling worker, created on its thread after pinning, so its memory is local. Throws `std::runtime_error()` from other threads.
+    BufferPool& bufferPool() {
+        Worker* worker = currentWorker();
+        if(worker == nullptr || std::none_of(workers.begin(), workers.end(), [worker](const auto& w) { return w.get() == worker; })) {
+            throw std::runtime_error("Not called from a worker of this acceptor");
+        }
+        return *worker->pool;
+    }
+};
+
+// ThreadPool class.
+/**
+ *
+ * @brief ## `skt::ThreadPool`
+ *
+ * @param threads How many worker threads. If not set, or 0, one per core.
+ * @param cpus    The CPU to pin each worker to, wrapped if there are more workers. If not set, workers are not pinned.
+ *
+ * @note - A work-stealing executor: every worker has its own queue, and a task can be pinned to a worker with `submit(task, worker)`.
+ * @note - A worker runs its own queue first. When it runs dry, it steals from the back of the others, so a busy worker's backlog spreads out.
+ * @note - Idle workers sleep. A pinned task wakes its own worker, or a sleeping one if its worker is busy and already has work queued.
+ * @note - The destructor runs the queued tasks, then joins the threads.
+ * @note - Each worker has a `bufferPool()`, created on its thread after pinning: with first touch, its memory is on the worker's NUMA node.
+ * @note #### Examples:
+ * @note `pool.submit([]{ ... });` - Runs on the calling worker if called from the pool, or on the next worker round-robin.
+ * @note `pool.submit(task, 3);` - Prefers worker 3, ex: to keep a connection on the same core.
+ *
+ */
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<Task> tasks;
+        bool sleeping = false;
+        bool poked = false;
+        std::thread thread;
+        int cpu = -1;  // -1 if not pinned.
+        std::unique_ptr<BufferPool> pool;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> stolen{0};
+
+    static ThreadPool*& currentPool() {
+        thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static size_t& currentIndex() {
+        thread_local size_t index = 0;
+        return index;
+    }
+
+    bool popOwn(size_t index, Task& task) {
+        Worker& w = *workers[index];
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if(w.tasks.empty()) return false;
+        task = std::move(w.tasks.front());
+        w.tasks.pop_front();
+        return true;
+    }
+
+    bool steal(size_t index, Task& task) {
+        for(size_t i = 1; i < workers.size(); i++) {
+            Worker& victim = *workers[(index + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            stolen++;
+            return true;
+        }
+        return false;
+    }
+
+    // Wakes a sleeping worker other than `busy`, to come and steal.
+    void pokeIdle(size_t busy) {
+        for(size_t i = 1; i < workers.size(); i++) {
+            Worker& w = *workers[(busy + i) % workers.size()];
+            std::lock_guard<std::mutex> lock(w.mutex);
+            if(!w.sleeping) continue;
+            w.poked = true;
+            w.cv.notify_one();
+            return;
+        }
+    }
+
+    void run(size_t index) {
+        currentPool() = this;
+        currentIndex() = index;
+        Worker& self = *workers[index];
+        if(self.cpu >= 0) pinThread(self.cpu);
+        self.pool = std::make_unique<BufferPool>();
+
+        for(;;) {
+            Task task;
+            if(popOwn(index, task) || steal(index, task)) {
+                task();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(self.mutex);
+            if(!self.tasks.empty()) continue;
+            if(stopping) return;
+            self.sleeping = true;
+            self.cv.wait(lock, [&] { return self.poked || !self.tasks.empty() || stopping; });
+            self.sleeping = false;
+            self.poked = false;
+        }
+    }
+
+public:
+
+    ThreadPool(size_t threads=0, const std::vector<int>& cpus={}) {
+        if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        for(size_t i = 0; i < threads; i++) {
+            workers.push_back(std::make_unique<Worker>());
+            if(!cpus.empty()) workers.back()->cpu = cpus[i % cpus.size()];
+        }
+        for(size_t i = 0; i < threads; i++) {
+            workers[i]->thread = std::thread([this, i] { run(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        stopping = true;
+        for(auto& w : workers) {
+            std::lock_guard<std::mutex> lock(w->mutex);
+            w->cv.notify_one();
+        }
+        for(auto& w : workers) w->thread.join();
+    }
+
+    // Queues a task on a worker.
+    /**
+     *
+     * @brief ## Queues `task` on `worker`. It runs there, unless another worker steals it while `worker` is busy.
+     *
+     * @param task   The task to run. Exceptions escaping it terminate the program, like in a `std::thread`.
+     * @param worker The preferred worker, from 0 to `size() - 1`. Wrapped if larger.
+     *
+     */
+    void submit(Task task, size_t worker) {
+        worker %= workers.size();
+        Worker& w = *workers[worker];
+        size_t queued;
+        {
+            std::lock_guard<std::mutex> lock(w.mutex);
+            w.tasks.push_back(std::move(task));
+            if(w.sleeping) {
+                w.cv.notify_one();
+                return;
+            }
+            queued = w.tasks.size();
+        }
+        // The worker is busy: if work is piling up, get help.
+        if(queued > 1) pokeIdle(worker);
+    }
+
+    // Queues a task on the calling worker, or round-robin from outside the pool.
+    void submit(Task task) {
+        size_t worker = currentPool() == this ? currentIndex() : next++;
+        submit(std::move(task), worker);
+    }
+
+    // Returns the number of workers.
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Returns the index of the calling worker, or -1 if not called from this pool.
+    long currentWorker() const {
+        return currentPool() == this ? (long)currentIndex() : -1;
+    }
+
+    // Returns how many tasks ran on another worker than the one they were queued on.
+    size_t steals() const {
+        return stolen;
+    }
+
+    // Returns the CPU a worker is pinned to, -1 if not pinned.
+    int cpuOf(size_t worker) const {
+        return workers.at(worker)->cpu;
+    }
+
+    // Returns the first worker pinned to `cpu`, or -1 if there is none.
+    long workerOnCpu(int cpu) const {
+        for(size_t i = 0; i < workers.size(); i++) {
+            if(workers[i]->cpu == cpu && cpu >= 0) return (long)i;
+        }
+        return -1;
+    }
+
+    // Returns the buffer pool of the calling worker. Throws `std::runtime_error()` if not called from this pool.
+    BufferPool& bufferPool() {
+        if(currentPool() != this) {
+            throw std::runtime_error("Not called from a worker of this pool");
+        }
+        return *workers[currentIndex()]->pool;
+    }
+};
+
+// Server class.
+/**
+ *
+ * @brief ## `skt::Server`
+ *
+ * @param port    The port to listen on.
+ * @param ip      The ip to bind. If not set, fallback to 0.0.0.0
+ * @param threads How many handler threads. If not set, or 0, one per core.
+ * @param backlog How many connections to queue until dropping requisitions. If not set, fallback to `skt::MAX_BACKLOG`.
+ * @param options Options for the listening socket, inherited by the accepted connections. See `skt::SocketOptions`.
+ * @param cpus    The CPU to pin each handler thread to, see `skt::ThreadPool`. If not set, they are not pinned.
+ *
+ * @throw `std::runtime_error()` if the listening socket can't be created.
+ *
+ * @note - Owns the listening `skt::Socket`, an `skt::EventLoop` watching every connection, and a `skt::ThreadPool` running the handlers.
+ * @note - When a connection has data, its handler runs on a pool worker. Every connection has a home worker, picked round-robin on accept, and runs there unless a steal is needed.
+ * @note - A connection is never handled by two workers at once: it is only watched again once its handler returned.
+ * @note - Connections are non-blocking: read with `tryRecv()` until `skt::WOULD_BLOCK`. Return false from the handler to close the connection.
+ * @note #### Examples:
+ * @note `skt::Server server(49110);` - Listens on port 49110.
+ * @note `server.run([](skt::Server::Connection& c) { std::string d; int n; while((n = c.node.tryRecv(d)) > 0) c.node.send(d); return n != 0; });` - Echo server.
+ * @note `server.stop();` - From any thread: makes `run()` return.
+ * @note `server.drain(std::chrono::seconds(30));` - From any thread: stops accepting, lets open connections finish, then `run()` returns. See `skt::Socket::handOff()` for restarts.
+ *
+ */
+class Server {
+public:
+    // A connection, as seen by the handler.
+    struct Connection {
+        Node node;
+        size_t worker;   // The home worker.
+        std::any state;  // Free for the handler, ex: a protocol parser.
+    };
+
+    // Called on a pool worker when the connection has data. Returns false to close the connection.
+    using Handler = std::function<bool(Connection& connection)>;
+
+private:
+    struct Slot {
+        Connection connection;
+        bool busy = false;
+        bool closing = false;
+    };
+
+    Socket listener;
+    EventLoop loop;
+    ThreadPool pool;
+    Handler handler;
+    std::unordered_map<sock_t, std::unique_ptr<Slot>> slots;
+    size_t nextWorker = 0;
+    bool steering = false;
+    std::atomic<bool> draining{false};
+
+    // The home worker of a new connection: the one on the CPU that received it, when steering, or the next one.
+    size_t pickWorker(sock_t fd) {
+    #ifndef SO_WINDOWS
+        int cpu = -1;
+        socklen_t length = sizeof(cpu);
+        if(steering && getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == 0) {
+            long worker = pool.workerOnCpu(cpu);
+            if(worker >= 0) return (size_t)worker;
+        }
+    #else
+        (void)fd;
+    #endif
+        return nextWorker++ % pool.size();
+    }
+
+    void acceptAll() {
+        while(std::optional<Node> node = listener.tryAccept()) {
+            auto slot = std::make_unique<Slot>();
+            slot->connection.node = std::move(*node);
+            slot->connection.worker = pickWorker(slot->connection.node);
+
+            sock_t fd = slot->connection.node;
+            Slot* raw = slot.get();
+            slots.emplace(fd, std::move(slot));
+            loop.add(fd, READABLE | ONESHOT, {[this, raw] { dispatch(raw); }, nullptr, [this, fd] { closeConnection(fd); }});
+        }
+    }
+
+    void dispatch(Slot* slot) {
+        slot->busy = true;
+        pool.submit([this, slot] {
+            bool keep;
+            try { keep = handler(slot->connection); } catch(const std::exception&) { keep = false; }
+
+            sock_t fd = slot->connection.node;
+            loop.post([this, slot, fd, keep] {
+                slot->busy = false;
+                if(!keep || slot->closing) closeConnection(fd);
+                else if(draining) finishConnection(fd);
+                else loop.modify(fd, READABLE | ONESHOT);
+            });
+        }, slot->connection.worker);
+    }
+
+    void closeConnection(sock_t fd) {
+        auto it = slots.find(fd);
+        if(it == slots.end()) return;
+        if(it->second->busy) {
+            // A worker is still using it, close when the handler returns.
+            it->second->closing = true;
+            return;
+        }
+        loop.remove(fd);
+        slots.erase(it);
+        if(draining && slots.empty()) loop.stop();
+    }
+
+    // Ends sending on a connection being drained: the peer reads the rest of the responses, then 0 bytes. Closed when the peer closes too.
+    void finishConnection(sock_t fd) {
+        auto it = slots.find(fd);
+        if(it == slots.end()) return;
+        Node& node = it->second->connection.node;
+        try { node.shutdown(SHUT_WR); } catch(const std::runtime_error&) { closeConnection(fd); return; }
+
+        loop.remove(fd);
+        loop.add(fd, READABLE, {[this, fd, &node] {
+            // Requests arriving now are dropped: the peer knows from the end of stream to retry elsewhere.
+            std::string dropped;
+            int received;
+            try { while((received = node.tryRecv(dropped)) > 0); } catch(const std::runtime_error&) { received = 0; }
+            if(received == 0) closeConnection(fd);
+        }, nullptr, [this, fd] { closeConnection(fd); }});
+    }
+
+public:
+
+    Server(int port, std::string ip=ANY_ADDR, size_t threads=0, int backlog=MAX_BACKLOG, const SocketOptions& options=SocketOptions(), const std::vector<int>& cpus={})
+        : listener(port, ip, false, options, true, backlog), pool(threads, cpus) {}
+
+    // Serves on a listening socket made elsewhere, ex: one from `skt::Socket::inherit()`. It is made non-blocking.
+    Server(Socket&& listener, size_t threads=0, const std::vector<int>& cpus={})
+        : listener(std::move(listener)), pool(threads, cpus) {
+        this->listener.setNonBlocking(true);
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    // Runs the server.
+    /**
+     *
+     * @brief ## Accepts connections and dispatches them to `handler`, until `stop()` is called.
+     *
+     * @param handler Called on a pool worker when a connection has data. Return true to keep the connection, false to close it.
+     *
+     * @throw `std::runtime_error()` if the event loop fails.
+     *
+     * @note Runs the event loop on the calling thread. Exceptions escaping the handler close its connection.
+     * @note When it returns, open connections are closed once their handlers are done.
+     *
+     */
+    void run(Handler handler) {
+        this->handler = std::move(handler);
+        if(!draining) loop.add(listener.getSocket(), READABLE, {[this] { acceptAll(); }, nullptr, nullptr});
+        loop.run();
+        loop.remove(listener.getSocket());
+
+        // Let running handlers finish before closing their connections.
+        while(std::any_of(slots.begin(), slots.end(), [](const auto& kv) { return kv.second->busy; })) {
+            loop.runOnce(10);
+        }
+        for(auto& kv : slots) loop.remove(kv.first);
+        slots.clear();
+    }
+
+    // Stops the server. Safe to call from any thread, including handlers. If `run()` has not started yet, it returns at once.
+    void stop() {
+        loop.stop();
+    }
+
+    // Shuts the server down gracefully.
+    /**
+     *
+     * @brief ## Stops accepting, and closes the connections as they finish, without losing responses. `run()` returns once all are closed, or at the deadline.
+     *
+     * @param deadline How long to wait for the peers to close. If not set, fallback to 30s. The connections still open then are closed.
+     *
+     * @note - Safe to call from any thread, including handlers. Idle connections are shut down at once, busy ones once their handler returns.
+     * @note - A connection is shut down for writing after its last response was queued: the peer reads it all, then the end of stream, and closes. Data sent after that is dropped.
+     * @note - The listening socket is closed. Connections waiting to be accepted go to the process sharing it (`skt::Socket::handOff()`, or `SO_REUSEPORT`), or are reset.
+     * @note #### Zero-downtime restart:
+     * @note `server.socket().handOff(); spawnNewVersion(); server.drain();` - The new version runs `skt::Server server(skt::Socket::inherit().value());`.
+     *
+     */
+    void drain(std::chrono::milliseconds deadline=std::chrono::seconds(30)) {
+        loop.post([this, deadline] {
+            if(draining.exchange(true)) return;
+            loop.remove(listener.getSocket());
+            listener.close();
+            loop.addTimer(deadline, [this] { loop.stop(); });
+
+            std::vector<sock_t> idle;
+            for(auto& kv : slots) if(!kv.second->busy) idle.push_back(kv.first);
+            for(sock_t fd : idle) finishConnection(fd);
+            if(slots.empty()) loop.stop();
+        });
+    }
+
+    // Returns whether `drain()` was called.
+    bool isDraining() const {
+        return draining;
+    }
+
+    // Returns the number of open connections. Only accurate from the thread calling `run()`.
+    size_t size() const {
+        return slots.size();
+    }
+
+    // Returns the handler pool.
+    ThreadPool& executor() {
+        return pool;
+    }
+
+    // Homes connections by CPU.
+    /**
+     *
+     * @brief Makes the home worker of each new connection the one pinned to the CPU that received it (`SO_INCOMING_CPU`), when there is one.
+     *
+     * @note Needs pinned handler threads. Others, and other platforms, stay round-robin. On by `steerByCpu()`, from the thread calling `run()`.
+     * @warning Connections follow the NIC interrupts: spread them over the workers' CPUs (RSS, or RPS), or a few workers take all the load.
+     *
+     */
+    void steerByCpu(bool enable=true) {
+        steering = enable;
+    }
+
+    // Returns the listening socket.
+    Socket& socket() {
+        return listener;
+    }
+};
+
+// ConnectionPool class.
+/**
+ *
+ * @brief ## `skt::ConnectionPool`
+ *
+ * @param maxPerHost  How many connections can be open to the same ip:port at once, leased or idle. If not set, fallback to 8.
+ * @param idleTimeout How long an idle connection is kept before being closed. If not set, fallback to 60 seconds.
+ * @param options     Options for the new connections, ex: `skt::SocketOptions::lowLatency()`.
+ *
+ * @note - Keeps client connections open between requests, so the TCP handshake is paid once per connection instead of once per request.
+ * @note - `acquire()` returns a `Lease`: use it as a connected `skt::Socket`, and it goes back to the pool when it goes out of scope.
+ * @note - The most recently used idle connection is handed out first. Before that, it is checked without blocking: if the peer closed it, or left unread data on it, it is dropped and another one is tried.
+ * @note - When a host is at `maxPerHost`, `acquire()` waits for a lease to come back.
+ * @note - Thread-safe. The pool must outlive its leases.
+ * @note #### Examples:
+ * @note `skt::ConnectionPool pool;` - Up to 8 connections per host.
+ * @note `pool.prewarm("127.0.0.1", 49110, 4);` - Opens 4 connections at startup.
+ * @note `auto conn = pool.acquire("127.0.0.1", 49110); conn->send("ping"); auto reply = conn->recv();`
+ * @note `conn.discard();` - After a protocol error: the connection is closed instead of going back to the pool.
+ *
+ */
+class ConnectionPool {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Idle {
+        std::unique_ptr<Socket> socket;
+        Clock::time_point since;
+    };
+
+    struct Host {
+        std::string ip;
+        int port;
+        std::vector<Idle> idle;  // Oldest first.
+        size_t open = 0;
+        std::condition_variable available;
+    };
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<Host>> hosts;
+    size_t maxPerHost;
+    Clock::duration idleTimeout;
+    SocketOptions options;
+
+    Host& host(const std::string& ip, int port) {
+        std::string key = ip + ":" + std::to_string(port);
+        auto it = hosts.find(key);
+        if(it == hosts.end()) {
+            auto created = std::make_unique<Host>();
+            created->ip = ip;
+            created->port = port;
+            it = hosts.emplace(std::move(key), std::move(created)).first;
+        }
+        return *it->second;
+    }
+
+    // An idle connection must have nothing to read: a readable socket was closed by the peer, or holds stale data.
+    static bool reusable(Socket& socket) {
+        try { return !detail::waitFor(socket.getSocket(), false, 0); } catch(const std::runtime_error&) { return false; }
+    }
+
+    std::unique_ptr<Socket> connect(Host& h) {
+        auto socket = std::make_unique<Socket>(h.port, h.ip, true, options);
+        socket->connect();
+        return socket;
+    }
+
+    // Closes the idle connections past their timeout. Called with the lock held.
+    void expire(Host& h, Clock::time_point now) {
+        size_t expired = 0;
+        while(expired < h.idle.size() && now - h.idle[expired].since >= idleTimeout) expired++;
+        if(expired == 0) return;
+        h.idle.erase(h.idle.begin(), h.idle.begin() + expired);
+        h.open -= expired;
+        for(size_t i = 0; i < expired; i++) h.available.notify_one();
+    }
+
+public:
+    // A leased connection.
+    /**
+     *
+     * @brief A connected `skt::Socket`, borrowed from the pool. Goes back to the pool when destroyed, or reassigned.
+     *
+     * @note Move-only. Call `discard()` if the connection is in an unknown state (ex: a request was interrupted), so it is not reused.
+     *
+     */
+    class Lease {
+        friend class ConnectionPool;
+
+        ConnectionPool* pool = nullptr;
+        Host* host = nullptr;
+        std::unique_ptr<Socket> socket;
+        bool broken = false;
+
+        Lease(ConnectionPool* pool, Host* host, std::unique_ptr<Socket> socket)
+            : pool(pool), host(host), socket(std::move(socket)) {}
+
+    public:
+        Lease() = default;
+
+        Lease(Lease&& other) noexcept
+            : pool(std::exchange(other.pool, nullptr)), host(other.host), socket(std::move(other.socket)), broken(other.broken) {}
+
+        Lease& operator=(Lease&& other) noexcept {
+            if(this != &other) {
+                reset();
+                pool = std::exchange(other.pool, nullptr);
+                host = other.host;
+                socket = std::move(other.socket);
+                broken = other.broken;
+            }
+            return *this;
+        }
+
+        ~Lease() {
+            reset();
+        }
+
+        Socket& operator*() const { return *socket; }
+        Socket* operator->() const { return socket.get(); }
+        Socket& get() const { return *socket; }
+        explicit operator bool() const { return socket != nullptr; }
+
+        // Marks the connection as unusable: it will be closed instead of returned.
+        void discard() { broken = true; }
+
+        // Returns the connection to the pool now.
+        void reset() {
+            if(pool) pool->giveBack(*host, std::move(socket), broken);
+            pool = nullptr;
+            socket.reset();
+            broken = false;
+        }
+    };
+
+    ConnectionPool(size_t maxPerHost=8, std::chrono::milliseconds idleTimeout=std::chrono::seconds(60), const SocketOptions& options=SocketOptions())
+        : maxPerHost(std::max<size_t>(1, maxPerHost)), idleTimeout(idleTimeout), options(options) {}
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // Borrows a connection.
+    /**
+     *
+     * @brief ## Returns a connection to `ip:port`: an idle one if there is a healthy one, a new one otherwise.
+     *
+     * @param ip   The server ip.
+     * @param port The server port.
+     * @param wait How long to wait when the host is at `maxPerHost`. If not set, waits until a lease comes back.
+     *
+     * @returns The leased, connected socket.
+     *
+     * @throw `std::runtime_error()` if no connection frees up in time, or a new connection can't be made.
+     *
+     */
+    Lease acquire(const std::string& ip, int port, std::optional<std::chrono::milliseconds> wait=std::nullopt) {
+        std::unique_lock<std::mutex> lock(mutex);
+        Host& h = host(ip, port);
+        auto deadline = Clock::now() + wait.value_or(std::chrono::milliseconds(0));
+
+        for(;;) {
+            Clock::time_point now = Clock::now();
+            expire(h, now);
+
+            while(!h.idle.empty()) {
+                std::unique_ptr<Socket> socket = std::move(h.idle.back().socket);
+                h.idle.pop_back();
+                if(reusable(*socket)) return Lease(this, &h, std::move(socket));
+                h.open--;
+            }
+
+            if(h.open < maxPerHost) {
+                h.open++;
+                lock.unlock();
+                try {
+                    return Lease(this, &h, connect(h));
+                } catch(...) {
+                    lock.lock();
+                    h.open--;
+                    h.available.notify_one();
+                    throw;
+                }
+            }
+
+            if(!wait) h.available.wait(lock);
+            else if(h.available.wait_until(lock, deadline) == std::cv_status::timeout) {
+                throw std::runtime_error("No connection available in the pool");
+            }
+        }
+    }
+
+    // Opens connections ahead of time.
+    /**
+     *
+     * @brief ## Opens connections to `ip:port` until `count` are idle, or the host is at `maxPerHost`.
+     *
+     * @param ip    The server ip.
+     * @param port  The server port.
+     * @param count How many idle connections to have.
+     *
+     * @returns The number of connections opened.
+     *
+     * @throw `std::runtime_error()` if a connection can't be made.
+     *
+     */
+    size_t prewarm(const std::string& ip, int port, size_t count) {
+        size_t opened = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        Host& h = host(ip, port);
+        while(h.idle.size() < count && h.open < maxPerHost) {
+            h.open++;
+            lock.unlock();
+            std::unique_ptr<Socket> socket;
+            try {
+                socket = connect(h);
+            } catch(...) {
+                lock.lock();
+                h.open--;
+                throw;
+            }
+            lock.lock();
+            h.idle.push_back({std::move(socket), Clock::now()});
+            h.available.notify_one();
+            opened++;
+        }
+        return opened;
+    }
+
+    // Closes the idle connections past the idle timeout. Expired connections are also closed lazily by `acquire()`.
+    void evictIdle() {
+        std::lock_guard<std::mutex> lock(mutex);
+        Clock::time_point now = Clock::now();
+        for(auto& kv : hosts) expire(*kv.second, now);
+    }
+
+    // Returns the number of idle connections to `ip:port`.
+    size_t idle(const std::string& ip, int port) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return host(ip, port).idle.size();
+    }
+
+    // Returns the number of connections to `ip:port`, leased or idle.
+    size_t open(const std::string& ip, int port) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return host(ip, port).open;
+    }
+
+private:
+    void giveBack(Host& h, std::unique_ptr<Socket> socket, bool broken) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(broken || !socket) h.open--;
+        else h.idle.push_back({std::move(socket), Clock::now()});
+        h.available.notify_one();
+    }
+};
+
+#ifdef SKT_HAS_COROUTINES
+// Task class.
+/**
+ *
+ * @brief ## `skt::Task<T>`
+ *
+ * @note - The result of a coroutine: `co_await` it from another coroutine to run it and get its `T`, or start it with `skt::spawn()` / `skt::blockOn()`.
+ * @note - Lazy: nothing runs until it is awaited. When it finishes, it resumes its awaiter directly, with no trip through the event loop.
+ * @note - Exceptions thrown inside are rethrown at the `co_await`.
+ * @note - Move-only, and owns the coroutine: destroying a task destroys its frame. Only destroy tasks that are not suspended on I/O.
+ * @note - A socket awaited once stays watched by the loop, so awaiting it again costs no registration. `loop.remove()` it before closing, like any watched socket.
+ * @note - One coroutine can wait to read and another to write on the same socket, at once.
+ * @note - Requires C++20.
+ * @note #### Examples:
+ * @note `skt::Task<std::string> ask(skt::EventLoop& loop, skt::Node& node) { co_await skt::sendAsync(loop, node, "ping"); co_return co_await skt::recvAsync(loop, node); }`
+ *
+ */
+template<typename T=void>
+class Task;
+
+namespace detail {
+    template<typename T>
+    struct TaskResult {
+        std::optional<T> value;
+        void return_value(T result) { value.emplace(std::move(result)); }
+        T take() { return std::move(*value); }
+    };
+
+    template<>
+    struct TaskResult<void> {
+        void return_void() {}
+        void take() {}
+    };
+}
+
+template<typename T>
+class Task {
+public:
+    struct promise_type : detail::TaskResult<T> {
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+        std::exception_ptr error;
+
+        // Resumes whoever awaited the task, if anybody.
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept { return h.promise().continuation; }
+            void await_resume() const noexcept {}
+        };
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    template<typename U>
+    friend U blockOn(EventLoop& loop, Task<U> task);
+
+public:
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+    Task& operator=(Task&& other) noexcept {
+        if(this != &other) {
+            if(handle) handle.destroy();
+            handle = std::exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if(handle) handle.destroy();
+    }
+
+    // Awaiting a task starts it, and suspends the awaiter until it finishes.
+    bool await_ready() const noexcept {
+        return !handle || handle.done();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+        handle.promise().continuation = awaiter;
+        return handle;
+    }
+
+    T await_resume() {
+        if(handle.promise().error) std::rethrow_exception(handle.promise().error);
+        return handle.promise().take();
+    }
+
+    // Returns true once the coroutine ran to the end.
+    bool done() const {
+        return handle && handle.done();
+    }
+};
+
+namespace detail {
+    // The frame of a spawned task: starts right away, and frees itself at the end.
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() const noexcept { return {}; }
+            std::suspend_never initial_suspend() const noexcept { return {}; }
+            std::suspend_never final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+    };
+
+    template<typename T>
+    Detached runDetached(Task<T> task) {
+        co_await std::move(task);
+    }
+
+    // Suspends until `fd` is ready for `event`, then resumes from the event loop. Returns false if `timeout` (if not 0) passed first.
+    // The socket stays registered after the first await, with separate reader and writer slots: later awaits only change its interest.
+    struct IoAwaiter {
+        EventLoop& loop;
+        sock_t fd;
+        Event event;
+        std::chrono::milliseconds timeout{0};
+        bool timedOut = false;
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            loop.await(fd, event, h, timeout, &timedOut);
+        }
+
+        bool await_resume() const noexcept { return !timedOut; }
+    };
+}
+
+// Starts a task in the background.
+/**
+ *
+ * @brief ## Runs `task` until its first suspension, then lets the event loop drive it. Its frame is freed when it finishes.
+ *
+ * @param task The task to run. Its result, if any, is dropped.
+ *
+ * @note Exceptions escaping the task terminate the program, like in a `std::thread`: catch them inside.
+ * @note Call it from the loop thread, or from another thread through `EventLoop::post()`.
+ *
+ */
+template<typename T>
+void spawn(Task<T> task) {
+    detail::runDetached(std::move(task));
+}
+
+// Runs a task to the end.
+/**
+ *
+ * @brief ## Runs `task`, dispatching `loop` events until it finishes, and returns its result.
+ *
+ * @param loop The event loop the task waits on.
+ * @param task The task to run.
+ *
+ * @returns The result of the task.
+ *
+ * @throw Whatever the task throws.
+ *
+ * @note Tasks spawned on the same loop also make progress meanwhile. Ex: `skt::blockOn(loop, client(loop))` from `main()`.
+ *
+ */
+template<typename T>
+T blockOn(EventLoop& loop, Task<T> task) {
+    task.handle.resume();
+    while(!task.done()) {
+        loop.runOnce(-1);
+    }
+    return task.await_resume();
+}
+
+// Accepts a connection, without blocking the thread.
+/**
+ *
+ * @brief ## Awaitable `accept()`: suspends until a client connects.
+ *
+ * @param loop   The event loop to wait on.
+ * @param server The listening socket. Made non-blocking if it is not. Must outlive the task.
+ *
+ * @returns The connected client, non-blocking.
+ *
+ * @throw `std::runtime_error()` if the connection can't be accepted.
+ *
+ * @note Ex: `for(;;) skt::spawn(session(loop, co_await skt::acceptAsync(loop, server)));`
+ *
+ */
+inline Task<Node> acceptAsync(EventLoop& loop, Socket& server) {
+    if(!server.isNonBlocking()) server.setNonBlocking(true);
+    for(;;) {
+        if(std::optional<Node> node = server.tryAccept()) co_return std::move(*node);
+        co_await detail::IoAwaiter{loop, server.getSocket(), READABLE};
+    }
+}
+
+// Connects to the server, without blocking the thread.
+/**
+ *
+ * @brief ## Awaitable `connect()`: suspends until the connection is made.
+ *
+ * @param loop    The event loop to wait on.
+ * @param client  The client socket. Made non-blocking if it is not. Must outlive the task.
+ * @param timeout How long to wait for the connection, on the timers of `loop`. If not set, or 0, waits until the OS gives up.
+ *
+ * @throw `std::runtime_error()` if the connection can't be made. `std::system_error()` with `std::errc::timed_out` if `timeout` passed first.
+ *
+ * @note A host name is connected on its first resolved address, use `Socket::connect(timeout)` to race all of them.
+ * @note After a timeout the attempt may still be running: `loop.remove()` the socket and close it.
+ *
+ */
+inline Task<void> connectAsync(EventLoop& loop, Socket& client, std::chrono::milliseconds timeout=std::chrono::milliseconds(0)) {
+    if(!client.isNonBlocking()) client.setNonBlocking(true);
+    sock_t fd = client.getSocket();
+
+    if(::connect(fd, client.getAddress().data(), client.getAddress().size()) == 0) {
+        detail::countConnect(&client.getStats(), true);
+        co_return;
+    }
+    if(!detail::connectInProgress()) {
+        detail::countConnect(&client.getStats(), false);
+        detail::throwLastError("Error connecting to server");
+    }
+
+    if(!co_await detail::IoAwaiter{loop, fd, WRITABLE, timeout}) {
+        detail::countConnect(&client.getStats(), false);
+        throw std::system_error(std::make_error_code(std::errc::timed_out), "Connection timed out");
+    }
+    int err = detail::connectResult(fd);
+    detail::countConnect(&client.getStats(), err == 0);
+    if(err) {
+        throw std::system_error(std::error_code(err, std::system_category()), "Error connecting to server");
+    }
+}
+
+// Receives data, without blocking the thread.
+/**
+ *
+ * @brief ## Awaitable `recv()`: suspends until data is received.
+ *
+ * @param loop The event loop to wait on.
+ * @param node The connection. Made non-blocking if it is not. Must outlive the task.
+ *
+ * @returns The data received, as a std::string. Empty if the peer closed the connection.
+ *
+ * @throw `std::runtime_error()` if the data can't be received.
+ *
+ */
+inline Task<std::string> recvAsync(EventLoop& loop, Node& node) {
+    if(!node.isNonBlocking()) node.setNonBlocking(true);
+    std::string data;
+    while(node.tryRecv(data) == WOULD_BLOCK) {
+        co_await detail::IoAwaiter{loop, node, READABLE};
+    }
+    co_return data;
+}
+
+// Receives data into a caller buffer, without blocking the thread.
+/**
+ *
+ * @brief ## Awaitable `recv(buffer, size)`: suspends until data is received into `buffer`.
+ *
+ * @param loop   The event loop to wait on.
+ * @param node   The connection. Made non-blocking if it is not. Must outlive the task.
+ * @param buffer Where to store the data. Must outlive the task.
+ * @param size   The size of `buffer`.
+ *
+ * @returns The number of bytes received, 0 if the peer closed the connection.
+ *
+ * @throw `std::runtime_error()` if the data can't be received.
+ *
+ */
+inline Task<size_t> recvAsync(EventLoop& loop, Node& node, void* buffer, size_t size) {
+    if(!node.isNonBlocking()) node.setNonBlocking(true);
+    int received;
+    while((received = detail::tryRecv(node, static_cast<char*>(buffer), size, &node.getStats())) == WOULD_BLOCK) {
+        co_await detail::IoAwaiter{loop, node, READABLE};
+    }
+    co_return (size_t)received;
+}
+
+// Sends data, without blocking the thread.
+/**
+ *
+ * @brief ## Awaitable `send()`: sends all the data, suspending while the send buffer is full.
+ *
+ * @param loop The event loop to wait on.
+ * @param node The connection. Made non-blocking if it is not. Must outlive the task.
+ * @param data The data to be sent. Not copied: it must stay alive until the task finishes.
+ *
+ * @returns The number of bytes sent, always `data.size()`.
+ *
+ * @throw `std::runtime_error()` if the data can't be sent.
+ *
+ */
+inline Task<size_t> sendAsync(EventLoop& loop, Node& node, std::string_view data) {
+    if(!node.isNonBlocking()) node.setNonBlocking(true);
+    size_t sent = 0;
+    while(sent < data.size()) {
+        int n = node.trySend(data.substr(sent));
+        if(n == WOULD_BLOCK) co_await detail::IoAwaiter{loop, node, WRITABLE};
+        else sent += n;
+    }
+    co_return sent;
+}
+#endif
+
+#if defined(SKT_IO_URING) && !defined(SO_WINDOWS)
+// Uring class.
+/**
+ *
+ * @brief ## `skt::Uring`
+ *
+ * @param entries The submission queue size: how many operations are sent to the kernel per syscall. If not set, fallback to 256.
+ *
+ * @throw `std::runtime_error()` if the ring can't be created. Ex: kernel older than 5.6, or io_uring disabled.
+ *
+ * @note - An io_uring submission path, to batch send/recv/accept across many sockets into few syscalls. Linux only.
+ * @note - Opt-in: `#define SKT_IO_URING` before including the header. No extra library is needed.
+ * @note - Operations are queued with `send()`, `recv()` and `accept()`, handed to the kernel with `submit()`, and their results collected with `reap()`.
+ * @note - If the queue fills up, it is submitted automatically, so queuing never fails.
+ * @note - Buffers must stay alive until the operation completes.
+ * @note #### Examples:
+ * @note `ring.sendToMany(fds.data(), fds.size(), update);` - Fans out one payload to many sockets, a syscall per batch instead of per socket.
+ * @note `ring.accept(sock.getSocket(), 0, true);` - Multishot accept: one request keeps producing new connections (Linux 5.19+).
+ *
+ */
+class Uring {
+public:
+    // The result of a finished operation.
+    struct Completion {
+        uint64_t userData;  // The value passed when queuing the operation.
+        int result;         // Bytes sent/received, or the new socket for accepts. Negative errno on failure.
+        bool more;          // True if a multishot operation will produce more completions.
+    };
+
+private:
+    int ringFd = -1;
+    unsigned sqEntries = 0;
+
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0, cqRingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe* cqes;
+
+    unsigned localTail = 0, toSubmit = 0;
+    size_t inFlight = 0;
+
+    static int enter(int fd, unsigned submit, unsigned wait, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, fd, submit, wait, flags, nullptr, 0);
+    }
+
+    io_uring_sqe* nextSqe() {
+        if(localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+            submit();
+        }
+        unsigned idx = localTail & *sqMask;
+        sqArray[idx] = idx;
+        localTail++;
+        toSubmit++;
+        inFlight++;
+
+        io_uring_sqe* sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void unmap() {
+        if(sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if(cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if(ringFd >= 0) ::close(ringFd);
+    }
+
+public:
+
+    Uring(unsigned entries=256) {
+        io_uring_params params{};
+        ringFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+        if(ringFd < 0) {
+            detail::throwLastError("Error creating io_uring");
+        }
+        sqEntries = params.sq_entries;
+
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if(singleMmap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+        cqRing = singleMmap ? sqRing
+                            : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+        if(sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED) {
+            unmap();
+            detail::throwLastError("Error mapping io_uring");
+        }
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqHead  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        cqHead  = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail  = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask  = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes    = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        localTail = *sqTail;
+    }
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring() {
+        unmap();
+    }
+
+    // Queues a send of `size` bytes from `data`. Completes with the bytes sent.
+    void send(sock_t fd, const void* data, size_t size, uint64_t userData) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(data);
+        sqe->len = (uint32_t)size;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData;
+    }
+
+    // Queues a recv into `buffer`. Completes with the bytes received, 0 if the peer closed.
+    void recv(sock_t fd, void* buffer, size_t size, uint64_t userData) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buffer);
+        sqe->len = (uint32_t)size;
+        sqe->user_data = userData;
+    }
+
+    // Queues an accept on a listening socket. Completes with the new socket descriptor.
+    /**
+     *
+     * @brief Queues an accept. With `multishot`, the request stays armed and completes once per new connection.
+     *
+     * @param fd        The listening socket, ex: `sock.getSocket()`.
+     * @param userData  Passed back in every completion.
+     * @param multishot Keep accepting with a single request. Needs Linux 5.19+, older kernels complete with `-EINVAL`.
+     * @param nonBlocking Create the accepted sockets in non-blocking mode.
+     *
+     * @note Completions keep `more` set while the multishot request is armed. If it is cleared, queue the accept again.
+     *
+     */
+    void accept(sock_t fd, uint64_t userData, bool multishot=false, bool nonBlocking=false) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = fd;
+        sqe->accept_flags = SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0);
+        if(multishot) sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+        sqe->user_data = userData;
+    }
+
+    // Submits the queued operations.
+    /**
+     *
+     * @brief Hands every queued operation to the kernel, with a single syscall.
+     *
+     * @param waitFor Also wait until at least this many operations completed. If not set, fallback to 0.
+     *
+     * @returns The number of operations submitted.
+     *
+     * @throw `std::runtime_error()` if the submission fails.
+     *
+     */
+    int submit(unsigned waitFor=0) {
+        __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+
+        unsigned count = toSubmit;
+        int ret;
+        do {
+            ret = enter(ringFd, count, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0);
+        } while(ret < 0 && errno == EINTR);
+        if(ret < 0) {
+            detail::throwLastError("Error submitting to io_uring");
+        }
+        toSubmit -= ret;
+        return ret;
+    }
+
+    // Collects the finished operations.
+    /**
+     *
+     * @brief Calls `onCompletion(const skt::Uring::Completion&)` for every finished operation. Never waits.
+     *
+     * @returns The number of completions handled.
+     *
+     */
+    template<typename F>
+    size_t reap(F&& onCompletion) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        size_t count = 0;
+
+        while(head != tail) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            Completion completion{cqe.user_data, cqe.res, (cqe.flags & IORING_CQE_F_MORE) != 0};
+            if(!completion.more) inFlight--;
+            head++;
+            count++;
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            onCompletion(completion);
+        }
+        return count;
     }
 
-    // Connects to a server.
+    // Marks the `userData` of the sends queued by `sendToMany()`.
+    static constexpr uint64_t FANOUT = uint64_t(1) << 63;
+
+    // Returns the number of queued or running operations.
+    size_t pending() const {
+        return inFlight;
+    }
+
+    // Sends the same data to many sockets.
     /**
-     * 
-     * @brief ## Connects to a server.
-     * 
-     * @throw `std::runtime_error()` if the socket can't be connected, or it it is a server socket.
-     * 
-     * @returns A pointer to a `skt::Node` object, containing the new socket file descriptor, ip and port. See skt::Node class.
-     * 
-     * @warning - Put the returned pointer in a smart pointer to avoid memory leaks, or delete it manually.
-     * @warning - IMPORTANT: on windows, as a client, if connecting to localhost, `ANY_ADDR` 0.0.0.0 will fail. Use `LOCALHOST` macro instead.
-     * 
+     *
+     * @brief ## Fan-out: sends `data` to every socket in `fds`, in batches of one syscall per queue size.
+     *
+     * @param fds     The sockets to send to. `skt::Node` converts to `sock_t`.
+     * @param count   The number of sockets.
+     * @param data    The data to send. It is shared by all sends, not copied.
+     * @param results If set, receives the result per socket: bytes sent, or negative errno.
+     *
+     * @returns How many sockets took the whole payload.
+     *
+     * @throw `std::runtime_error()` if the submission fails.
+     *
+     * @note Waits for all sends to complete. A socket that could only take part of the data is counted out, check `results`.
+     * @note Should not be mixed with other pending operations on the same ring: their completions are skipped, and lost.
+     * @note Its sends are tagged with `FANOUT` in `userData`, a bit other operations should leave unset.
+     *
      */
-    Node* connectRef(){
-        if(!isClient) {
-            throw std::runtime_error("Can't connect on a server socket");
+    size_t sendToMany(const sock_t* fds, size_t count, std::string_view data, int* results=nullptr) {
+        size_t complete = 0;
+        for(size_t start = 0; start < count; start += sqEntries) {
+            size_t batch = std::min<size_t>(sqEntries, count - start);
+            for(size_t i = 0; i < batch; i++) {
+                send(fds[start + i], data.data(), data.size(), FANOUT | (start + i));
+            }
+            submit((unsigned)batch);
+
+            size_t done = 0;
+            while(done < batch) {
+                reap([&](const Completion& c) {
+                    // Only the sends of this batch: anything else would index out of `results`.
+                    uint64_t index = c.userData & ~FANOUT;
+                    if(!(c.userData & FANOUT) || index < start || index >= start + batch) return;
+                    done++;
+                    if(results) results[index] = c.result;
+                    if(c.result == (int)data.size()) complete++;
+                });
+                if(done < batch) submit(1);
+            }
         }
+        return complete;
+    }
+};
+#endif
+
+// Context class.
+/**
+ *
+ * @brief ## `skt::Context`
+ *
+ * @note - The process-wide networking state, shared by every `skt::Socket` and `skt::Node`: created on first use, with `skt::Context::instance()`.
+ * @note - Starts the platform networking stack once (WSAStartup on Windows), and stops it at exit. Sockets no longer start it themselves.
+ * @note - Owns the default backends: `loop()`, and `uring()` with `SKT_IO_URING`. They are created on first use, and are not thread-safe: run them from one thread.
+ * @note - Calling `skt::Context::instance()` early, ex: first thing in `main()`, moves the startup cost and its errors there.
+ * @note #### Examples:
+ * @note `skt::EventLoop& loop = skt::Context::instance().loop();` - The shared event loop.
+ * @note `skt::Context::instance().bufferPool(65536).acquire();` - A 64 KB chunk from the shared pools.
+ *
+ */
+class Context {
+    std::once_flag loopOnce;
+    std::unique_ptr<EventLoop> defaultLoop;
+#if defined(SKT_IO_URING) && !defined(SO_WINDOWS)
+    std::once_flag uringOnce;
+    std::unique_ptr<Uring> defaultUring;
+#endif
+
+    Context() {
+        detail::startNetworking();
+    }
+
+public:
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    // Returns the context, starting the networking stack on the first call.
+    /**
+     *
+     * @brief Returns the process-wide context. Thread-safe.
+     *
+     * @throw `std::system_error()` if the networking stack can't be started. Ex: WSAStartup failed.
+     *
+     */
+    static Context& instance() {
+        static Context context;
+        return context;
+    }
+
+    // Returns the default event loop, created on the first call.
+    EventLoop& loop() {
+        std::call_once(loopOnce, [this] { defaultLoop.reset(new EventLoop()); });
+        return *defaultLoop;
+    }
+
+#if defined(SKT_IO_URING) && !defined(SO_WINDOWS)
+    // Returns the default io_uring, created on the first call.
+    Uring& uring() {
+        std::call_once(uringOnce, [this] { defaultUring.reset(new Uring()); });
+        return *defaultUring;
+    }
+#endif
 
-        Node* node = new Node();
-        auto addr = node->getAddr();
-        auto addrLen = node->getAddrLen();
+    // Returns the shared buffer pool for chunks of at least `size` bytes. See `skt::BufferPool::forSize()`.
+    BufferPool& bufferPool(size_t size=detail::RECV_SIZE) {
+        return BufferPool::forSize(size);
+    }
+};
+
+#ifdef SKT_TLS
+namespace detail {
+    // Throws the oldest queued OpenSSL error, with `what` as context.
+    [[noreturn]] inline void throwTlsError(const char* what) {
+        unsigned long code = ERR_get_error();
+        ERR_clear_error();
+        char reason[256] = "unknown error";
+        if(code != 0) ERR_error_string_n(code, reason, sizeof(reason));
+        throw std::runtime_error(std::string(what) + ": " + reason);
+    }
 
-        node->setSock(socket);
-        node->setIp(ip);
-        node->setPort(port);
+    struct SslCtxFree { void operator()(SSL_CTX* ctx) const { SSL_CTX_free(ctx); } };
+    struct SslFree { void operator()(SSL* ssl) const { SSL_free(ssl); } };
+}
+
+// TlsContext class.
+/**
+ *
+ * @brief ## `skt::TlsContext`
+ *
+ * @note - The TLS settings shared by many connections: certificates, verification, protocol versions. Wraps an OpenSSL `SSL_CTX`.
+ * @note - Opt-in: `#define SKT_TLS` before including the header, and link with `-lssl -lcrypto`. Needs OpenSSL 1.1.1+, kernel TLS needs 3.0+.
+ * @note - Created with `server()` or `client()`. Kernel TLS is asked for by default, see `setKernelTls()`.
+ * @note - Move-only. Must outlive the `skt::TlsStream`s made from it.
+ * @note #### Examples:
+ * @note `auto ctx = skt::TlsContext::server("cert.pem", "key.pem");` - A server context, with its certificate chain and private key.
+ * @note `auto ctx = skt::TlsContext::client();` - A client context that verifies servers against the system CA store.
+ *
+ */
+class TlsContext {
+    std::unique_ptr<SSL_CTX, detail::SslCtxFree> ctx;
+    bool isServerSide = false;
 
-        if(::connect(socket, (struct sockaddr *)addr, *addrLen) < 0) {
-            throw std::runtime_error("Error connecting to server");
+    TlsContext(const SSL_METHOD* method, bool isServerSide) : ctx(SSL_CTX_new(method)), isServerSide(isServerSide) {
+        if(!ctx) {
+            detail::throwTlsError("Error creating TLS context");
         }
+        SSL_CTX_set_min_proto_version(ctx.get(), TLS1_2_VERSION);
+        // Short writes are resumed by the caller, like a plain `trySend()`, and may resume from a moved buffer.
+        SSL_CTX_set_mode(ctx.get(), SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+        setKernelTls(true);
+    }
 
-        return node;
+public:
+
+    // Creates a server context.
+    /**
+     *
+     * @brief ## Creates a context for accepting TLS connections.
+     *
+     * @param certFile The certificate chain, PEM, leaf first.
+     * @param keyFile  The private key of the certificate, PEM.
+     *
+     * @throw `std::runtime_error()` if the files can't be loaded, or the key doesn't match the certificate.
+     *
+     */
+    static TlsContext server(const std::string& certFile, const std::string& keyFile) {
+        TlsContext context(TLS_server_method(), true);
+        if(SSL_CTX_use_certificate_chain_file(context.ctx.get(), certFile.c_str()) != 1
+            || SSL_CTX_use_PrivateKey_file(context.ctx.get(), keyFile.c_str(), SSL_FILETYPE_PEM) != 1
+            || SSL_CTX_check_private_key(context.ctx.get()) != 1) {
+            detail::throwTlsError("Error loading certificate");
+        }
+        return context;
     }
 
-    // Connects to a server.
+    // Creates a client context.
     /**
-     * 
-     * @brief ## Connects to a server. 
-     * 
-     * @note Stores the socket file descriptor, ip and port in the socket object.
-     * 
-     * @throw `std::runtime_error()` if the socket can't be connected, or if it is a server socket.
-     * 
-     * @warning IMPORTANT: on windows, as a client, if connecting to localhost, `ANY_ADDR` 0.0.0.0 will fail. Use `LOCALHOST` macro instead.
-     * 
+     *
+     * @brief ## Creates a context for connecting to TLS servers.
+     *
+     * @param verifyPeer Check the server certificate, and its name against the one given to `skt::TlsStream`. If not set, fallback to true.
+     * @param caFile     The trusted certificates, PEM. If empty, the system CA store.
+     *
+     * @throw `std::runtime_error()` if the trusted certificates can't be loaded.
+     *
      */
-    void connect(){
-        if(!isClient) {
-            throw std::runtime_error("Can't connect on a server socket");
+    static TlsContext client(bool verifyPeer=true, const std::string& caFile="") {
+        TlsContext context(TLS_client_method(), false);
+        if(verifyPeer) {
+            int loaded = caFile.empty() ? SSL_CTX_set_default_verify_paths(context.ctx.get())
+                                        : SSL_CTX_load_verify_locations(context.ctx.get(), caFile.c_str(), nullptr);
+            if(loaded != 1) {
+                detail::throwTlsError("Error loading trusted certificates");
+            }
+        }
+        SSL_CTX_set_verify(context.ctx.get(), verifyPeer ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+        return context;
+    }
+
+    // Asks OpenSSL to hand the session keys to the kernel after the handshake.
+    /**
+     *
+     * @brief ## Turns kernel TLS (kTLS) on or off for the connections created afterwards.
+     *
+     * @note With it, OpenSSL installs the `tls` TCP upper layer (`TCP_ULP`) and gives it the keys: the kernel encrypts,
+     * @note and `skt::TlsStream::sendFile()` keeps the `sendfile()` zero-copy path.
+     * @note If the kernel, the cipher or the OpenSSL build can't do it, the connection silently stays in userspace crypto.
+     * @note Check `skt::TlsStream::isKernelTlsSend()` after the handshake.
+     *
+     */
+    void setKernelTls(bool enabled) {
+    #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        if(enabled) SSL_CTX_set_options(ctx.get(), SSL_OP_ENABLE_KTLS);
+        else SSL_CTX_clear_options(ctx.get(), SSL_OP_ENABLE_KTLS);
+    #else
+        (void)enabled;
+    #endif
+    }
+
+    bool isServer() const {
+        return isServerSide;
+    }
+
+    // Returns the OpenSSL context, for settings not wrapped here. Ex: ciphers, ALPN.
+    SSL_CTX* native() const {
+        return ctx.get();
+    }
+};
+
+// TlsStream class.
+/**
+ *
+ * @brief ## `skt::TlsStream`
+ *
+ * @param context    The settings. Its side (server or client) picks whether `handshake()` accepts or connects.
+ * @param node       The connection: an accepted `skt::Node`, or `sock.connectRef()` for a client. Moved in.
+ * @param serverName A client sets the name of the server here: sent as SNI, and checked against the certificate. Ignored by servers.
+ *
+ * @throw `std::runtime_error()` if the TLS session can't be created.
+ *
+ * @note - A TLS session over a `skt::Node`. Call `handshake()` first, then send and receive as with the node.
+ * @note - When the context asks for kernel TLS and the kernel takes it, records are encrypted in the kernel,
+ * @note   and `sendFile()` stays zero-copy. Otherwise, OpenSSL encrypts in userspace, with the same API.
+ * @note - Works with blocking and non-blocking nodes: `trySend()`, `tryRecv()` and `tryHandshake()` return instead of waiting.
+ * @note - Move-only. Destroying it does not send a close notification, call `shutdown()` for that.
+ * @note #### Examples:
+ * @note `skt::TlsStream tls(ctx, sock.accept()); tls.handshake(); tls.sendAll("hello");`
+ * @note `skt::TlsStream tls(ctx, client.connectRef(), "example.com"); tls.handshake(); tls.sendFile(fd);`
+ *
+ */
+class TlsStream {
+    Node node;
+    std::unique_ptr<SSL, detail::SslFree> ssl;
+    bool isServerSide;
+    bool wantWrite = false;
+
+    // Runs one OpenSSL call, retrying while it waits for the socket, if `wait`.
+    // Returns its result, 0 if the peer closed the session, or WOULD_BLOCK.
+    template<typename Call>
+    int run(Call call, bool wait, const char* what) {
+        for(;;) {
+            ERR_clear_error();
+        #ifdef SO_WINDOWS
+            WSASetLastError(0);
+        #else
+            errno = 0;
+        #endif
+            int ret = call();
+            if(ret > 0) return ret;
+
+            int err = SSL_get_error(ssl.get(), ret);
+            if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                wantWrite = err == SSL_ERROR_WANT_WRITE;
+                if(!wait) return WOULD_BLOCK;
+                detail::waitFor(node, wantWrite);
+                continue;
+            }
+            if(err == SSL_ERROR_ZERO_RETURN) return 0;
+            if(err == SSL_ERROR_SYSCALL && ERR_peek_error() == 0) {
+            #ifdef SO_WINDOWS
+                if(WSAGetLastError() != 0) detail::throwLastError(what);
+            #else
+                if(errno == EINTR) continue;
+                if(errno != 0) detail::throwLastError(what);
+            #endif
+                throw std::runtime_error(std::string(what) + ": connection closed without a TLS close notification");
+            }
+            detail::throwTlsError(what);
         }
+    }
+
+public:
 
-        if(::connect(socket, (struct sockaddr *)&addr, addrLen) < 0) {
-            throw std::runtime_error("Error connecting to server");
+    TlsStream(const TlsContext& context, Node node, const std::string& serverName="")
+        : node(std::move(node)), ssl(SSL_new(context.native())), isServerSide(context.isServer()) {
+        if(!ssl || SSL_set_fd(ssl.get(), (int)(sock_t)this->node) != 1) {
+            detail::throwTlsError("Error creating TLS session");
+        }
+        if(!isServerSide && !serverName.empty()) {
+            // SNI is only sent for names, IP addresses are checked against the certificate as they are.
+            bool isIp = Address::parse(serverName, 0).has_value();
+            if((!isIp && SSL_set_tlsext_host_name(ssl.get(), serverName.c_str()) != 1)
+                || SSL_set1_host(ssl.get(), serverName.c_str()) != 1) {
+                detail::throwTlsError("Error setting TLS server name");
+            }
         }
     }
 
-    // Sends data to the socket.
+    TlsStream(TlsStream&&) noexcept = default;
+    TlsStream& operator=(TlsStream&&) noexcept = default;
+
+    // Runs the handshake.
     /**
-     * 
-     * @brief ## Sends data to a socket.
-     * 
-     * @param data The data to be sent.
-     * @param socket The socket to send the data. If a client, it can be omitted.
-     * 
-     * @return The number of bytes sent.
-     * 
+     *
+     * @brief ## Runs the TLS handshake, waiting for the peer as needed. As a client, also verifies the server.
+     *
+     * @throw `std::runtime_error()` if the handshake fails, ex: an untrusted certificate or no shared protocol.
+     *
+     */
+    void handshake() {
+        run([&] { return isServerSide ? SSL_accept(ssl.get()) : SSL_connect(ssl.get()); }, true, "Error in TLS handshake");
+    }
+
+    // Runs the handshake, without waiting.
+    /**
+     *
+     * @brief ## Advances the handshake as far as the socket allows. For non-blocking nodes, ex: in a `skt::EventLoop`.
+     *
+     * @returns True when the handshake is done. If false, call it again once the socket is writable if `wantsWrite()`, or readable otherwise.
+     *
+     * @throw `std::runtime_error()` if the handshake fails, or the peer closed the connection.
+     *
+     */
+    bool tryHandshake() {
+        int ret = run([&] { return isServerSide ? SSL_accept(ssl.get()) : SSL_connect(ssl.get()); }, false, "Error in TLS handshake");
+        if(ret == 0) throw std::runtime_error("Error in TLS handshake: connection closed");
+        return ret != WOULD_BLOCK;
+    }
+
+    // True if the last call that returned `WOULD_BLOCK` waits for room to write, false if it waits for data.
+    bool wantsWrite() const {
+        return wantWrite;
+    }
+
+    // Tries to send data, without waiting.
+    /**
+     *
+     * @brief Encrypts and sends as much of `data` as the socket takes.
+     *
+     * @returns The number of bytes sent, or `skt::WOULD_BLOCK` if the node is non-blocking and has no room. Retry with the rest of the data.
+     *
      * @throw `std::runtime_error()` if the data can't be sent.
-     * 
+     *
      */
-    int send(std::string data, sock_t socket=INVALID_SOCKET) {
-        if(socket == INVALID_SOCKET) { socket = this->socket; }
+    int trySend(std::string_view data) {
+        if(data.empty()) return 0;
+        int size = (int)std::min<size_t>(data.size(), INT_MAX);
+        int sent = run([&] { return SSL_write(ssl.get(), data.data(), size); }, false, "Error sending data");
+        if(sent == 0) throw std::runtime_error("Error sending data: TLS session closed");
+        return sent;
+    }
 
-        int sent = ::send(socket, data.c_str(), data.size(), 0);
-        if(sent < 0) {
-            throw std::runtime_error("Error sending data");
+    // Sends all data.
+    /**
+     *
+     * @brief Encrypts and sends all the data, waiting for room when needed.
+     *
+     * @returns The number of bytes sent, always `data.size()`.
+     *
+     * @throw `std::runtime_error()` if the data can't be sent.
+     *
+     */
+    size_t sendAll(std::string_view data) {
+        size_t total = 0;
+        while(total < data.size()) {
+            int size = (int)std::min<size_t>(data.size() - total, INT_MAX);
+            int sent = run([&] { return SSL_write(ssl.get(), data.data() + total, size); }, true, "Error sending data");
+            if(sent == 0) throw std::runtime_error("Error sending data: TLS session closed");
+            total += sent;
         }
-        return sent;
+        return total;
     }
 
-    // Receives data from the socket.
+    // Tries to receive data, without waiting.
     /**
-     * 
-     * @brief ## Receives data from a socket.
-     * 
-     * 
-     * @param socket The socket to receive the data. If a client, it can be omitted.
-     * @param buffer[] The buffer to store the data. If omitted, it will use the internal buffer.
-     * 
-     * @return The data received. If the data bytes is 0, it will return an empty string.
-     * 
+     *
+     * @brief Receives and decrypts into `buffer`.
+     *
+     * @returns The number of bytes received, 0 if the peer closed the session, or `skt::WOULD_BLOCK` if the node is non-blocking and there is no data.
+     *
      * @throw `std::runtime_error()` if the data can't be received.
-     * 
-     * @note Hangs until data is received.
+     *
      */
-    std::string recv(sock_t socket=INVALID_SOCKET, char buffer[]=nullptr) {
-        if(socket == INVALID_SOCKET) { socket = this->socket; }
-        if(buffer == nullptr) { buffer = this->buffer; }
+    int tryRecv(void* buffer, size_t size) {
+        int capped = (int)std::min<size_t>(size, INT_MAX);
+        return run([&] { return SSL_read(ssl.get(), buffer, capped); }, false, "Error receiving data");
+    }
 
-        int received = ::recv(socket, buffer, 4096, 0);
-        if(received < 0) {
-            throw std::runtime_error("Error receiving data");
-        }
-        if(received == 0) return "";
+    // Receives data into a caller buffer.
+    /**
+     *
+     * @brief Receives and decrypts into `buffer`, waiting for data when needed.
+     *
+     * @returns The number of bytes received. 0 if the peer closed the session.
+     *
+     * @throw `std::runtime_error()` if the data can't be received.
+     *
+     */
+    size_t recv(void* buffer, size_t size) {
+        int capped = (int)std::min<size_t>(size, INT_MAX);
+        return run([&] { return SSL_read(ssl.get(), buffer, capped); }, true, "Error receiving data");
+    }
 
-        return std::string(buffer, received);
+    // Receives data.
+    /**
+     *
+     * @brief Receives and decrypts up to one TLS record.
+     *
+     * @returns The data received, as a std::string. Empty if the peer closed the session.
+     *
+     * @throw `std::runtime_error()` if the data can't be received.
+     *
+     */
+    std::string recv() {
+        // A TLS record holds at most 16 KB of data.
+        PooledBuffer scratch = BufferPool::forSize(16384).acquire();
+        size_t received = recv(scratch.data(), scratch.capacity());
+        return std::string(scratch.data(), received);
     }
 
-    // Closes the socket.
+    // Sends a file.
     /**
-     * 
-     * @brief ## Closes the socket.
-     * 
-     * @throw `std::runtime_error()` if the socket can't be closed.
-     * 
+     *
+     * @brief ## Sends `length` bytes of a file from `offset`. A length of 0 sends up to the end of the file.
+     *
+     * @param fileFd The file descriptor, ex: from `open()`. Can also be a pipe or a socket, read from where it stands.
+     * @param offset Where to start in the file. If not set, fallback to 0. Must be 0 for a pipe or a socket.
+     * @param length How many bytes to send. If not set, fallback to 0: up to the end of the file.
+     *
+     * @returns The number of bytes sent. Less than `length` if the file ended first.
+     *
+     * @throw `std::runtime_error()` if the file can't be read or sent.
+     *
+     * @note With kernel TLS, the kernel reads, encrypts and sends a regular file with `sendfile()`: no copy through user memory.
+     * @note Otherwise, the file is read in chunks and encrypted by OpenSSL.
+     *
      */
-    void close() {
+    size_t sendFile(int fileFd, int64_t offset=0, size_t length=0) {
+        bool regular = true;
+    #ifndef SO_WINDOWS
+        struct stat info;
+        if(fstat(fileFd, &info) < 0) detail::throwLastError("Error sending file");
+        regular = S_ISREG(info.st_mode);
+        if(!regular && offset != 0) {
+            throw std::runtime_error("Can't send a pipe or socket from an offset");
+        }
+    #endif
+    #if OPENSSL_VERSION_NUMBER >= 0x30000000L && !defined(SO_WINDOWS)
+        // Only a regular file has a size to send up to, and `sendfile()` needs one it can map.
+        if(regular && isKernelTlsSend()) {
+            if(length == 0) {
+                if(info.st_size <= offset) return 0;
+                length = (size_t)(info.st_size - offset);
+            }
+            size_t sent = 0;
+            while(sent < length) {
+                ERR_clear_error();
+                errno = 0;
+                ossl_ssize_t n = SSL_sendfile(ssl.get(), fileFd, (off_t)(offset + sent), length - sent, 0);
+                if(n > 0) { sent += n; continue; }
+                int err = SSL_get_error(ssl.get(), (int)n);
+                if(err == SSL_ERROR_WANT_WRITE) { detail::waitFor(node, true); continue; }
+                if(err == SSL_ERROR_SYSCALL && errno == EINTR) continue;
+                if(err == SSL_ERROR_SYSCALL && errno == 0) break;  // The file got shorter.
+                if(err == SSL_ERROR_SYSCALL) detail::throwLastError("Error sending file");
+                detail::throwTlsError("Error sending file");
+            }
+            return sent;
+        }
+    #endif
 
-    #ifdef SO_WINDOWS
-        if(closesocket(socket) < 0)
+        PooledBuffer chunk = BufferPool::forSize(size_t(1) << 16).acquire();
+        size_t sent = 0;
+        while(length == 0 || sent < length) {
+            size_t want = chunk.capacity();
+            if(length != 0) want = std::min(want, length - sent);
+        #ifdef SO_WINDOWS
+            if(_lseeki64(fileFd, offset + (int64_t)sent, SEEK_SET) < 0) detail::throwLastError("Error reading file");
+            int n = _read(fileFd, chunk.data(), (unsigned)want);
+        #else
+            ssize_t n = regular ? ::pread(fileFd, chunk.data(), want, (off_t)(offset + sent)) : ::read(fileFd, chunk.data(), want);
+            if(n < 0 && errno == EINTR) continue;
+        #endif
+            if(n < 0) detail::throwLastError("Error reading file");
+            if(n == 0) break;  // End of file.
+            sendAll(std::string_view(chunk.data(), (size_t)n));
+            sent += n;
+        }
+        return sent;
+    }
+
+    // True if the kernel encrypts what is sent.
+    bool isKernelTlsSend() const {
+    #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        return BIO_get_ktls_send(SSL_get_wbio(ssl.get())) == 1;
     #else
-        if(::close(socket) < 0)
+        return false;
     #endif
-            throw std::runtime_error("Error closing socket");
-    
     }
 
-    // Returns the socket file descriptor.
-    sock_t getSocket() {
-        return socket;
+    // True if the kernel decrypts what is received.
+    bool isKernelTlsRecv() const {
+    #if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        return BIO_get_ktls_recv(SSL_get_rbio(ssl.get())) == 1;
+    #else
+        return false;
+    #endif
     }
 
-    // Returns the address.
-    sockaddr_in* getAddr() {
-        return &addr;
+    // Ends the session.
+    /**
+     *
+     * @brief Sends the TLS close notification, so the peer can tell a clean end from a truncated stream. Does not close the socket.
+     *
+     * @throw `std::runtime_error()` if the notification can't be sent.
+     *
+     */
+    void shutdown() {
+        ERR_clear_error();
+        int ret = SSL_shutdown(ssl.get());
+        if(ret < 0) {
+            int err = SSL_get_error(ssl.get(), ret);
+            if(err == SSL_ERROR_WANT_WRITE) { detail::waitFor(node, true); SSL_shutdown(ssl.get()); return; }
+            if(err != SSL_ERROR_WANT_READ) detail::throwTlsError("Error ending TLS session");
+        }
     }
-    // Returns the port.
-    int getPort() {
-	return port;
+
+    // Returns the connection.
+    Node& getNode() {
+        return node;
+    }
+
+    // Returns the OpenSSL session, ex: to read the negotiated protocol or the peer certificate.
+    SSL* native() const {
+        return ssl.get();
     }
 };
+#endif
 
 // Returns the last error.
-std::string getLastError() {
-#ifdef SO_WINDOWS
-    return std::to_string(WSAGetLastError());
-#else
-    return std::to_string(errno);
-#endif
+/**
+ *
+ * @brief Returns the message of the last failed socket call, from the system. Ex: "Connection refused".
+ *
+ * @note Read it right after the failure: any later call may overwrite it. Exceptions thrown by the library already carry it,
+ * @note as `std::system_error::code()` and in `what()`, and the `noexcept` calls return it in their `skt::Result`.
+ * @note After catching an exception, print its `what()` instead: the cleanup on the way may have changed the last error.
+ *
+ */
+inline std::string getLastError() {
+    return detail::lastError().message();
 }
 
 }
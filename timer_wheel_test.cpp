@@ -0,0 +1,89 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace std::chrono;
+
+// Drives the wheel like `skt::EventLoop::runOnce()`: sleeps for `nextTimeout()`, then advances.
+static void drive(skt::TimerWheel& wheel, const bool& done) {
+    while(!done) {
+        int timeout = wheel.nextTimeout();
+        assert(timeout >= 0);
+        std::this_thread::sleep_for(milliseconds(timeout));
+        wheel.advance();
+    }
+}
+
+// A timer due right after a level wraps: the slot coming down must not be skipped by `nextTimeout()`.
+static void boundary(int edge) {
+    skt::TimerWheel wheel;
+    bool fired = false;
+    milliseconds late{};
+    auto start = steady_clock::now();
+    wheel.add(milliseconds(edge + 36), [&] { fired = true; late = duration_cast<milliseconds>(steady_clock::now() - start) - milliseconds(edge + 36); });
+
+    // Advance on the last tick before the wrap, so the wheel stops on the boundary.
+    while(wheel.now() < (uint64_t)edge - 1) std::this_thread::yield();
+    wheel.advance();
+    if(wheel.now() < (uint64_t)edge) {
+        int timeout = wheel.nextTimeout();
+        assert(timeout >= 0 && timeout <= 38);
+    }
+    drive(wheel, fired);
+    std::cout << "boundary " << edge << ": " << late.count() << "ms late" << std::endl;
+    assert(late >= milliseconds(0) && late < milliseconds(30));
+}
+
+int main() {
+    // Order, cancel and reset.
+    {
+        skt::TimerWheel wheel;
+        std::vector<int> order;
+        wheel.add(milliseconds(30), [&] { order.push_back(3); });
+        wheel.add(milliseconds(10), [&] { order.push_back(1); });
+        auto cancelled = wheel.add(milliseconds(20), [&] { order.push_back(-1); });
+        auto moved = wheel.add(milliseconds(5), [&] { order.push_back(4); });
+        assert(wheel.cancel(cancelled) && !wheel.cancel(cancelled));
+        assert(wheel.reset(moved, milliseconds(40)));
+        assert(wheel.size() == 3);
+
+        bool done = false;
+        wheel.add(milliseconds(50), [&] { done = true; });
+        drive(wheel, done);
+        assert((order == std::vector<int>{1, 3, 4}));
+        assert(wheel.size() == 0 && wheel.nextTimeout() == -1);
+        assert(!wheel.reset(moved, milliseconds(1)));
+    }
+
+    // Across the first two level wraps.
+    boundary(64);
+    boundary(4096);
+
+    // Randomized: no timer fires early, or much later than due.
+    {
+        skt::TimerWheel wheel;
+        std::mt19937 random(7);
+        std::uniform_int_distribution<int> delay(0, 5000);
+        auto start = steady_clock::now();
+        int pending = 200;
+        milliseconds worst{};
+        for(int i = 0; i < 200; i++) {
+            milliseconds due(delay(random));
+            wheel.add(due, [&, due] {
+                auto elapsed = duration_cast<milliseconds>(steady_clock::now() - start);
+                assert(elapsed >= due);
+                worst = std::max(worst, elapsed - due);
+                pending--;
+            });
+        }
+        bool done = false;
+        wheel.add(milliseconds(5001), [&] { done = true; });
+        drive(wheel, done);
+        std::cout << "random: worst " << worst.count() << "ms late" << std::endl;
+        assert(pending == 0 && worst < milliseconds(30));
+    }
+
+    std::cout << "OK" << std::endl;
+}
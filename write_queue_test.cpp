@@ -0,0 +1,107 @@
+#include "tcpsock.hpp"
+#include <cassert>
+#include <iostream>
+#include <thread>
+
+using namespace std::chrono;
+
+// Runs the loop until `done`, or fails after `limit`.
+template<typename F>
+static void runUntil(skt::EventLoop& loop, F done, milliseconds limit=seconds(10)) {
+    auto deadline = steady_clock::now() + limit;
+    while(!done()) {
+        assert(steady_clock::now() < deadline);
+        loop.runOnce(10);
+    }
+}
+
+int main() {
+    // Backpressure: the queue resumes on WRITABLE, then hands the socket's own `onWritable` back.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        sock_t fd = pair.first;
+        int ownWritable = 0;
+        loop.add(fd, skt::READABLE, {[] {}, [&] { ownWritable++; }, nullptr});
+
+        skt::WriteQueue out(loop, fd, 64 << 10, 16 << 10);
+        bool high = false, low = false;
+        out.onHighWatermark = [&] { high = true; };
+        out.onLowWatermark = [&] { low = true; };
+        std::string payload(4 << 20, 'w');
+        assert(!out.write(std::string(payload)));
+        assert(high && out.isFull());
+
+        std::string received;
+        std::thread reader([&] {
+            pair.second.setNonBlocking(false);
+            char buffer[65536];
+            while(received.size() < payload.size()) received.append(buffer, pair.second.recv(buffer, sizeof(buffer)));
+        });
+        runUntil(loop, [&] { return out.pending() == 0; });
+        reader.join();
+        assert(received == payload && low && !out.isFull());
+        assert(ownWritable == 0);
+        assert(loop.interest(fd) == skt::READABLE);
+
+        // The socket's callback is back in place.
+        loop.modify(fd, skt::READABLE | skt::WRITABLE);
+        runUntil(loop, [&] { return ownWritable > 0; });
+        loop.remove(fd);
+    }
+
+    // A socket already watched for WRITABLE keeps getting its callback while the queue waits.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        sock_t fd = pair.first;
+        int ownWritable = 0;
+        loop.add(fd, skt::READABLE | skt::WRITABLE, {[] {}, [&] { ownWritable++; }, nullptr});
+
+        skt::WriteQueue out(loop, fd);
+        out.write(std::string(4 << 20, 'v'));
+        std::thread reader([&] {
+            pair.second.setNonBlocking(false);
+            char buffer[65536];
+            for(size_t got = 0; got < (4u << 20);) got += pair.second.recv(buffer, sizeof(buffer));
+        });
+        runUntil(loop, [&] { return out.pending() == 0; });
+        reader.join();
+        assert(loop.interest(fd) == (skt::READABLE | skt::WRITABLE));
+        int before = ownWritable;
+        runUntil(loop, [&] { return ownWritable > before; });
+        loop.remove(fd);
+    }
+
+    // A peer that left: the flush reports the error, the process gets no SIGPIPE.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        pair.second.close();
+        skt::WriteQueue out(loop, pair.first);
+        bool failed = false;
+        out.onError = [&] { failed = true; };
+        out.write("hello");
+        runUntil(loop, [&] { return failed; });
+        assert(out.hasFailed() && !out.write("more"));
+    }
+
+    // Writes of a tick are coalesced, in order.
+    {
+        skt::EventLoop loop;
+        auto pair = skt::socketPair(true);
+        skt::WriteQueue out(loop, pair.first);
+        auto shared = std::make_shared<const std::string>(" shared");
+        for(int i = 0; i < 100; i++) out.write(std::to_string(i % 10));
+        out.write(shared);
+        out.write(std::string(" owned"));
+        runUntil(loop, [&] { return out.pending() == 0; });
+        std::string data;
+        pair.second.tryRecv(data);
+        std::string expected;
+        for(int i = 0; i < 100; i++) expected += std::to_string(i % 10);
+        assert(data == expected + " shared owned");
+    }
+
+    std::cout << "OK" << std::endl;
+}